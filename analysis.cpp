@@ -0,0 +1,554 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "analysis.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+typedef struct
+{
+    std::mutex lock;
+    std::deque<u32> chunks;
+} work_queue_t;
+
+typedef struct
+{
+    trace_index_t *idx;
+    std::vector<work_queue_t *> queues;
+    std::atomic<u32> steals;
+    std::atomic<u64> instructions;
+    std::atomic<bool> failed;
+} analysis_t;
+
+// private helpers
+static bool pop_own(work_queue_t *q, u32 *chunk)
+{
+    std::lock_guard<std::mutex> guard(q->lock);
+
+    if (q->chunks.empty())
+        return false;
+
+    *chunk = q->chunks.back();
+    q->chunks.pop_back();
+    return true;
+}
+
+static bool steal(analysis_t *a, u32 self, u32 *chunk)
+{
+    u32 n = (u32)a->queues.size();
+
+    for (u32 i = 1; i < n; i++)
+    {
+        work_queue_t *q = a->queues[(self + i) % n];
+        std::lock_guard<std::mutex> guard(q->lock);
+
+        if (!q->chunks.empty())
+        {
+            *chunk = q->chunks.front();
+            q->chunks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void worker(analysis_t *a, u32 self, std::vector<trace_reducer_t *> *reducers)
+{
+    FILE *fp = fopen(a->idx->path, "rb");
+    if (fp == NULL)
+    {
+        a->failed = true;
+        return;
+    }
+
+    trace_chunk_header_t hdr;
+    trace_chunk_t chunk;
+    trace_record_t prev;
+    u64 instructions = 0;
+    u32 c;
+
+    chunk.reserve(TRACE_CHUNK_RECORDS);
+
+    while (!a->failed)
+    {
+        if (!pop_own(a->queues[self], &c))
+        {
+            if (!steal(a, self, &c))
+                break;
+            a->steals++;
+        }
+
+        const trace_index_entry_t *e = &a->idx->entries[c];
+        if (!trace_read_chunk(fp, e->offset, &hdr, &chunk))
+        {
+            a->failed = true;
+            break;
+        }
+
+        const trace_record_t *pprev = NULL;
+        if (c > 0)
+        {
+            const trace_index_entry_t *pe = &a->idx->entries[c - 1];
+            if (!trace_read_record(fp, pe, pe->count - 1, &prev))
+            {
+                a->failed = true;
+                break;
+            }
+            pprev = &prev;
+        }
+
+        for (size_t i = 0; i < reducers->size(); i++)
+            (*reducers)[i]->map(pprev, chunk, e->first);
+
+        instructions += chunk.size();
+    }
+
+    a->instructions += instructions;
+    fclose(fp);
+}
+
+bool trace_analyze(trace_index_t *idx, std::vector<trace_reducer_t *> &reducers, u32 threads, trace_analysis_stats_t *stats)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    u32 chunks = (u32)idx->entries.size();
+
+    analysis_t a;
+    a.idx = idx;
+    a.steals = 0;
+    a.instructions = 0;
+    a.failed = false;
+
+    // contiguous runs keep each worker's reads sequential until it starts stealing
+    for (u32 t = 0; t < threads; t++)
+    {
+        work_queue_t *q = new work_queue_t;
+        u32 begin = (u32)((u64)chunks * t / threads);
+        u32 end = (u32)((u64)chunks * (t + 1) / threads);
+
+        for (u32 c = end; c > begin; c--)
+            q->chunks.push_back(c - 1);
+
+        a.queues.push_back(q);
+    }
+
+    std::vector<std::vector<trace_reducer_t *> > local(threads);
+    for (u32 t = 0; t < threads; t++)
+    {
+        for (size_t r = 0; r < reducers.size(); r++)
+            local[t].push_back(reducers[r]->clone());
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> pool;
+    for (u32 t = 1; t < threads; t++)
+        pool.push_back(std::thread(worker, &a, t, &local[t]));
+    worker(&a, 0, &local[0]);
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    for (u32 t = 0; t < threads; t++)
+    {
+        for (size_t r = 0; r < reducers.size(); r++)
+        {
+            reducers[r]->merge(*local[t][r]);
+            delete local[t][r];
+        }
+        delete a.queues[t];
+    }
+
+    for (size_t r = 0; r < reducers.size(); r++)
+        reducers[r]->finish();
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    if (stats != NULL)
+    {
+        stats->threads = threads;
+        stats->chunks = chunks;
+        stats->steals = a.steals;
+        stats->instructions = a.instructions;
+        stats->seconds = elapsed.count();
+    }
+
+    return !a.failed;
+}
+
+//--------------------------------------------------------------------------
+// built-in reducers
+static bool count_order(const trace_count_t &a, const trace_count_t &b)
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+    return a.pc < b.pc;
+}
+
+void trace_top_counts(const trace_pc_counts_t &counts, u32 top, std::vector<trace_count_t> *out)
+{
+    out->clear();
+    out->reserve(counts.size());
+
+    for (trace_pc_counts_t::const_iterator it = counts.begin(); it != counts.end(); ++it)
+    {
+        trace_count_t c;
+        c.pc = it->first;
+        c.count = it->second;
+        out->push_back(c);
+    }
+
+    if (top < out->size())
+    {
+        std::partial_sort(out->begin(), out->begin() + top, out->end(), count_order);
+        out->resize(top);
+    }
+    else
+    {
+        std::sort(out->begin(), out->end(), count_order);
+    }
+}
+
+static void merge_counts(trace_pc_counts_t &into, const trace_pc_counts_t &from)
+{
+    for (trace_pc_counts_t::const_iterator it = from.begin(); it != from.end(); ++it)
+        into[it->first] += it->second;
+}
+
+void trace_pc_histogram_t::map(const trace_record_t *, const trace_chunk_t &chunk, u64)
+{
+    for (size_t i = 0; i < chunk.size(); i++)
+        counts[chunk[i].pc]++;
+}
+
+void trace_pc_histogram_t::merge(const trace_reducer_t &other)
+{
+    merge_counts(counts, static_cast<const trace_pc_histogram_t &>(other).counts);
+}
+
+trace_insn_mix_t::trace_insn_mix_t()
+{
+    memset(counts, 0, sizeof counts);
+}
+
+void trace_insn_mix_t::map(const trace_record_t *, const trace_chunk_t &chunk, u64)
+{
+    spu_insn_t insn;
+
+    for (size_t i = 0; i < chunk.size(); i++)
+    {
+        spu_decode(chunk[i].insn, &insn);
+        counts[insn.itype]++;
+    }
+}
+
+void trace_insn_mix_t::merge(const trace_reducer_t &other)
+{
+    const trace_insn_mix_t &o = static_cast<const trace_insn_mix_t &>(other);
+
+    for (u32 i = 0; i <= SPU_INSN_COUNT; i++)
+        counts[i] += o.counts[i];
+}
+
+bool trace_is_block_start(const trace_record_t *prev, const trace_record_t &rec)
+{
+    if (prev == NULL || prev->pc + 4 != rec.pc)
+        return true;
+
+    spu_insn_t insn;
+    spu_decode(prev->insn, &insn);
+
+    return spu_is_branch(insn.itype);
+}
+
+void trace_block_counts_t::map(const trace_record_t *prev, const trace_chunk_t &chunk, u64)
+{
+    for (size_t i = 0; i < chunk.size(); i++)
+    {
+        if (trace_is_block_start(prev, chunk[i]))
+            counts[chunk[i].pc]++;
+        prev = &chunk[i];
+    }
+}
+
+void trace_block_counts_t::merge(const trace_reducer_t &other)
+{
+    merge_counts(counts, static_cast<const trace_block_counts_t &>(other).counts);
+}
+
+static void add_timing(trace_timing_stats_t *s, const spu_issue_t &is)
+{
+    s->instructions++;
+    s->cycles += is.cycles;
+    s->stall += is.stall;
+    if (is.dual)
+        s->dual++;
+}
+
+static void merge_timing(trace_timing_stats_t *into, const trace_timing_stats_t &from)
+{
+    into->executions += from.executions;
+    into->instructions += from.instructions;
+    into->cycles += from.cycles;
+    into->dual += from.dual;
+    into->stall += from.stall;
+    into->penalty += from.penalty;
+}
+
+trace_timing_t::trace_timing_t()
+{
+    memset(&total, 0, sizeof total);
+}
+
+void trace_timing_t::map(const trace_record_t *prev, const trace_chunk_t &chunk, u64)
+{
+    spu_timing_t t;
+    spu_insn_t insn;
+    spu_issue_t is;
+    trace_timing_stats_t *block = NULL;
+    trace_timing_stats_t *last = NULL;
+    bool branch = false;
+
+    spu_timing_reset(&t);
+
+    for (size_t i = 0; i < chunk.size(); i++)
+    {
+        const trace_record_t &rec = chunk[i];
+
+        if (branch)
+        {
+            u32 penalty = spu_timing_branch(&t, prev->pc, rec.pc);
+
+            last->penalty += penalty;
+            total.penalty += penalty;
+            if (block != NULL)
+                block->penalty += penalty;
+        }
+
+        if (trace_is_block_start(prev, rec))
+        {
+            block = &blocks[rec.pc];
+            block->executions++;
+        }
+
+        spu_decode(rec.insn, &insn);
+        spu_timing_issue(&t, rec.pc, rec.insn, &insn, &is);
+
+        last = &pcs[rec.pc];
+        last->executions++;
+        add_timing(last, is);
+        add_timing(&total, is);
+        if (block != NULL)
+            add_timing(block, is);
+
+        branch = spu_is_branch(insn.itype);
+        prev = &rec;
+    }
+
+    total.executions += chunk.size();
+}
+
+void trace_timing_t::merge(const trace_reducer_t &other)
+{
+    const trace_timing_t &o = static_cast<const trace_timing_t &>(other);
+
+    for (trace_timing_map_t::const_iterator it = o.blocks.begin(); it != o.blocks.end(); ++it)
+        merge_timing(&blocks[it->first], it->second);
+    for (trace_timing_map_t::const_iterator it = o.pcs.begin(); it != o.pcs.end(); ++it)
+        merge_timing(&pcs[it->first], it->second);
+
+    merge_timing(&total, o.total);
+}
+
+static void clear_site(trace_hint_site_t *s)
+{
+    memset(s, 0, sizeof *s);
+    s->hint = ~0u;
+}
+
+static trace_hint_site_t *find_site(trace_hint_map_t &sites, u32 pc)
+{
+    trace_hint_map_t::iterator it = sites.find(pc);
+    if (it != sites.end())
+        return &it->second;
+
+    trace_hint_site_t *s = &sites[pc];
+    clear_site(s);
+    return s;
+}
+
+static void merge_site(trace_hint_site_t *into, const trace_hint_site_t &from)
+{
+    into->taken += from.taken;
+    into->not_taken += from.not_taken;
+    into->correct += from.correct;
+    into->wrong += from.wrong;
+    into->late += from.late;
+    into->unhinted += from.unhinted;
+    into->hinted_not_taken += from.hinted_not_taken;
+    into->lost += from.lost;
+    into->hint = std::min(into->hint, from.hint);
+}
+
+trace_hint_analysis_t::trace_hint_analysis_t()
+{
+    clear_site(&total);
+}
+
+void trace_hint_analysis_t::classify(const hint_t *h, u64 distance, u32 pc, u32 next, u64 count)
+{
+    trace_hint_site_t *s = find_site(sites, pc);
+    trace_hint_site_t d;
+    bool taken = (next != pc + 4);
+
+    clear_site(&d);
+
+    bool named = (h != NULL && h->branch == pc);
+    bool late = named && distance < SPU_HINT_LEAD;
+
+    if (named)
+        d.hint = h->pc;
+
+    if (taken)
+    {
+        d.taken = count;
+
+        if (!named)
+            d.unhinted = count;
+        else if (late)
+            d.wrong = d.late = count;
+        else if (h->target != ~0u && h->target != next)
+            d.wrong = count;
+        else
+            d.correct = count;
+
+        d.lost = (d.unhinted + d.wrong) * SPU_BRANCH_PENALTY;
+    }
+    else
+    {
+        d.not_taken = count;
+
+        // a late hint never took effect, so the fall through was predicted
+        if (named && !late)
+        {
+            d.hinted_not_taken = count;
+            d.lost = count * SPU_BRANCH_PENALTY;
+        }
+    }
+
+    merge_site(s, d);
+    merge_site(&total, d);
+}
+
+// pending keys: branch address, next address and the branch's position
+// relative to the chunk (capped, only short distances matter)
+#define PENDING_POS_MAX     (SPU_HINT_LEAD + 1)
+
+void trace_hint_analysis_t::resolve(chunk_t *c, const hint_t *h, u32 pc, u32 next, u64 icount)
+{
+    if (c->hinted)
+    {
+        classify(h, icount - h->icount, pc, next, 1);
+        return;
+    }
+
+    // position 0 is the last record of the previous chunk
+    u64 pos = std::min<u64>(icount + 1 - c->first, PENDING_POS_MAX);
+    c->pending[pc | ((u64)next << 20) | (pos << 40)]++;
+}
+
+void trace_hint_analysis_t::map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first)
+{
+    spu_insn_t insn;
+    hint_t h;
+
+    memset(&h, 0, sizeof h);
+    chunks.push_back(chunk_t());
+    chunk_t *c = &chunks.back();
+    c->first = first;
+    c->hinted = false;
+
+    if (prev != NULL && !chunk.empty())
+    {
+        spu_decode(prev->insn, &insn);
+        if (spu_is_branch(insn.itype))
+            resolve(c, &h, prev->pc, chunk[0].pc, first - 1);
+    }
+
+    for (size_t i = 0; i < chunk.size(); i++)
+    {
+        const trace_record_t &rec = chunk[i];
+        spu_decode(rec.insn, &insn);
+
+        if (spu_is_hint(insn.itype))
+        {
+            h.pc = rec.pc;
+            h.branch = spu_hint_branch(rec.insn, rec.pc);
+            h.target = spu_hint_target(&insn, rec.pc);
+            h.icount = first + i;
+            c->hinted = true;
+        }
+        else if (spu_is_branch(insn.itype) && i + 1 < chunk.size())
+        {
+            resolve(c, &h, rec.pc, chunk[i + 1].pc, first + i);
+        }
+    }
+
+    if (c->hinted)
+        c->last = h;
+}
+
+void trace_hint_analysis_t::merge(const trace_reducer_t &other)
+{
+    const trace_hint_analysis_t &o = static_cast<const trace_hint_analysis_t &>(other);
+
+    for (trace_hint_map_t::const_iterator it = o.sites.begin(); it != o.sites.end(); ++it)
+        merge_site(find_site(sites, it->first), it->second);
+    merge_site(&total, o.total);
+
+    chunks.insert(chunks.end(), o.chunks.begin(), o.chunks.end());
+}
+
+static bool chunk_order(const std::pair<u64, size_t> &a, const std::pair<u64, size_t> &b)
+{
+    return a.first < b.first;
+}
+
+void trace_hint_analysis_t::finish()
+{
+    std::vector<std::pair<u64, size_t> > order;
+    for (size_t i = 0; i < chunks.size(); i++)
+        order.push_back(std::make_pair(chunks[i].first, i));
+    std::sort(order.begin(), order.end(), chunk_order);
+
+    const hint_t *h = NULL;
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        chunk_t &c = chunks[order[i].second];
+
+        for (std::unordered_map<u64, u64>::const_iterator it = c.pending.begin(); it != c.pending.end(); ++it)
+        {
+            u32 pc = (u32)(it->first & 0xfffff);
+            u32 next = (u32)((it->first >> 20) & 0xfffff);
+            u64 pos = it->first >> 40;
+
+            // distance from the hint to the branch; capped positions are
+            // far enough either way
+            u64 distance = (h != NULL) ? (c.first - h->icount) + pos - 1 : 0;
+            classify(h, distance, pc, next, it->second);
+        }
+
+        if (c.hinted)
+            h = &c.last;
+    }
+
+    chunks.clear();
+}
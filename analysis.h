@@ -0,0 +1,202 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef ANALYSIS_H__
+#define ANALYSIS_H__
+
+#include <vector>
+#include <unordered_map>
+#include "types.h"
+#include "spu.h"
+#include "trace.h"
+#include "timing.h"
+
+//
+//      Parallel trace analysis
+//
+//      The chunks of an indexed trace are spread over a pool of worker
+//      threads with work stealing: every worker starts with a contiguous run
+//      of chunks, pops from the back of its own queue and steals from the
+//      front of the others once it runs dry.
+//
+//      Reducers are cloned once per worker and fed whole chunks. When all
+//      chunks are done the clones are merged into the original reducers in
+//      worker order. merge() must be associative and commutative (counts,
+//      sums, minima...), which makes the merged result independent of which
+//      worker happened to process which chunk. State that depends on earlier
+//      chunks can be kept per chunk (keyed by its first instruction) and
+//      resolved in trace order by finish(), which runs once after merging.
+//
+
+class trace_reducer_t
+{
+public:
+    virtual ~trace_reducer_t() {}
+
+    // a new, empty reducer of the same kind
+    virtual trace_reducer_t *clone() const = 0;
+    // fold one chunk in. prev is the record executed right before chunk[0],
+    // or NULL for the first chunk of the trace
+    virtual void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first) = 0;
+    virtual void merge(const trace_reducer_t &other) = 0;
+    virtual void finish() {}
+};
+
+typedef struct
+{
+    u32 threads;
+    u32 chunks;
+    u32 steals;
+    u64 instructions;
+    double seconds;
+} trace_analysis_stats_t;
+
+// threads == 0 uses one worker per hardware thread
+bool trace_analyze(trace_index_t *idx, std::vector<trace_reducer_t *> &reducers, u32 threads, trace_analysis_stats_t *stats);
+
+//--------------------------------------------------------------------------
+// built-in reducers
+typedef std::unordered_map<u32, u64> trace_pc_counts_t;
+
+struct trace_count_t
+{
+    u32 pc;
+    u64 count;
+};
+
+// sorted by descending count, then ascending address
+void trace_top_counts(const trace_pc_counts_t &counts, u32 top, std::vector<trace_count_t> *out);
+
+// executions per PC
+class trace_pc_histogram_t : public trace_reducer_t
+{
+public:
+    trace_pc_counts_t counts;
+
+    trace_reducer_t *clone() const { return new trace_pc_histogram_t; }
+    void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first);
+    void merge(const trace_reducer_t &other);
+};
+
+// executions per instruction type, undecodable words in SPU_INSN_COUNT
+class trace_insn_mix_t : public trace_reducer_t
+{
+public:
+    u64 counts[SPU_INSN_COUNT + 1];
+
+    trace_insn_mix_t();
+    trace_reducer_t *clone() const { return new trace_insn_mix_t; }
+    void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first);
+    void merge(const trace_reducer_t &other);
+};
+
+// executions per basic block, keyed by the block's first address. A block
+// starts after any branch (taken or not) and at any non-sequential PC.
+class trace_block_counts_t : public trace_reducer_t
+{
+public:
+    trace_pc_counts_t counts;
+
+    trace_reducer_t *clone() const { return new trace_block_counts_t; }
+    void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first);
+    void merge(const trace_reducer_t &other);
+};
+
+bool trace_is_block_start(const trace_record_t *prev, const trace_record_t &rec);
+
+// pipeline timing (see timing.h) per basic block and per PC. The model
+// starts cold at every chunk: registers ready, no hint, and the branch
+// ending the previous chunk not charged. Instructions before the first
+// block start of a chunk count towards the totals only.
+struct trace_timing_stats_t
+{
+    u64 executions;
+    u64 instructions;
+    u64 cycles;                 // issue cycles, without branch penalties
+    u64 dual;
+    u64 stall;
+    u64 penalty;                // mispredicted branch cycles
+};
+
+typedef std::unordered_map<u32, trace_timing_stats_t> trace_timing_map_t;
+
+class trace_timing_t : public trace_reducer_t
+{
+public:
+    trace_timing_map_t blocks;  // keyed by the block's first address
+    trace_timing_map_t pcs;
+    trace_timing_stats_t total;
+
+    trace_timing_t();
+    trace_reducer_t *clone() const { return new trace_timing_t; }
+    void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first);
+    void merge(const trace_reducer_t &other);
+};
+
+// branch hint effectiveness per branch site. Every branch is paired with
+// the most recent hint instruction:
+//
+//   correct    taken, the hint names this branch and its target
+//   wrong      taken, the hint names this branch but another target, or
+//              came fewer than SPU_HINT_LEAD instructions earlier
+//   unhinted   taken, the most recent hint names another branch or there
+//              was none
+//   hinted_not_taken   the hint made the branch predicted taken but it
+//              fell through
+//
+// All but correct cost SPU_BRANCH_PENALTY cycles. hbr hints take their
+// target from a register, which the trace does not record; they count as
+// correct whenever they name the branch.
+struct trace_hint_site_t
+{
+    u64 taken;
+    u64 not_taken;
+    u64 correct;
+    u64 wrong;
+    u64 late;                   // part of wrong
+    u64 unhinted;
+    u64 hinted_not_taken;
+    u64 lost;                   // estimated cycles
+    u32 hint;                   // lowest address of a hint naming this branch, ~0 if none
+};
+
+typedef std::unordered_map<u32, trace_hint_site_t> trace_hint_map_t;
+
+class trace_hint_analysis_t : public trace_reducer_t
+{
+public:
+    trace_hint_map_t sites;     // keyed by branch address
+    trace_hint_site_t total;
+
+    trace_hint_analysis_t();
+    trace_reducer_t *clone() const { return new trace_hint_analysis_t; }
+    void map(const trace_record_t *prev, const trace_chunk_t &chunk, u64 first);
+    void merge(const trace_reducer_t &other);
+    void finish();
+
+private:
+    struct hint_t
+    {
+        u32 pc;
+        u32 branch;
+        u32 target;
+        u64 icount;
+    };
+
+    // branches resolved before the chunk's first hint wait for the last
+    // hint of the preceding chunks
+    struct chunk_t
+    {
+        u64 first;
+        bool hinted;
+        hint_t last;
+        std::unordered_map<u64, u64> pending;
+    };
+
+    std::vector<chunk_t> chunks;
+
+    void classify(const hint_t *h, u64 distance, u32 pc, u32 next, u64 count);
+    void resolve(chunk_t *c, const hint_t *h, u32 pc, u32 next, u64 icount);
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "annotate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool annotations_write(const char *path, const std::vector<annotation_t> &notes)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return false;
+
+    for (size_t i = 0; i < notes.size(); i++)
+    {
+        const annotation_t &n = notes[i];
+
+        if (n.color == ANNOTATION_NO_COLOR)
+            fprintf(fp, "%05X - %s\n", n.ea, n.comment.c_str());
+        else
+            fprintf(fp, "%05X %06X %s\n", n.ea, n.color, n.comment.c_str());
+    }
+
+    bool ok = (ferror(fp) == 0);
+    fclose(fp);
+    return ok;
+}
+
+bool annotations_read(const char *path, std::vector<annotation_t> *notes)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return false;
+
+    char line[1024];
+    notes->clear();
+
+    while (fgets(line, sizeof line, fp) != NULL)
+    {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = 0;
+
+        if (len == 0 || line[0] == '#')
+            continue;
+
+        char *p = line;
+        annotation_t n;
+
+        n.ea = strtoul(p, &p, 16);
+        while (*p == ' ')
+            p++;
+
+        if (*p == '-')
+        {
+            n.color = ANNOTATION_NO_COLOR;
+            p++;
+        }
+        else
+        {
+            n.color = strtoul(p, &p, 16);
+        }
+
+        if (*p == ' ')
+            p++;
+
+        n.comment = p;
+        notes->push_back(n);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+u32 annotation_heat(double fraction)
+{
+    if (fraction < 0)
+        fraction = 0;
+    if (fraction > 1)
+        fraction = 1;
+
+    // keep a little colour even for the coolest entries so they stand out
+    // from unannotated code
+    u32 gb = 0xF0 - (u32)(0xA0 * fraction);
+
+    return (gb << 16) | (gb << 8) | 0xFF;
+}
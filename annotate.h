@@ -0,0 +1,38 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef ANNOTATE_H__
+#define ANNOTATE_H__
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+//
+//      Annotation files
+//
+//      Per-address results of the offline tools, in a form the debugger
+//      module can apply to the database. One line per address:
+//
+//          <address> <color> <comment>
+//
+//      address and color are hex, the color in IDA's 0xBBGGRR order or
+//      "-" for none. Empty lines and lines starting with '#' are ignored.
+//
+
+#define ANNOTATION_NO_COLOR     0xFFFFFFFF
+
+typedef struct
+{
+    u32 ea;
+    u32 color;
+    std::string comment;
+} annotation_t;
+
+bool annotations_write(const char *path, const std::vector<annotation_t> &notes);
+bool annotations_read(const char *path, std::vector<annotation_t> *notes);
+
+// white (0) to red (1)
+u32 annotation_heat(double fraction);
+
+#endif
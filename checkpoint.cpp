@@ -0,0 +1,213 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "checkpoint.h"
+#include "mirror.h"
+#include "core.h"
+
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::high_resolution_clock checkpoint_clock;
+
+// set while a save or restore drives the connection
+static std::atomic<bool> busy(false);
+
+// private helpers
+static checkpoint_file_t *checkpoint_map(const char *path, bool create)
+{
+    void *view = NULL;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                              FILE_SHARE_READ, NULL, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER size;
+    if (create || (GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG)sizeof(checkpoint_file_t)))
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, create ? PAGE_READWRITE : PAGE_READONLY, 0, sizeof(checkpoint_file_t), NULL);
+        if (mapping != NULL)
+        {
+            view = MapViewOfFile(mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(checkpoint_file_t));
+            // the view keeps both alive
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+#else
+    int fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (create ? ftruncate(fd, sizeof(checkpoint_file_t)) == 0 : lseek(fd, 0, SEEK_END) >= (off_t)sizeof(checkpoint_file_t))
+    {
+        void *p = mmap(NULL, sizeof(checkpoint_file_t), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            view = p;
+    }
+
+    close(fd);
+#endif
+
+    return (checkpoint_file_t *)view;
+}
+
+static void checkpoint_unmap(checkpoint_file_t *file)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(file);
+#else
+    munmap(file, sizeof(checkpoint_file_t));
+#endif
+}
+
+static bool checkpoint_valid(const checkpoint_file_t *file)
+{
+    return file->magic == CHECKPOINT_MAGIC &&
+           file->version == CHECKPOINT_VERSION &&
+           file->ls_size == LS_SIZE &&
+           file->page_size == LS_PAGE_SIZE &&
+           file->pages == LS_PAGES &&
+           file->reg_count == GDB_REG_COUNT;
+}
+
+// exported functions
+bool checkpoint_save(const char *path, checkpoint_stats_t *stats)
+{
+    checkpoint_clock::time_point start = checkpoint_clock::now();
+
+    memset(stats, 0, sizeof *stats);
+
+    checkpoint_file_t *file = checkpoint_map(path, true);
+    if (file == NULL)
+        return false;
+
+    busy = true;
+
+    // without the registers the file is not a checkpoint; it is left unstamped
+    bool ok = gdb_read_registers(file->reg) &&
+              gdb_read_mem(0, file->ls, LS_SIZE) == LS_SIZE;
+    if (ok)
+    {
+        for (u32 i = 0; i < LS_PAGES; i++)
+            file->page_crc[i] = gdb_crc32(0xffffffff, file->ls + i * LS_PAGE_SIZE, LS_PAGE_SIZE);
+
+        file->version = CHECKPOINT_VERSION;
+        file->ls_size = LS_SIZE;
+        file->page_size = LS_PAGE_SIZE;
+        file->pages = LS_PAGES;
+        file->reg_count = GDB_REG_COUNT;
+        file->created = (u64)time(NULL);
+        file->magic = CHECKPOINT_MAGIC;
+
+        stats->pages = LS_PAGES;
+    }
+
+    checkpoint_unmap(file);
+    busy = false;
+
+    stats->seconds = std::chrono::duration<double>(checkpoint_clock::now() - start).count();
+    return ok;
+}
+
+bool checkpoint_apply(const u8 *const pages[LS_PAGES], const u32 page_crc[LS_PAGES], const u32 reg[GDB_REG_COUNT][4],
+                      checkpoint_stats_t *stats)
+{
+    static u8 current[LS_SIZE];
+    static u32 regs[GDB_REG_COUNT][4];
+    u32 numbers[LS_PAGES];
+    u32 crc[LS_PAGES];
+    bool differs[LS_PAGES];
+
+    // a core file is read-only
+    if (core_active())
+        return false;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        numbers[i] = i;
+
+    // what the target holds now: its page CRCs if it has them, else LS
+    stats->crc = !mirror_active() && gdb_crc_pages(numbers, LS_PAGES, crc);
+    if (stats->crc)
+    {
+        for (u32 i = 0; i < LS_PAGES; i++)
+            differs[i] = crc[i] != page_crc[i];
+    }
+    else
+    {
+        if (gdb_read_mem(0, current, LS_SIZE) != LS_SIZE)
+            return false;
+
+        for (u32 i = 0; i < LS_PAGES; i++)
+            differs[i] = memcmp(current + i * LS_PAGE_SIZE, pages[i], LS_PAGE_SIZE) != 0;
+    }
+
+    stats->pages = LS_PAGES;
+    stats->sent = 0;
+
+    // buffered, then sent with adjacent pages merged
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (!differs[i])
+            continue;
+
+        gdb_write_mem(i * LS_PAGE_SIZE, (u8 *)pages[i], LS_PAGE_SIZE);
+        stats->sent++;
+    }
+    if (!gdb_flush_writes())
+        return false;
+
+    // G covers the 128 GPRs; the SPU id is read-only
+    memcpy(regs, reg, sizeof regs);
+
+    return gdb_write_registers(regs) &&
+           gdb_write_register(GDB_REG_PC, regs[GDB_REG_PC]);
+}
+
+bool checkpoint_restore(const char *path, checkpoint_stats_t *stats)
+{
+    const u8 *pages[LS_PAGES];
+    checkpoint_clock::time_point start = checkpoint_clock::now();
+
+    memset(stats, 0, sizeof *stats);
+
+    checkpoint_file_t *file = checkpoint_map(path, false);
+    if (file == NULL)
+        return false;
+
+    if (!checkpoint_valid(file))
+    {
+        checkpoint_unmap(file);
+        return false;
+    }
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        pages[i] = file->ls + i * LS_PAGE_SIZE;
+
+    busy = true;
+    bool ok = checkpoint_apply(pages, file->page_crc, file->reg, stats);
+    busy = false;
+
+    checkpoint_unmap(file);
+
+    stats->seconds = std::chrono::duration<double>(checkpoint_clock::now() - start).count();
+    return ok;
+}
+
+bool checkpoint_busy(void)
+{
+    return busy;
+}
@@ -0,0 +1,69 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef CHECKPOINT_H__
+#define CHECKPOINT_H__
+
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Checkpoints
+//
+//      A checkpoint file holds all 130 registers and the full local store
+//      as checkpoint_file_t: one 4 KB header, then LS, so the file can be
+//      mapped and LS used in place. The header keeps the qCRC of every
+//      page (gdb_crc32, seeded with ~0), so a restore can ask the stub for
+//      its page CRCs in one pipelined burst and upload only the pages that
+//      differ. Stubs without qCRC get LS read (in one burst) and compared
+//      instead, and so does a target with a mirror.
+//
+//      magic is written last, so a save that did not finish is rejected.
+//
+
+#define CHECKPOINT_MAGIC        0x4b435053      // 'SPCK'
+#define CHECKPOINT_VERSION      1
+#define CHECKPOINT_HEADER_SIZE  4096            // keeps ls page aligned
+
+// send_ioctl codes. buf is the file name; the reply is a checkpoint_stats_t.
+// 1 on success, -1 on failure
+#define CHECKPOINT_IOCTL_SAVE       0x5301
+#define CHECKPOINT_IOCTL_RESTORE    0x5302
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 ls_size;                // LS_SIZE
+    u32 page_size;              // LS_PAGE_SIZE
+    u32 pages;                  // LS_PAGES
+    u32 reg_count;              // GDB_REG_COUNT
+    u64 created;                // time_t
+    u32 page_crc[LS_PAGES];
+    u32 reg[GDB_REG_COUNT][4];
+    u8 pad[CHECKPOINT_HEADER_SIZE - 32 - LS_PAGES * 4 - GDB_REG_COUNT * 16];
+    u8 ls[LS_SIZE];
+} checkpoint_file_t;
+
+typedef struct
+{
+    u32 pages;                  // pages compared
+    u32 sent;                   // pages uploaded by a restore
+    bool crc;                   // compared by qCRC rather than by reading LS
+    double seconds;
+} checkpoint_stats_t;
+
+// false if the registers or LS could not be read; the file is left unstamped
+bool checkpoint_save(const char *path, checkpoint_stats_t *stats);
+// false if the file is not a checkpoint or LS could not be compared
+bool checkpoint_restore(const char *path, checkpoint_stats_t *stats);
+// makes the target's registers and LS these: pages are the LS pages in
+// order, page_crc their gdb_crc32. Only pages that differ are sent. Fills
+// in all of stats but seconds. False if a page or the registers could not
+// be sent.
+bool checkpoint_apply(const u8 *const pages[LS_PAGES], const u32 page_crc[LS_PAGES], const u32 reg[GDB_REG_COUNT][4],
+                      checkpoint_stats_t *stats);
+// true while checkpoint_save or checkpoint_restore drives the connection
+bool checkpoint_busy(void);
+
+#endif
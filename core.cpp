@@ -0,0 +1,257 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "core.h"
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const core_file_t *core = NULL;
+static size_t core_size;
+static u32 trace_records;
+static bool stop_pending = false;
+
+// what core_select swaps
+typedef struct
+{
+    const core_file_t *core;
+    size_t size;
+    u32 trace_records;
+    bool stop_pending;
+} core_connection_t;
+
+static core_connection_t connections[GDB_CONNECTIONS];
+static u32 selected = 0;
+
+// private helpers
+static void *core_map(const char *path, size_t *size, bool create)
+{
+    void *view = NULL;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                              FILE_SHARE_READ, NULL, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER length;
+    if (!create && GetFileSizeEx(file, &length))
+        *size = (size_t)length.QuadPart;
+
+    if (*size >= sizeof(core_file_t))
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, create ? PAGE_READWRITE : PAGE_READONLY,
+                                            (DWORD)((u64)*size >> 32), (DWORD)*size, NULL);
+        if (mapping != NULL)
+        {
+            view = MapViewOfFile(mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, *size);
+            // the view keeps both alive
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+#else
+    int fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (!create)
+    {
+        off_t length = lseek(fd, 0, SEEK_END);
+        *size = length > 0 ? (size_t)length : 0;
+    }
+
+    if (*size >= sizeof(core_file_t) && (!create || ftruncate(fd, *size) == 0))
+    {
+        void *p = mmap(NULL, *size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            view = p;
+    }
+
+    close(fd);
+#endif
+
+    return view;
+}
+
+static void core_unmap(const void *view, size_t size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap((void *)view, size);
+#endif
+}
+
+// exported functions
+void core_select(u32 connection)
+{
+    if (connection >= GDB_CONNECTIONS || connection == selected)
+        return;
+
+    connections[selected].core = core;
+    connections[selected].size = core_size;
+    connections[selected].trace_records = trace_records;
+    connections[selected].stop_pending = stop_pending;
+
+    selected = connection;
+    core = connections[selected].core;
+    core_size = connections[selected].size;
+    trace_records = connections[selected].trace_records;
+    stop_pending = connections[selected].stop_pending;
+}
+
+bool core_open(const char *path)
+{
+    size_t size = 0;
+
+    core_close();
+
+    const core_file_t *file = (const core_file_t *)core_map(path, &size, false);
+    if (file == NULL)
+        return false;
+
+    if (file->magic != CORE_MAGIC ||
+        file->version != CORE_VERSION ||
+        file->ls_size != LS_SIZE ||
+        file->reg_count != GDB_REG_COUNT ||
+        file->bp_count > CORE_MAX_BP)
+    {
+        core_unmap(file, size);
+        return false;
+    }
+
+    core = file;
+    core_size = size;
+    trace_records = (u32)((size - sizeof(core_file_t)) / sizeof(trace_record_t));
+    if (trace_records > file->trace_count)
+        trace_records = file->trace_count;
+    stop_pending = false;
+
+    return true;
+}
+
+void core_close(void)
+{
+    if (core != NULL)
+        core_unmap(core, core_size);
+
+    core = NULL;
+    stop_pending = false;
+}
+
+bool core_active(void)
+{
+    return core != NULL;
+}
+
+const core_file_t *core_file(void)
+{
+    return core;
+}
+
+u32 core_trace(const trace_record_t **records)
+{
+    if (core == NULL)
+        return 0;
+
+    *records = (const trace_record_t *)(core + 1);
+    return trace_records;
+}
+
+bool core_read(u32 addr, u8 *buffer, u32 size)
+{
+    if (core == NULL || addr >= LS_SIZE || size > LS_SIZE - addr)
+        return false;
+
+    memcpy(buffer, core->ls + addr, size);
+    return true;
+}
+
+bool core_read_register(u32 id, u32 reg[4])
+{
+    if (core == NULL || id >= GDB_REG_COUNT)
+        return false;
+
+    memcpy(reg, core->reg[id], sizeof core->reg[id]);
+    return true;
+}
+
+void core_request_stop(void)
+{
+    stop_pending = core != NULL;
+}
+
+bool core_take_stop(u32 *signal, u32 *pc)
+{
+    if (!stop_pending || core == NULL)
+        return false;
+
+    stop_pending = false;
+    *signal = SIGINT;
+    *pc = core->reg[GDB_REG_PC][0];
+    return true;
+}
+
+bool core_save(const char *path, const core_file_t *header, const u8 *ls, const trace_record_t *trace, u32 trace_count)
+{
+    size_t size = sizeof(core_file_t) + (size_t)trace_count * sizeof(trace_record_t);
+
+    if (header->bp_count > CORE_MAX_BP)
+        return false;
+
+    core_file_t *file = (core_file_t *)core_map(path, &size, true);
+    if (file == NULL)
+        return false;
+
+    file->version = CORE_VERSION;
+    file->ls_size = LS_SIZE;
+    file->reg_count = GDB_REG_COUNT;
+    file->created = (u64)time(NULL);
+    file->icount = header->icount;
+    file->signal = header->signal;
+    file->bp_count = header->bp_count;
+    file->trace_count = trace_count;
+    memcpy(file->reg, header->reg, sizeof file->reg);
+    memcpy(file->bp, header->bp, header->bp_count * sizeof file->bp[0]);
+    memcpy(file->ls, ls, LS_SIZE);
+    if (trace_count != 0)
+        memcpy(file + 1, trace, trace_count * sizeof(trace_record_t));
+    file->magic = CORE_MAGIC;
+
+    core_unmap(file, size);
+    return true;
+
+/*
+	// emulator side, where it gives up on the SPU (fail() in anergistic).
+	// trace_tail is a ring of the last TRACE_TAIL records, trace_head the
+	// next slot to fill.
+	static core_file_t header;
+	static trace_record_t tail[TRACE_TAIL];
+	u32 count = ctx->icount < TRACE_TAIL ? (u32)ctx->icount : TRACE_TAIL;
+	u32 first = (trace_head + TRACE_TAIL - count) % TRACE_TAIL;
+
+	for (u32 i = 0; i < count; i++)
+		tail[i] = trace_tail[(first + i) % TRACE_TAIL];
+
+	header.icount = ctx->icount;
+	header.signal = sig;
+	memcpy(header.reg, ctx->reg, 128 * 16);
+	header.reg[GDB_REG_SPU_ID][0] = ctx->spu_id;
+	header.reg[GDB_REG_PC][0] = ctx->pc;
+	for (u32 i = 0; i < GDB_MAX_BP && header.bp_count < CORE_MAX_BP; i++)
+		if (bp_x[i].active)
+			header.bp[header.bp_count++] = (core_bp_t){ bp_x[i].addr, GDB_BP_TYPE_X, bp_x[i].len, 0 };
+	core_save("spu.core", &header, ctx->ls, tail, count);
+*/
+}
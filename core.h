@@ -0,0 +1,80 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef CORE_H__
+#define CORE_H__
+
+#include "types.h"
+#include "gdb.h"
+#include "trace.h"
+
+//
+//      Core files
+//
+//      A core file is what is left of an SPU job that crashed: all 130
+//      registers, LS, the breakpoints that were set, the signal that stopped
+//      it and, optionally, the last instructions it retired. It is laid out
+//      as core_file_t, with LS at a 4 KB offset, followed by trace_count
+//      trace_record_t, oldest first. magic is written last.
+//
+//      Given "core:<path>" as host name, the debugger opens one instead of
+//      connecting to a stub. The file is mapped read-only and memory and
+//      register reads are served straight from the mapping, so a dump opens
+//      at once and needs no emulator. The SPU cannot run: a resume or pause
+//      stops it again where it stands, and writes fail.
+//
+
+#define CORE_MAGIC              0x52435053      // 'SPCR'
+#define CORE_VERSION            1
+#define CORE_HEADER_SIZE        4096            // keeps ls page aligned
+#define CORE_MAX_BP             64
+
+typedef struct
+{
+    u32 addr;
+    u32 type;                   // gdb_bp_type
+    u32 size;
+    u32 reserved;
+} core_bp_t;
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 ls_size;                // LS_SIZE
+    u32 reg_count;              // GDB_REG_COUNT
+    u64 created;                // time_t
+    u64 icount;                 // instructions retired, ~0 if not known
+    u32 signal;                 // what stopped the SPU
+    u32 bp_count;
+    u32 trace_count;            // records after ls
+    u32 reserved;
+    u32 reg[GDB_REG_COUNT][4];
+    core_bp_t bp[CORE_MAX_BP];
+    u8 pad[CORE_HEADER_SIZE - 48 - GDB_REG_COUNT * 16 - CORE_MAX_BP * 16];
+    u8 ls[LS_SIZE];
+} core_file_t;
+
+// one core file per gdb connection, see gdb_select
+void core_select(u32 connection);
+
+// false if path is not a core file; any core open before is closed
+bool core_open(const char *path);
+void core_close(void);
+bool core_active(void);
+const core_file_t *core_file(void);
+// the trace tail; fewer records than trace_count if the file was cut short
+u32 core_trace(const trace_record_t **records);
+
+bool core_read(u32 addr, u8 *buffer, u32 size);
+bool core_read_register(u32 id, u32 reg[4]);
+
+// a resume or a pause: the next core_take_stop reports a stop at the PC
+void core_request_stop(void);
+bool core_take_stop(u32 *signal, u32 *pc);
+
+// writes a core file. header supplies icount, signal, reg, bp_count and
+// bp; the rest is filled in here
+bool core_save(const char *path, const core_file_t *header, const u8 *ls, const trace_record_t *trace, u32 trace_count);
+
+#endif
@@ -23,6 +23,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <map>
 #include <set>
 
 #include <ida.hpp>
@@ -33,11 +34,28 @@
 #include <segment.hpp>
 #include <dbg.hpp>
 #include <allins.hpp>
+#include <bytes.hpp>
+#include <funcs.hpp>
+#include <gdl.hpp>
+#include <fpro.h>
 
 #include "debmod.h"
 #include "include\ps3tmapi.h"
 
 #include "gdb.h"
+#include "spu.h"
+#include "trace.h"
+#include "timing.h"
+#include "annotate.h"
+#include "profile.h"
+#include "mirror.h"
+#include "delta.h"
+#include "prefetch.h"
+#include "search.h"
+#include "checkpoint.h"
+#include "reverse.h"
+#include "lockstep.h"
+#include "core.h"
 
 #ifdef _DEBUG
 #define debug_printf ::msg
@@ -50,6 +68,36 @@
 #define PROCESSOR_NAME "spu"
 
 static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_trace_open(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_trace_seek(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_trace_find_pc(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_spu_timing(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_load_annotations(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_profile_start(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_profile_stop(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_profile_report(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_profile_export(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_delta_track(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_delta_count(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_delta_start(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_delta_size(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_delta_show(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_prefetch_set(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_prefetch_report(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_read_ranges(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_ls_search(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_checkpoint_save(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_checkpoint_restore(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_reverse_start(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_reverse_stop(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_reverse_step(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_reverse_continue(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_reverse_report(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_who_wrote(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_lockstep(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_core_info(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_core_save(idc_value_t *argv, idc_value_t *res);
+static void core_describe(void);
 void get_threads_info(void);
 void clear_all_bp(uint32 tid);
 uint32 read_pc_register(uint32 tid);
@@ -59,6 +107,37 @@ int do_step(uint32 tid, uint32 dbg_notification);
 bool addr_has_bp(uint32 ea);
 
 static const char idc_threadlst_args[] = {0};
+static const char idc_trace_open_args[] = {VT_STR2, 0};
+static const char idc_trace_seek_args[] = {VT_INT64, 0};
+static const char idc_trace_find_pc_args[] = {VT_LONG, VT_INT64, 0};
+static const char idc_spu_timing_args[] = {VT_LONG, 0};
+static const char idc_load_annotations_args[] = {VT_STR2, 0};
+static const char idc_profile_start_args[] = {VT_LONG, VT_LONG, 0};
+static const char idc_profile_stop_args[] = {0};
+static const char idc_profile_report_args[] = {VT_LONG, 0};
+static const char idc_profile_export_args[] = {VT_STR2, 0};
+static const char idc_ls_delta_track_args[] = {VT_LONG, 0};
+static const char idc_ls_delta_count_args[] = {0};
+static const char idc_ls_delta_start_args[] = {VT_LONG, 0};
+static const char idc_ls_delta_size_args[] = {VT_LONG, 0};
+static const char idc_ls_delta_show_args[] = {VT_LONG, 0};
+static const char idc_prefetch_set_args[] = {VT_STR2, VT_LONG, 0};
+static const char idc_prefetch_report_args[] = {VT_LONG, 0};
+static const char idc_ls_read_ranges_args[] = {VT_STR2, 0};
+static const char idc_ls_search_args[] = {VT_STR2, VT_LONG, VT_LONG, 0};
+static const char idc_checkpoint_save_args[] = {VT_STR2, 0};
+static const char idc_checkpoint_restore_args[] = {VT_STR2, 0};
+static const char idc_reverse_start_args[] = {VT_LONG, VT_LONG, 0};
+static const char idc_reverse_stop_args[] = {0};
+static const char idc_reverse_step_args[] = {VT_LONG, 0};
+static const char idc_reverse_continue_args[] = {0};
+static const char idc_reverse_report_args[] = {VT_LONG, 0};
+static const char idc_who_wrote_args[] = {VT_LONG, VT_STR2, 0};
+static const char idc_lockstep_args[] = {VT_STR2, VT_LONG, VT_STR2, VT_LONG, VT_LONG, VT_LONG, 0};
+static const char idc_core_info_args[] = {VT_LONG, 0};
+static const char idc_core_save_args[] = {VT_STR2, VT_LONG, 0};
+
+static trace_index_t *trace_idx = NULL;
 
 std::vector<SNPS3TargetInfo*> Targets;
 std::string TargetName;
@@ -93,7 +172,44 @@ static const unsigned char bpt_code[] = {0x7f, 0xe0, 0x00, 0x08};
 #define STEP_INTO 15
 #define STEP_OVER 16
 
-#define RC_GENERAL 1
+// how long a pause may take before the target is considered unresponsive
+#define PAUSE_TIMEOUT_MS 500
+
+// register classes. There are no channel registers in the stub's
+// register set; the special class is the ABI's link, stack and environment
+// registers instead.
+#define RC_PC       1       // PC and SPU_ID
+#define RC_SPECIAL  2       // r0 - r2
+#define RC_ARGS     4       // r3 - r74, arguments and return values
+#define RC_VOLATILE 8       // r75 - r79
+#define RC_SAVED    16      // r80 - r127, callee-saved
+
+struct register_class_range
+{
+    int cls;
+    u32 first;
+    u32 count;
+};
+
+static const register_class_range register_class_ranges[] =
+{
+    { RC_PC,        128,  2 },
+    { RC_SPECIAL,   0,    3 },
+    { RC_ARGS,      3,   72 },
+    { RC_VOLATILE,  75,   5 },
+    { RC_SAVED,     80,  48 },
+};
+
+static int register_class(u32 reg)
+{
+    for (size_t i = 0; i < qnumber(register_class_ranges); i++)
+    {
+        if (reg >= register_class_ranges[i].first && reg < register_class_ranges[i].first + register_class_ranges[i].count)
+            return register_class_ranges[i].cls;
+    }
+
+    return RC_PC;
+}
 
 struct regval
 {
@@ -105,7 +221,11 @@ typedef struct regval regval;
 //--------------------------------------------------------------------------
 const char* register_classes[] =
 {
-    "General registers",
+    "PC",
+    "Link, stack and environment (r0-r2)",
+    "Arguments and return values (r3-r74)",
+    "Volatile (r75-r79)",
+    "Callee-saved (r80-r127)",
     NULL
 };
 
@@ -142,140 +262,140 @@ char register_names[GPR_COUNT][16] = {0};
 //--------------------------------------------------------------------------
 register_info_t registers[GPR_COUNT] =
 {
-    { "r0",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r1",     REGISTER_FLAGS | REGISTER_ADDRESS | REGISTER_SP,       RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r2",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r3",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r4",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r5",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r6",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r7",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r8",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r9",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r10",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r11",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r12",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r13",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r14",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r15",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r16",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r17",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r18",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r19",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r20",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r21",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r22",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r23",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r24",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r25",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r26",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r27",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r28",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r29",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r30",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r31",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-
-    { "r32",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r33",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r34",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r35",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r36",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r37",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r38",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r39",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r40",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r41",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r42",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r43",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r44",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r45",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r46",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r47",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r48",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r49",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r50",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r51",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r52",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r53",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r54",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r55",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r56",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r57",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r58",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r59",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r60",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r61",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r62",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r63",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-
-    { "r64",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r65",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r66",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r67",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r68",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r69",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r70",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r71",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r72",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r73",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r74",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r75",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r76",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r77",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r78",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r79",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r80",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r81",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r82",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r83",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r84",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r85",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r86",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r87",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r88",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r89",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r90",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r91",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r92",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r93",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r94",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r95",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-
-    { "r96",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r97",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r98",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r99",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r100",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r101",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r102",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r103",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r104",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r105",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r106",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r107",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r108",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r109",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r110",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r111",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r112",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r113",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r114",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r115",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r116",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r117",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r118",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r119",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r120",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r121",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r122",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r123",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r124",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r125",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r126",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-    { "r127",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
-
-    { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_GENERAL,  dt_dword,   NULL,   0 },
-    { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_GENERAL,  dt_dword,   NULL,   0 },
+    { "r0",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SPECIAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r1",     REGISTER_FLAGS | REGISTER_ADDRESS | REGISTER_SP,       RC_SPECIAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r2",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SPECIAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r3",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r4",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r5",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r6",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r7",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r8",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r9",     REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r10",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r11",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r12",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r13",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r14",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r15",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r16",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r17",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r18",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r19",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r20",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r21",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r22",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r23",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r24",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r25",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r26",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r27",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r28",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r29",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r30",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r31",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+
+    { "r32",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r33",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r34",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r35",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r36",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r37",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r38",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r39",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r40",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r41",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r42",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r43",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r44",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r45",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r46",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r47",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r48",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r49",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r50",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r51",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r52",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r53",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r54",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r55",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r56",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r57",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r58",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r59",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r60",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r61",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r62",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r63",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+
+    { "r64",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r65",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r66",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r67",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r68",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r69",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r70",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r71",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r72",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r73",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r74",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r75",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_VOLATILE, REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r76",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_VOLATILE, REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r77",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_VOLATILE, REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r78",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_VOLATILE, REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r79",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_VOLATILE, REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r80",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r81",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r82",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r83",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r84",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r85",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r86",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r87",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r88",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r89",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r90",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r91",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r92",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r93",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r94",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r95",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+
+    { "r96",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r97",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r98",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r99",    REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r100",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r101",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r102",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r103",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r104",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r105",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r106",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r107",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r108",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r109",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r110",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r111",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r112",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r113",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r114",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r115",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r116",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r117",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r118",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r119",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r120",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r121",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r122",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r123",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r124",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r125",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r126",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+    { "r127",   REGISTER_FLAGS | REGISTER_ADDRESS,                     RC_SAVED,    REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 },
+
+    { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_PC,       dt_dword,   NULL,   0 },
+    { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_PC,       dt_dword,   NULL,   0 },
 };
 
 #define SPU_ID 0xdeadbabe
@@ -421,9 +541,9 @@ uint32 registers_id[] =
 #if USE_CUSTOM_FORMAT
 void setup_registers()
 {
-    static register_info_t default_register_info = { "",     REGISTER_FLAGS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 };
-    static register_info_t spu_id_register_info = { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_GENERAL,  dt_dword,   NULL,   0 };
-    static register_info_t pc_register_info = { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_GENERAL,  dt_dword,   NULL,   0 };
+    static register_info_t default_register_info = { "",     REGISTER_FLAGS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 };
+    static register_info_t spu_id_register_info = { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_PC,       dt_dword,   NULL,   0 };
+    static register_info_t pc_register_info = { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_PC,       dt_dword,   NULL,   0 };
 
     for (int i = 0; i < 128; ++i)
     {
@@ -431,6 +551,7 @@ void setup_registers()
         qsnprintf(register_names[i], 16, "r%d", i);
         // setup register info
         registers[i] = default_register_info; registers[i].name = register_names[i]; registers[i].flags |= (REGISTER_ADDRESS | REGISTER_NOLF | ((i == 1) ? REGISTER_SP : 0));
+        registers[i].register_class = register_class(i);
     }
 
     registers[SPU_ID_INDEX] = spu_id_register_info;
@@ -439,9 +560,9 @@ void setup_registers()
 #else
 void setup_registers()
 {
-    static register_info_t default_register_info = { "",     REGISTER_FLAGS,                     RC_GENERAL,  REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 };
-    static register_info_t spu_id_register_info = { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_GENERAL,  dt_dword,   NULL,   0 };
-    static register_info_t pc_register_info = { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_GENERAL,  dt_dword,   NULL,   0 };
+    static register_info_t default_register_info = { "",     REGISTER_FLAGS,                     RC_ARGS,     REGISTER_DATA_TYPE,  REGISTER_DATA_FORMAT,   0 };
+    static register_info_t spu_id_register_info = { "SPU_ID", REGISTER_ADDRESS | REGISTER_READONLY, RC_PC,       dt_dword,   NULL,   0 };
+    static register_info_t pc_register_info = { "PC",     REGISTER_ADDRESS | REGISTER_IP,       RC_PC,       dt_dword,   NULL,   0 };
 
     for (int i = 0; i < 128; ++i)
     {
@@ -455,6 +576,8 @@ void setup_registers()
         registers[i * 4 + 1] = default_register_info; registers[i * 4 + 1].name = register_names[i * 4 + 1]; registers[i * 4 + 1].flags |= (REGISTER_NOLF);
         registers[i * 4 + 2] = default_register_info; registers[i * 4 + 2].name = register_names[i * 4 + 2]; registers[i * 4 + 2].flags |= (REGISTER_NOLF);
         registers[i * 4 + 3] = default_register_info; registers[i * 4 + 3].name = register_names[i * 4 + 3];
+        for (int j = 0; j < 4; ++j)
+            registers[i * 4 + j].register_class = register_class(i);
     }
 
     registers[SPU_ID_INDEX] = spu_id_register_info;
@@ -534,192 +657,1401 @@ bool GetHostnames(const char* input, std::string& ipOut, std::string& dnsNameOut
 	return false;
 }
 
+// compares LS with the previous stop while LsDeltaTrack is on
+static void ls_delta_update(void)
+{
+    delta_stats_t stats;
+
+    if (!delta_tracking())
+        return;
+
+    if (!delta_update())
+    {
+        msg("LS delta: could not read local store\n");
+        return;
+    }
+
+    delta_stats(&stats);
+    if (stats.source == DELTA_SOURCE_SNAPSHOT)
+        return;
+
+    msg("LS delta: %u ranges, %u bytes changed (%u pages via %s, %.2f ms)\n", (uint32)delta_ranges().size(),
+        stats.bytes, stats.pages, delta_source_name(stats.source), stats.seconds * 1000.0);
+}
+
+// a stop the user sees, before IDA reads anything
+static void target_stopped(u32 pc)
+{
+    prefetch_stop(pc);
+    ls_delta_update();
+}
+
 static void handle_events(u32 signal, u32 address)
 {
-    debug_printf("handle_events\n");
+    debug_printf("handle_events\n");
+
+    debug_event_t ev;
+
+    switch (signal)
+    {
+    case SIGABRT:
+        {
+            if (attaching)
+            {
+                debug_printf("SPU3_DBG_EVENT_PROCESS_START\n");
+
+                attaching = false;
+
+                ev.eid     = PROCESS_START;
+                ev.pid     = ProcessID;
+                ev.tid     = NO_THREAD;
+                ev.ea      = BADADDR;
+                ev.handled = true;
+
+                qstrncpy(ev.modinfo.name, "SPU3", sizeof(ev.modinfo.name));
+                ev.modinfo.base = 0;
+                ev.modinfo.size = 0;
+                ev.modinfo.rebase_to = BADADDR;
+
+                events.enqueue(ev, IN_BACK);
+
+                ev.eid     = PROCESS_SUSPEND;
+                ev.pid     = ProcessID;
+
+                events.enqueue(ev, IN_BACK);
+
+                break;
+            }
+        }
+        break;
+    case SIGSEGV:
+        {
+            debug_printf("SPU3_DBG_EVENT_PROCESS_EXIT\n");
+
+            ev.eid     = PROCESS_EXIT;
+            ev.pid     = ProcessID;
+            ev.tid     = NO_THREAD;
+            ev.ea      = BADADDR;
+            ev.handled = true;
+            ev.exit_code = 0;
+
+            events.enqueue(ev, IN_BACK);
+        }
+        break;
+    case SIGINT:
+        {
+            debug_printf("SPU3_DBG_EVENT_INTERRUPT\n");
+
+            // ends a recording run like any other stop
+            reverse_stopped(true);
+
+            ev.eid     = PROCESS_SUSPEND;
+            ev.pid     = ProcessID;
+            ev.tid     = ThreadID;
+            ev.ea      = address;
+            ev.handled = true;
+
+            events.enqueue(ev, IN_BACK);
+
+            target_stopped(address);
+        }
+        break;
+    case SIGTRAP:
+        {
+            debug_printf("SPU3_DBG_EVENT_TRAP\n");
+
+            const gdb_stop_t *stop = gdb_last_stop();
+            bool resuming = continue_from_bp;
+
+            // checkpoint stops of a reverse execution recording are not the user's
+            if (reverse_stopped(addr_has_bp(address) || stop->swbreak || stop->hwbreak || stop->watch != GDB_BP_TYPE_NONE))
+                break;
+
+            if (continue_from_bp == true)
+            {
+                debug_printf("\tContinuing from breakpoint...\n");
+                continue_from_bp = false;
+            }
+            else if (singlestep == true)
+            {
+                debug_printf("\tSingle step...\n");
+
+                ev.eid     = STEP;
+                ev.pid     = ProcessID;
+                ev.tid     = ThreadID;
+                ev.ea      = address;
+                ev.handled = true;
+                ev.exc.code = 0;
+                ev.exc.can_cont = true;
+                ev.exc.ea = BADADDR;
+
+                events.enqueue(ev, IN_BACK);
+
+                continue_from_bp = false;
+                singlestep = false;
+            }
+            else if (stop->watch != GDB_BP_TYPE_NONE)
+            {
+                debug_printf("\tWatchpoint at 0x%08X...\n", stop->watch_addr);
+
+                ev.eid     = BREAKPOINT;
+                ev.pid     = ProcessID;
+                ev.tid     = ThreadID;
+                ev.ea      = address;
+                ev.handled = true;
+                ev.bpt.hea = stop->watch_addr;
+                ev.bpt.kea = BADADDR;
+                ev.exc.ea  = BADADDR;
+
+                events.enqueue(ev, IN_BACK);
+            }
+            else if (!addr_has_bp(address) && !stop->swbreak)
+            {
+                ev.eid     = PROCESS_SUSPEND;
+                ev.pid     = ProcessID;
+                ev.tid     = ThreadID;
+                ev.ea      = address;
+                ev.handled = true;
+
+                events.enqueue(ev, IN_BACK);
+            }
+            else
+            {
+                debug_printf("\tBreakpoint...\n");
+
+                ev.eid     = BREAKPOINT;
+                ev.pid     = ProcessID;
+                ev.tid     = ThreadID;
+                ev.ea      = address;
+                ev.handled = true;
+                ev.bpt.hea = BADADDR;
+                ev.bpt.kea = BADADDR;
+                ev.exc.ea  = BADADDR;
+
+                events.enqueue(ev, IN_BACK);
+            }
+
+            for (std::set<uint32>::const_iterator step_it = step_bpts.begin(); step_it != step_bpts.end(); ++step_it)
+            {
+                uint32 addr = *step_it;
+
+                if (!addr_has_bp(addr))
+                {
+                    main_bpts_map.erase(addr);
+
+                    gdb_remove_bp(addr, GDB_BP_TYPE_X, 4);
+                    debug_printf("step bpt cleared: 0x%08X\n", (uint32)addr);
+                }
+            }
+            step_bpts.clear();
+
+            if (!resuming)
+                target_stopped(address);
+        }
+        break;
+    default:
+        debug_printf("Unknown event signal: 0x%08X\n");
+        break;
+    }
+}
+
+//--------------------------------------------------------------------------
+// Initialize debugger
+static bool idaapi init_debugger(const char *hostname, int port_num, const char *password)
+{
+    debug_printf("init_debugger\n");
+
+    if (!gdb_init(hostname, port_num))
+        return false;
+
+    if (mirror_active())
+        msg("Reading local store from the emulator's shared memory mirror\n");
+
+    if (core_active())
+        core_describe();
+
+	set_idc_func_ex("threadlst", idc_threadlst, idc_threadlst_args, 0);
+	set_idc_func_ex("TraceOpen", idc_trace_open, idc_trace_open_args, 0);
+	set_idc_func_ex("TraceSeek", idc_trace_seek, idc_trace_seek_args, 0);
+	set_idc_func_ex("TraceFindPc", idc_trace_find_pc, idc_trace_find_pc_args, 0);
+	set_idc_func_ex("SpuTiming", idc_spu_timing, idc_spu_timing_args, 0);
+	set_idc_func_ex("LoadAnnotations", idc_load_annotations, idc_load_annotations_args, 0);
+	set_idc_func_ex("ProfileStart", idc_profile_start, idc_profile_start_args, 0);
+	set_idc_func_ex("ProfileStop", idc_profile_stop, idc_profile_stop_args, 0);
+	set_idc_func_ex("ProfileReport", idc_profile_report, idc_profile_report_args, 0);
+	set_idc_func_ex("ProfileExport", idc_profile_export, idc_profile_export_args, 0);
+	set_idc_func_ex("LsDeltaTrack", idc_ls_delta_track, idc_ls_delta_track_args, 0);
+	set_idc_func_ex("LsDeltaCount", idc_ls_delta_count, idc_ls_delta_count_args, 0);
+	set_idc_func_ex("LsDeltaStart", idc_ls_delta_start, idc_ls_delta_start_args, 0);
+	set_idc_func_ex("LsDeltaSize", idc_ls_delta_size, idc_ls_delta_size_args, 0);
+	set_idc_func_ex("LsDeltaShow", idc_ls_delta_show, idc_ls_delta_show_args, 0);
+	set_idc_func_ex("PrefetchSet", idc_prefetch_set, idc_prefetch_set_args, 0);
+	set_idc_func_ex("PrefetchReport", idc_prefetch_report, idc_prefetch_report_args, 0);
+	set_idc_func_ex("LsReadRanges", idc_ls_read_ranges, idc_ls_read_ranges_args, 0);
+	set_idc_func_ex("LsSearch", idc_ls_search, idc_ls_search_args, 0);
+	set_idc_func_ex("CheckpointSave", idc_checkpoint_save, idc_checkpoint_save_args, 0);
+	set_idc_func_ex("CheckpointRestore", idc_checkpoint_restore, idc_checkpoint_restore_args, 0);
+	set_idc_func_ex("ReverseStart", idc_reverse_start, idc_reverse_start_args, 0);
+	set_idc_func_ex("ReverseStop", idc_reverse_stop, idc_reverse_stop_args, 0);
+	set_idc_func_ex("ReverseStep", idc_reverse_step, idc_reverse_step_args, 0);
+	set_idc_func_ex("ReverseContinue", idc_reverse_continue, idc_reverse_continue_args, 0);
+	set_idc_func_ex("ReverseReport", idc_reverse_report, idc_reverse_report_args, 0);
+	set_idc_func_ex("WhoWrote", idc_who_wrote, idc_who_wrote_args, 0);
+	set_idc_func_ex("Lockstep", idc_lockstep, idc_lockstep_args, 0);
+	set_idc_func_ex("CoreInfo", idc_core_info, idc_core_info_args, 0);
+	set_idc_func_ex("CoreSave", idc_core_save, idc_core_save_args, 0);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+// Terminate debugger
+static bool idaapi term_debugger(void)
+{
+    debug_printf("term_debugger\n");
+
+    profile_stop();
+    reverse_stop();
+    gdb_deinit();
+
+	set_idc_func_ex("threadlst", NULL, idc_threadlst_args, 0);
+	set_idc_func_ex("TraceOpen", NULL, idc_trace_open_args, 0);
+	set_idc_func_ex("TraceSeek", NULL, idc_trace_seek_args, 0);
+	set_idc_func_ex("TraceFindPc", NULL, idc_trace_find_pc_args, 0);
+	set_idc_func_ex("SpuTiming", NULL, idc_spu_timing_args, 0);
+	set_idc_func_ex("LoadAnnotations", NULL, idc_load_annotations_args, 0);
+	set_idc_func_ex("ProfileStart", NULL, idc_profile_start_args, 0);
+	set_idc_func_ex("ProfileStop", NULL, idc_profile_stop_args, 0);
+	set_idc_func_ex("ProfileReport", NULL, idc_profile_report_args, 0);
+	set_idc_func_ex("ProfileExport", NULL, idc_profile_export_args, 0);
+	set_idc_func_ex("LsDeltaTrack", NULL, idc_ls_delta_track_args, 0);
+	set_idc_func_ex("LsDeltaCount", NULL, idc_ls_delta_count_args, 0);
+	set_idc_func_ex("LsDeltaStart", NULL, idc_ls_delta_start_args, 0);
+	set_idc_func_ex("LsDeltaSize", NULL, idc_ls_delta_size_args, 0);
+	set_idc_func_ex("LsDeltaShow", NULL, idc_ls_delta_show_args, 0);
+	set_idc_func_ex("PrefetchSet", NULL, idc_prefetch_set_args, 0);
+	set_idc_func_ex("PrefetchReport", NULL, idc_prefetch_report_args, 0);
+	set_idc_func_ex("LsReadRanges", NULL, idc_ls_read_ranges_args, 0);
+	set_idc_func_ex("LsSearch", NULL, idc_ls_search_args, 0);
+	set_idc_func_ex("CheckpointSave", NULL, idc_checkpoint_save_args, 0);
+	set_idc_func_ex("CheckpointRestore", NULL, idc_checkpoint_restore_args, 0);
+	set_idc_func_ex("ReverseStart", NULL, idc_reverse_start_args, 0);
+	set_idc_func_ex("ReverseStop", NULL, idc_reverse_stop_args, 0);
+	set_idc_func_ex("ReverseStep", NULL, idc_reverse_step_args, 0);
+	set_idc_func_ex("ReverseContinue", NULL, idc_reverse_continue_args, 0);
+	set_idc_func_ex("ReverseReport", NULL, idc_reverse_report_args, 0);
+	set_idc_func_ex("WhoWrote", NULL, idc_who_wrote_args, 0);
+	set_idc_func_ex("Lockstep", NULL, idc_lockstep_args, 0);
+	set_idc_func_ex("CoreInfo", NULL, idc_core_info_args, 0);
+	set_idc_func_ex("CoreSave", NULL, idc_core_save_args, 0);
+
+    trace_index_close(trace_idx);
+    trace_idx = NULL;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+int idaapi process_get_info(int n, process_info_t *info)
+{
+    if (n > 0)
+        return 0;
+
+    info->pid = 0;
+    qstrncpy(info->name, "SPU3", sizeof(info->name));
+
+    return 1;
+}
+
+static const char *get_state_name(uint32 State)
+{
+	switch ( State )
+	{
+		case SNPS3_PPU_IDLE:			return "IDLE";
+		case SNPS3_PPU_RUNNABLE:        return "RUNNABLE";
+		case SNPS3_PPU_ONPROC:			return "ONPROC";
+		case SNPS3_PPU_SLEEP:			return "SLEEP";
+		case SNPS3_PPU_SUSPENDED:       return "SUSPENDED";
+		case SNPS3_PPU_SLEEP_SUSPENDED: return "SLEEP_SUSPENDED";
+		case SNPS3_PPU_STOP:			return "STOP";
+		case SNPS3_PPU_ZOMBIE:			return "ZOMBIE";
+		case SNPS3_PPU_DELETED:			return "DELETED";
+		default:						return "???";
+	}
+}
+
+//--------------------------------------------------------------------------
+// the profiler's sampler thread owns the gdb connection while it runs;
+// anything else that talks to the target has to wait for ProfileStop
+static bool profile_owns_target(const char *what)
+{
+    if (!profile_running())
+        return false;
+
+    if (what != NULL)
+        msg("%s: the profiler is running, stop it first\n", what);
+    return true;
+}
+
+static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res)
+{
+	get_threads_info();
+	return eOk;
+}
+
+//--------------------------------------------------------------------------
+// TraceOpen("file"): open a recorded instruction trace, building its index
+// sidecar on first use
+static error_t idaapi idc_trace_open(idc_value_t *argv, idc_value_t *res)
+{
+    trace_index_close(trace_idx);
+    trace_idx = trace_index_open(argv[0].c_str());
+
+    if (trace_idx == NULL)
+    {
+        msg("Could not open trace: %s\n", argv[0].c_str());
+        res->set_long(0);
+        return eOk;
+    }
+
+    msg("Trace: %llu instructions, %u chunks, %u register checkpoints\n",
+        trace_index_count(trace_idx), (uint32)trace_idx->entries.size(), (uint32)trace_idx->checkpoints.size());
+
+    res->set_long(1);
+    return eOk;
+}
+
+// the registers are those of the nearest checkpoint before n, which the
+// instructions in between may have changed
+static void trace_show(u64 n, const trace_record_t &rec)
+{
+    const trace_checkpoint_t *cp = trace_index_checkpoint(trace_idx, n);
+
+    if (cp != NULL)
+    {
+        msg("Trace: instruction %llu at %08X, registers checkpointed at %llu (pc %08X), %llu instructions earlier\n",
+            n, rec.pc, cp->icount, cp->pc, n - cp->icount);
+
+        for (u32 i = 0; i < 128; i += 2)
+            msg("  r%-3u %08X %08X %08X %08X   r%-3u %08X %08X %08X %08X\n",
+                i, cp->reg[i][0], cp->reg[i][1], cp->reg[i][2], cp->reg[i][3],
+                i + 1, cp->reg[i + 1][0], cp->reg[i + 1][1], cp->reg[i + 1][2], cp->reg[i + 1][3]);
+    }
+    else
+        msg("Trace: instruction %llu at %08X\n", n, rec.pc);
+
+    jumpto(rec.pc);
+}
+
+// TraceSeek(n): jump to the PC of the nth recorded instruction and return
+// it, or -1
+static error_t idaapi idc_trace_seek(idc_value_t *argv, idc_value_t *res)
+{
+    trace_record_t rec;
+    u64 n = argv[0].i64;
+
+    if (trace_idx == NULL || !trace_index_seek(trace_idx, n, &rec))
+    {
+        res->set_int64(-1);
+        return eOk;
+    }
+
+    trace_show(n, rec);
+
+    res->set_int64(rec.pc);
+    return eOk;
+}
+
+// TraceFindPc(pc, nth): instruction number of the nth (0-based) hit of pc,
+// or -1, and jump there
+static error_t idaapi idc_trace_find_pc(idc_value_t *argv, idc_value_t *res)
+{
+    trace_record_t rec;
+    u64 n;
+
+    if (trace_idx == NULL ||
+        !trace_index_find_pc(trace_idx, (u32)argv[0].num, argv[1].i64, 0, &n) ||
+        !trace_index_seek(trace_idx, n, &rec))
+    {
+        res->set_int64(-1);
+        return eOk;
+    }
+
+    trace_show(n, rec);
+
+    res->set_int64(n);
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// SpuTiming(ea): static pipeline estimate for the basic blocks of the
+// function containing ea. Stalled instructions are coloured and commented.
+// Returns the number of blocks, or -1 outside a function.
+static error_t idaapi idc_spu_timing(idc_value_t *argv, idc_value_t *res)
+{
+    func_t *pfn = get_func((ea_t)argv[0].num);
+    if (pfn == NULL)
+    {
+        res->set_long(-1);
+        return eOk;
+    }
+
+    qflow_chart_t fc("", pfn, BADADDR, BADADDR, 0);
+    std::vector<u32> words;
+    std::vector<spu_issue_t> issues;
+    u32 cycles = 0, instructions = 0, dual = 0, stall = 0;
+
+    for (int i = 0; i < fc.size(); i++)
+    {
+        ea_t start = fc.blocks[i].startEA;
+        u32 count = (u32)((fc.blocks[i].endEA - start) / 4);
+        if (count == 0)
+            continue;
+
+        words.resize(count);
+        issues.resize(count);
+        for (u32 j = 0; j < count; j++)
+            words[j] = get_long(start + j * 4);
+
+        spu_block_timing_t bt;
+        spu_timing_block(&words[0], count, (u32)start, &bt, &issues[0]);
+
+        msg("%a: %u instructions, %u cycles, %u dual issued, %u stall cycles\n",
+            start, bt.instructions, bt.cycles, bt.dual, bt.stall);
+
+        for (u32 j = 0; j < count; j++)
+        {
+            if (issues[j].stall == 0)
+                continue;
+
+            char buf[32];
+            qsnprintf(buf, sizeof buf, "stall %u", issues[j].stall);
+            set_cmt(start + j * 4, buf, false);
+            set_item_color(start + j * 4, annotation_heat(issues[j].stall / 12.0));
+        }
+
+        cycles += bt.cycles;
+        instructions += bt.instructions;
+        dual += bt.dual;
+        stall += bt.stall;
+    }
+
+    msg("%a: %d blocks, %u instructions, %u cycles if each block runs once (%u dual issued, %u stall cycles)\n",
+        pfn->startEA, fc.size(), instructions, cycles, dual, stall);
+
+    res->set_long(fc.size());
+    return eOk;
+}
+
+// LoadAnnotations("file"): apply an annotation file written by spu3trace
+// as comments and item colours. Returns the number applied, or -1.
+static error_t idaapi idc_load_annotations(idc_value_t *argv, idc_value_t *res)
+{
+    std::vector<annotation_t> notes;
+
+    if (!annotations_read(argv[0].c_str(), &notes))
+    {
+        msg("Could not read annotations: %s\n", argv[0].c_str());
+        res->set_long(-1);
+        return eOk;
+    }
+
+    for (size_t i = 0; i < notes.size(); i++)
+    {
+        if (!notes[i].comment.empty())
+            set_cmt(notes[i].ea, notes[i].comment.c_str(), false);
+        if (notes[i].color != ANNOTATION_NO_COLOR)
+            set_item_color(notes[i].ea, notes[i].color);
+    }
+
+    msg("Applied %u annotations\n", (uint32)notes.size());
+
+    res->set_long((uint32)notes.size());
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// ProfileStart(rate, callers): sample the running target rate times per
+// second, also reading r0 when callers is set
+static error_t idaapi idc_profile_start(idc_value_t *argv, idc_value_t *res)
+{
+    if (get_process_state() != DSTATE_RUN || argv[0].num <= 0)
+    {
+        msg("Profile: the process must be running and the rate positive\n");
+        res->set_long(0);
+        return eOk;
+    }
+
+    res->set_long(profile_start((u32)argv[0].num, argv[1].num != 0) ? 1 : 0);
+    return eOk;
+}
+
+static void profile_function(ea_t ea, ea_t *start, char *name, size_t size)
+{
+    func_t *pfn = get_func(ea);
+
+    if (pfn == NULL || get_func_name(pfn->startEA, name, size) == NULL)
+    {
+        qsnprintf(name, size, "0x%05X", (uint32)ea);
+        *start = ea;
+        return;
+    }
+
+    *start = pfn->startEA;
+}
+
+static bool profile_order(const std::pair<uint32, ea_t> &a, const std::pair<uint32, ea_t> &b)
+{
+    if (a.first != b.first)
+        return a.first > b.first;
+    return a.second < b.second;
+}
+
+static void profile_print(uint32 top)
+{
+    profile_stats_t stats;
+    std::vector<profile_sample_t> samples;
+
+    profile_stats(&stats);
+    profile_samples(&samples);
+
+    msg("Profile: %u samples in %.2f s, %.0f Hz of %u Hz requested\n",
+        stats.samples, stats.seconds, stats.seconds > 0 ? stats.samples / stats.seconds : 0.0, stats.rate);
+    msg("Profile: target interrupted %.2f%% of the time, %.1f us per sample, %u timeouts, %u dropped\n",
+        stats.seconds > 0 ? 100.0 * stats.stopped / stats.seconds : 0.0,
+        stats.samples ? 1e6 * stats.stopped / stats.samples : 0.0, stats.timeouts, stats.dropped);
+
+    std::unordered_map<ea_t, uint32> functions;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        func_t *pfn = get_func(samples[i].pc);
+        functions[pfn != NULL ? pfn->startEA : samples[i].pc] += samples[i].count;
+    }
+
+    std::vector<std::pair<uint32, ea_t> > sorted;
+    for (std::unordered_map<ea_t, uint32>::const_iterator it = functions.begin(); it != functions.end(); ++it)
+        sorted.push_back(std::make_pair(it->second, it->first));
+    std::sort(sorted.begin(), sorted.end(), profile_order);
+
+    for (size_t i = 0; i < sorted.size() && i < top; i++)
+    {
+        char name[MAXNAMELEN];
+        ea_t start;
+
+        profile_function(sorted[i].second, &start, name, sizeof name);
+        msg("  %8u %6.2f%%  %a  %s\n", sorted[i].first,
+            stats.samples ? 100.0 * sorted[i].first / stats.samples : 0.0, start, name);
+    }
+}
+
+// ProfileStop(): stop sampling and print the report
+static error_t idaapi idc_profile_stop(idc_value_t *argv, idc_value_t *res)
+{
+    profile_stop();
+    profile_print(30);
+
+    res->set_long(1);
+    return eOk;
+}
+
+// ProfileReport(top): print the top functions so far, also while sampling
+static error_t idaapi idc_profile_report(idc_value_t *argv, idc_value_t *res)
+{
+    profile_print(argv[0].num > 0 ? (uint32)argv[0].num : 30);
+
+    res->set_long(1);
+    return eOk;
+}
+
+// ProfileExport("file"): write "caller;function count" folded stacks for
+// flame graph tools. The caller comes from r0, which only holds the return
+// address in leaf functions.
+static error_t idaapi idc_profile_export(idc_value_t *argv, idc_value_t *res)
+{
+    std::vector<profile_sample_t> samples;
+    profile_samples(&samples);
+
+    std::map<std::string, uint32> stacks;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        char name[MAXNAMELEN];
+        ea_t start;
+        std::string stack;
+
+        if (samples[i].caller != 0)
+        {
+            profile_function(samples[i].caller, &start, name, sizeof name);
+            stack = name;
+            stack += ';';
+        }
+
+        profile_function(samples[i].pc, &start, name, sizeof name);
+        stack += name;
+
+        stacks[stack] += samples[i].count;
+    }
+
+    FILE *fp = qfopen(argv[0].c_str(), "w");
+    if (fp == NULL)
+    {
+        msg("Could not write %s\n", argv[0].c_str());
+        res->set_long(0);
+        return eOk;
+    }
+
+    for (std::map<std::string, uint32>::const_iterator it = stacks.begin(); it != stacks.end(); ++it)
+        qfprintf(fp, "%s %u\n", it->first.c_str(), it->second);
+    qfclose(fp);
+
+    msg("Profile: %u stacks written to %s\n", (uint32)stacks.size(), argv[0].c_str());
+
+    res->set_long((uint32)stacks.size());
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// ranges LsDeltaShow coloured last, so the next call can clear them
+static std::vector<delta_range_t> delta_shown;
+
+static void ls_delta_color(const delta_range_t &range, bgcolor_t color)
+{
+    ea_t end = range.addr + range.size;
+
+    for (ea_t ea = get_item_head(range.addr); ea != BADADDR && ea < end; ea = next_head(ea, end))
+        set_item_color(ea, color);
+}
+
+// LsDeltaTrack(enable): compare LS at every stop with the stop before.
+// Starting while suspended takes the first copy straight away.
+static error_t idaapi idc_ls_delta_track(idc_value_t *argv, idc_value_t *res)
+{
+    if (argv[0].num == 0)
+    {
+        delta_stop();
+        res->set_long(1);
+        return eOk;
+    }
+
+    delta_start();
+    if (get_process_state() == DSTATE_SUSP && !delta_update())
+    {
+        msg("LS delta: could not read local store\n");
+        res->set_long(0);
+        return eOk;
+    }
+
+    res->set_long(1);
+    return eOk;
+}
+
+// LsDeltaCount(): number of changed ranges at the last stop
+static error_t idaapi idc_ls_delta_count(idc_value_t *argv, idc_value_t *res)
+{
+    res->set_long((uint32)delta_ranges().size());
+    return eOk;
+}
+
+// LsDeltaStart(n), LsDeltaSize(n): address and size of changed range n,
+// -1 past the end
+static error_t idaapi idc_ls_delta_start(idc_value_t *argv, idc_value_t *res)
+{
+    const std::vector<delta_range_t> &ranges = delta_ranges();
+
+    if (argv[0].num < 0 || (size_t)argv[0].num >= ranges.size())
+        res->set_long(-1);
+    else
+        res->set_long(ranges[argv[0].num].addr);
+    return eOk;
+}
+
+static error_t idaapi idc_ls_delta_size(idc_value_t *argv, idc_value_t *res)
+{
+    const std::vector<delta_range_t> &ranges = delta_ranges();
+
+    if (argv[0].num < 0 || (size_t)argv[0].num >= ranges.size())
+        res->set_long(-1);
+    else
+        res->set_long(ranges[argv[0].num].size);
+    return eOk;
+}
+
+// LsDeltaShow(color): list the changed ranges and colour the items in them,
+// clearing the colour of those shown before. -1 only clears.
+static error_t idaapi idc_ls_delta_show(idc_value_t *argv, idc_value_t *res)
+{
+    for (size_t i = 0; i < delta_shown.size(); i++)
+        ls_delta_color(delta_shown[i], DEFCOLOR);
+    delta_shown.clear();
+
+    if (argv[0].num == -1)
+    {
+        res->set_long(0);
+        return eOk;
+    }
+
+    delta_shown = delta_ranges();
+
+    for (size_t i = 0; i < delta_shown.size(); i++)
+    {
+        if (i < 64)
+            msg("  %05X-%05X  %u bytes\n", delta_shown[i].addr, delta_shown[i].addr + delta_shown[i].size, delta_shown[i].size);
+        ls_delta_color(delta_shown[i], (bgcolor_t)argv[0].num);
+    }
+
+    if (delta_shown.size() > 64)
+        msg("  ... %u more\n", (uint32)delta_shown.size() - 64);
+
+    res->set_long((uint32)delta_shown.size());
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// PrefetchSet("name", value): change a stop-time prefetch setting (see
+// prefetch.h). Returns the previous value, or -1 for an unknown name.
+static error_t idaapi idc_prefetch_set(idc_value_t *argv, idc_value_t *res)
+{
+    u32 old;
+
+    if (!prefetch_set(argv[0].c_str(), (u32)argv[1].num, &old))
+    {
+        msg("Prefetch: unknown setting %s\n", argv[0].c_str());
+        res->set_long(-1);
+        return eOk;
+    }
+
+    res->set_long(old);
+    return eOk;
+}
+
+// PrefetchReport(reset): print the settings and how many prefetched pages
+// IDA went on to read. Returns that share in percent.
+static error_t idaapi idc_prefetch_report(idc_value_t *argv, idc_value_t *res)
+{
+    prefetch_stats_t stats;
+    const char *name;
+    u32 value;
+
+    prefetch_stats(&stats);
+
+    msg("Prefetch:");
+    for (u32 i = 0; (name = prefetch_setting(i, &value)) != NULL; i++)
+        msg(" %s=0x%X", name, value);
+    msg("\n");
+
+    uint32 accuracy = stats.fetched ? 100 * stats.used / stats.fetched : 0;
+    msg("Prefetch: %u stops, %u pages asked for, %u fetched, %u read (%u%%), %u wasted, %.2f ms per stop\n",
+        stats.stops, stats.pages, stats.fetched, stats.used, accuracy, stats.wasted,
+        stats.stops ? 1000.0 * stats.seconds / stats.stops : 0.0);
+
+    if (argv[0].num != 0)
+        prefetch_reset();
+
+    res->set_long(accuracy);
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// LsReadRanges("addr,size;addr,size;..."): read all ranges (hex) in one
+// burst. Returns the bytes of each as hex, separated by spaces; a range that
+// could not be read in full comes back empty.
+static error_t idaapi idc_ls_read_ranges(idc_value_t *argv, idc_value_t *res)
+{
+    std::vector<gdb_mem_range_t> ranges;
+    std::vector<u8> data;
+    const char *p = argv[0].c_str();
+    char *end;
+
+    if (profile_owns_target("LsReadRanges"))
+    {
+        res->set_string("");
+        return eOk;
+    }
+
+    while (*p != '\0')
+    {
+        gdb_mem_range_t range = {0, 0, NULL, 0};
+
+        range.addr = strtoul(p, &end, 16);
+        if (end == p || *end != ',')
+            break;
+        p = end + 1;
+
+        range.size = strtoul(p, &end, 16);
+        if (end == p || range.size > LS_SIZE)
+            break;
+        p = *end == ';' ? end + 1 : end;
+
+        ranges.push_back(range);
+    }
+
+    if (*p != '\0')
+    {
+        msg("LsReadRanges: bad range list at \"%s\"\n", p);
+        res->set_string("");
+        return eOk;
+    }
+
+    u32 total = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+        total += ranges[i].size;
+    data.resize(total + 1);
+
+    total = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        ranges[i].buffer = &data[total];
+        total += ranges[i].size;
+    }
+
+    if (!ranges.empty())
+        gdb_read_mem_ranges(&ranges[0], (u32)ranges.size());
+
+    std::string out;
+    char hex[3];
+
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (i != 0)
+            out += ' ';
+        if (ranges[i].length != ranges[i].size)
+            continue;
+        for (u32 j = 0; j < ranges[i].size; j++)
+        {
+            sprintf(hex, "%02X", ranges[i].buffer[j]);
+            out += hex;
+        }
+    }
+
+    res->set_string(out.c_str());
+    return eOk;
+}
+
+// hex bytes, spaces ignored, at most GDB_SEARCH_MAX of them
+static bool parse_hex_bytes(const char *text, u8 out[GDB_SEARCH_MAX], u32 *len)
+{
+    u32 digits = 0;
+    const char *p;
+
+    *len = 0;
+    for (p = text; *p != '\0'; p++)
+    {
+        if (*p == ' ')
+            continue;
+        if (!isxdigit((u8)*p) || *len == GDB_SEARCH_MAX)
+            return false;
+
+        u8 nibble = (u8)(isdigit((u8)*p) ? *p - '0' : (tolower((u8)*p) - 'a' + 10));
+        out[*len] = (digits & 1) ? (out[*len] << 4) | nibble : nibble;
+        if (digits++ & 1)
+            (*len)++;
+    }
+
+    return *len != 0 && (digits & 1) == 0;
+}
+
+// LsSearch("pattern", align, max): find up to max matches (0: all) of the
+// hex byte pattern in LS, at multiples of align. Spaces in the pattern are
+// ignored, so a 128-bit constant can be written as four words. Returns the
+// match addresses as hex, separated by spaces.
+static error_t idaapi idc_ls_search(idc_value_t *argv, idc_value_t *res)
+{
+    u8 pattern[GDB_SEARCH_MAX];
+    u32 len;
+
+    if (profile_owns_target("LsSearch"))
+    {
+        res->set_string("");
+        return eOk;
+    }
+
+    if (!parse_hex_bytes(argv[0].c_str(), pattern, &len))
+    {
+        msg("LsSearch: bad pattern \"%s\"\n", argv[0].c_str());
+        res->set_string("");
+        return eOk;
+    }
+
+    std::vector<u32> matches;
+    search_source source;
+    u32 align = argv[1].num > 0 ? (u32)argv[1].num : 1;
+    u32 max = argv[2].num > 0 ? (u32)argv[2].num : LS_SIZE;
+
+    if (!search_memory(0, LS_SIZE, pattern, len, align, max, &matches, &source))
+        msg("LsSearch: could not read local store\n");
+
+    std::string out;
+    char addr[16];
+
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        sprintf(addr, i != 0 ? " %05X" : "%05X", matches[i]);
+        out += addr;
+    }
+
+    msg("LsSearch: %u matches (%s)\n", (uint32)matches.size(), search_source_name(source));
+    res->set_string(out.c_str());
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+// saves or restores a checkpoint for IDC and send_ioctl, and says how long
+// it took
+static bool checkpoint_run(int fn, const char *path, checkpoint_stats_t *stats)
+{
+    if (fn == CHECKPOINT_IOCTL_SAVE)
+    {
+        if (!checkpoint_save(path, stats))
+        {
+            msg("Checkpoint: could not save %s\n", path);
+            return false;
+        }
+
+        msg("Checkpoint: saved %s in %.2f ms\n", path, 1000.0 * stats->seconds);
+        return true;
+    }
+
+    if (!checkpoint_restore(path, stats))
+    {
+        msg("Checkpoint: could not restore %s\n", path);
+        return false;
+    }
+
+    // what IDA has cached is from before the restore
+    refresh_debugger_memory();
+
+    msg("Checkpoint: restored %s in %.2f ms, %u of %u pages sent (compared by %s)\n",
+        path, 1000.0 * stats->seconds, stats->sent, stats->pages, stats->crc ? "qCRC" : "reading LS");
+    return true;
+}
+
+// CheckpointSave("file"): registers and LS into a checkpoint file (see
+// checkpoint.h). Returns 1, or 0 on failure.
+static error_t idaapi idc_checkpoint_save(idc_value_t *argv, idc_value_t *res)
+{
+    checkpoint_stats_t stats;
+
+    if (profile_owns_target("CheckpointSave"))
+    {
+        res->set_long(0);
+        return eOk;
+    }
+
+    res->set_long(checkpoint_run(CHECKPOINT_IOCTL_SAVE, argv[0].c_str(), &stats) ? 1 : 0);
+    return eOk;
+}
+
+// CheckpointRestore("file"): put a checkpoint back, uploading only the pages
+// that differ. Returns the number of pages sent, or -1 on failure.
+static error_t idaapi idc_checkpoint_restore(idc_value_t *argv, idc_value_t *res)
+{
+    checkpoint_stats_t stats;
+
+    if (profile_owns_target("CheckpointRestore"))
+    {
+        res->set_long(-1);
+        return eOk;
+    }
+
+    if (!checkpoint_run(CHECKPOINT_IOCTL_RESTORE, argv[0].c_str(), &stats))
+        res->set_long(-1);
+    else
+        res->set_long(stats.sent);
+    return eOk;
+}
+
+//--------------------------------------------------------------------------
+static bool reverse_is_bp(u32 pc)
+{
+    return addr_has_bp(pc);
+}
+
+// after a reversal: IDA's view of memory and registers is out of date
+static void reverse_report_move(const char *what, bool ok, u32 pc)
+{
+    reverse_stats_t stats;
+
+    reverse_stats(&stats);
+    refresh_debugger_memory();
+
+    msg("Reverse: %s %s at %05X, instruction %llu, %.2f ms\n", what,
+        ok ? "stopped" : "reached the start of the history or failed,", pc,
+        (uint64)stats.position, 1000.0 * stats.last);
+}
+
+// ReverseStart(interval, budget_mb): record from here on, a checkpoint every
+// interval instructions (0: 100000) within budget_mb megabytes (0: 32).
+// Needs the stub to answer qSPUICount and "i". Returns 1, or 0 if it cannot.
+static error_t idaapi idc_reverse_start(idc_value_t *argv, idc_value_t *res)
+{
+    if (profile_owns_target("ReverseStart"))
+    {
+        res->set_long(0);
+        return eOk;
+    }
+
+    if (!reverse_start((u32)argv[0].num, (u32)argv[1].num << 20))
+    {
+        msg("Reverse: cannot record, the stub does not count instructions (qSPUICount)\n");
+        res->set_long(0);
+        return eOk;
+    }
+
+    res->set_long(1);
+    return eOk;
+}
+
+// ReverseStop(): stop recording and drop the history
+static error_t idaapi idc_reverse_stop(idc_value_t *argv, idc_value_t *res)
+{
+    reverse_stop();
+    res->set_long(0);
+    return eOk;
+}
+
+// ReverseStep(count): "bs", go count instructions back (0 means 1). Returns
+// the new PC, or -1 if the history did not reach that far.
+static error_t idaapi idc_reverse_step(idc_value_t *argv, idc_value_t *res)
+{
+    u32 pc;
+
+    if (profile_owns_target("ReverseStep"))
+    {
+        res->set_long(-1);
+        return eOk;
+    }
+
+    bool ok = reverse_step(argv[0].num > 0 ? (u32)argv[0].num : 1, &pc);
+
+    reverse_report_move("step", ok, pc);
+    res->set_long(ok ? (sval_t)pc : -1);
+    return eOk;
+}
+
+// ReverseContinue(): "bc", go back to the last breakpoint hit. Returns the
+// new PC, or -1 if there was none and the target is at the history start.
+static error_t idaapi idc_reverse_continue(idc_value_t *argv, idc_value_t *res)
+{
+    u32 pc;
+
+    if (profile_owns_target("ReverseContinue"))
+    {
+        res->set_long(-1);
+        return eOk;
+    }
+
+    bool ok = reverse_continue(reverse_is_bp, &pc);
+
+    reverse_report_move("continue", ok, pc);
+    res->set_long(ok ? (sval_t)pc : -1);
+    return eOk;
+}
+
+// ReverseReport(reset): history and memory use, and how long reversals took.
+// Returns the number of checkpoints.
+static error_t idaapi idc_reverse_report(idc_value_t *argv, idc_value_t *res)
+{
+    reverse_stats_t stats;
+
+    reverse_stats(&stats);
+
+    msg("Reverse: %s, %u checkpoints covering instructions %llu-%llu, %u pages, %.1f of %.1f MB, %u evicted\n",
+        reverse_recording() ? "recording" : "off", stats.checkpoints, (uint64)stats.first, (uint64)stats.position,
+        stats.pages, stats.bytes / 1048576.0, stats.budget / 1048576.0, stats.evicted);
+    msg("Reverse: %u reversals, %.2f ms average, %.2f ms worst, %llu instructions replayed, %u pages restored\n",
+        stats.reversals, stats.reversals ? 1000.0 * stats.total / stats.reversals : 0.0, 1000.0 * stats.worst,
+        (uint64)stats.replayed, stats.restored);
+
+    if (argv[0].num != 0)
+        reverse_reset_stats();
+
+    res->set_long(stats.checkpoints);
+    return eOk;
+}
+
+// WhoWrote(addr, "value"): find the instruction that wrote the hex bytes
+// value at addr, from the reverse execution history. Leaves the target right
+// before it and prints its PC and the registers there. Returns the PC, or -1.
+static error_t idaapi idc_who_wrote(idc_value_t *argv, idc_value_t *res)
+{
+    static const char *failures[] =
+    {
+        "",
+        "local store does not hold that value now",
+        "it was already there when the history starts",
+        "not recording, or a replay failed",
+    };
+    u8 value[GDB_SEARCH_MAX];
+    u32 size;
+    u32 addr = (u32)argv[0].num;
+    reverse_write_t write;
+
+    res->set_long(-1);
+
+    if (profile_owns_target("WhoWrote"))
+        return eOk;
+
+    if (!parse_hex_bytes(argv[1].c_str(), value, &size))
+    {
+        msg("WhoWrote: bad value \"%s\"\n", argv[1].c_str());
+        return eOk;
+    }
+
+    reverse_write_result result = reverse_who_wrote(addr, value, size, &write);
+    refresh_debugger_memory();
+
+    if (result != REVERSE_WRITE_FOUND)
+    {
+        msg("WhoWrote: %05X: %s\n", addr, failures[result]);
+        return eOk;
+    }
+
+    u8 word[4];
+    spu_insn_t insn;
+    const char *mnemonic = "?";
+
+    if (gdb_read_mem(write.pc, word, sizeof word) == sizeof word && spu_decode(be32(word), &insn))
+        mnemonic = spu_mnemonic(insn.itype);
+
+    msg("WhoWrote: %05X was written by %s at %05X, instruction %llu (%u replays, %.2f ms)\n",
+        addr, mnemonic, write.pc, (uint64)write.position, write.replays, 1000.0 * write.seconds);
+
+    static u32 reg[GDB_REG_COUNT][4];
+    gdb_read_registers(reg);
+
+    for (u32 i = 0; i < 128; i += 2)
+    {
+        msg("  r%-3u %08X %08X %08X %08X   r%-3u %08X %08X %08X %08X\n",
+            i, reg[i][0], reg[i][1], reg[i][2], reg[i][3],
+            i + 1, reg[i + 1][0], reg[i + 1][1], reg[i + 1][2], reg[i + 1][3]);
+    }
+
+    res->set_long(write.pc);
+    return eOk;
+}
+
+// Lockstep("host_a", port_a, "host_b", port_b, batch, limit): run two
+// emulators loaded with the same image side by side, batch instructions at a
+// time (0 for 100000), until their registers or LS differ or limit
+// instructions went by (0 for no limit). Prints where they parted and what
+// differs. Returns that PC, or -1.
+static error_t idaapi idc_lockstep(idc_value_t *argv, idc_value_t *res)
+{
+    static const char *failures[] =
+    {
+        "",
+        "no difference",
+        "a connection failed, or a stub does not count instructions (qSPUICount)",
+    };
+    static lockstep_report_t report;
 
-    debug_event_t ev;
+    res->set_long(-1);
 
-    switch (signal)
-    {
-    case SIGABRT:
-        {
-            if (attaching)
-            {
-                debug_printf("SPU3_DBG_EVENT_PROCESS_START\n");
+    if (profile_owns_target("Lockstep"))
+        return eOk;
 
-                attaching = false;
+    lockstep_result result = lockstep_run(argv[0].c_str(), (u32)argv[1].num, argv[2].c_str(), (u32)argv[3].num,
+                                          (u32)argv[4].num, (u64)argv[5].num, &report);
 
-                ev.eid     = PROCESS_START;
-                ev.pid     = ProcessID;
-                ev.tid     = NO_THREAD;
-                ev.ea      = BADADDR;
-                ev.handled = true;
+    msg("Lockstep: %llu instructions alike, %u batches, %u replays, %.2f ms\n",
+        (uint64)report.position, report.batches, report.replays, 1000.0 * report.seconds);
 
-                qstrncpy(ev.modinfo.name, "SPU3", sizeof(ev.modinfo.name));
-                ev.modinfo.base = 0;
-                ev.modinfo.size = 0;
-                ev.modinfo.rebase_to = BADADDR;
+    if (result != LOCKSTEP_DIVERGED)
+    {
+        if (result == LOCKSTEP_SAME && report.batches != 0 && report.ran[0] != 0)
+            msg("Lockstep: both stopped at %05X\n", report.pc);
+        else
+            msg("Lockstep: %s\n", failures[result]);
+        return eOk;
+    }
 
-                events.enqueue(ev, IN_BACK);
+    spu_insn_t insn;
+    const char *mnemonic = spu_decode(report.insn, &insn) ? spu_mnemonic(insn.itype) : "?";
 
-                ev.eid     = PROCESS_SUSPEND;
-                ev.pid     = ProcessID;
+    msg("Lockstep: parted at %05X %s, ran %u/%u signal %u/%u\n", report.pc, mnemonic,
+        report.ran[0], report.ran[1], report.signal[0], report.signal[1]);
 
-                events.enqueue(ev, IN_BACK);
+    for (size_t i = 0; i < report.regs.size(); i++)
+    {
+        const lockstep_reg_diff_t &d = report.regs[i];
 
-                break;
-            }
-        }
-        break;
-    case SIGSEGV:
-        {
-            debug_printf("SPU3_DBG_EVENT_PROCESS_EXIT\n");
+        if (d.id == GDB_REG_PC)
+            msg("  pc   %05X / %05X\n", d.a[0], d.b[0]);
+        else
+            msg("  r%-3u %08X %08X %08X %08X / %08X %08X %08X %08X\n", d.id,
+                d.a[0], d.a[1], d.a[2], d.a[3], d.b[0], d.b[1], d.b[2], d.b[3]);
+    }
 
-            ev.eid     = PROCESS_EXIT;
-            ev.pid     = ProcessID;
-            ev.tid     = NO_THREAD;
-            ev.ea      = BADADDR;
-            ev.handled = true;
-            ev.exit_code = 0;
+    for (size_t i = 0; i < report.mem.size(); i++)
+    {
+        const lockstep_mem_diff_t &d = report.mem[i];
+        char a[LOCKSTEP_MEM_SHOWN * 2 + 1], b[LOCKSTEP_MEM_SHOWN * 2 + 1];
+        u32 shown = std::min<u32>(d.size, LOCKSTEP_MEM_SHOWN);
 
-            events.enqueue(ev, IN_BACK);
-        }
-        break;
-    case SIGTRAP:
+        for (u32 j = 0; j < shown; j++)
         {
-            debug_printf("SPU3_DBG_EVENT_TRAP\n");
+            qsnprintf(a + j * 2, 3, "%02X", d.a[j]);
+            qsnprintf(b + j * 2, 3, "%02X", d.b[j]);
+        }
+        a[shown * 2] = b[shown * 2] = 0;
 
-            if (continue_from_bp == true)
-            {
-                debug_printf("\tContinuing from breakpoint...\n");
-                continue_from_bp = false;
-            }
-            else if (singlestep == true)
-            {
-                debug_printf("\tSingle step...\n");
+        msg("  %05X+%-4X %s%s / %s%s\n", d.addr, d.size, a, shown < d.size ? ".." : "", b, shown < d.size ? ".." : "");
+    }
 
-                ev.eid     = STEP;
-                ev.pid     = ProcessID;
-                ev.tid     = ThreadID;
-                ev.ea      = address;
-                ev.handled = true;
-                ev.exc.code = 0;
-                ev.exc.can_cont = true;
-                ev.exc.ea = BADADDR;
+    if (report.mem_bytes != 0)
+        msg("  %u LS bytes differ in all\n", report.mem_bytes);
 
-                events.enqueue(ev, IN_BACK);
+    res->set_long(report.pc);
+    return eOk;
+}
 
-                continue_from_bp = false;
-                singlestep = false;
-            }
-            else if (!addr_has_bp(address))
-            {
-                ev.eid     = PROCESS_SUSPEND;
-                ev.pid     = ProcessID;
-                ev.tid     = ThreadID;
-                ev.ea      = address;
-                ev.handled = true;
+//--------------------------------------------------------------------------
+static const char *core_bp_type_name(u32 type)
+{
+    switch (type)
+    {
+    case GDB_BP_TYPE_X:
+        return "exec";
+    case GDB_BP_TYPE_R:
+        return "read";
+    case GDB_BP_TYPE_W:
+        return "write";
+    case GDB_BP_TYPE_A:
+        return "access";
+    default:
+        return "?";
+    }
+}
 
-                events.enqueue(ev, IN_BACK);
-            }
-            else
-            {
-                debug_printf("\tBreakpoint...\n");
+static void core_describe(void)
+{
+    const core_file_t *core = core_file();
+    const trace_record_t *trace;
+    u32 records = core_trace(&trace);
+
+    msg("Core: SPU stopped by signal %u at %05X", core->signal, core->reg[GDB_REG_PC][0]);
+    if (core->icount != ~0ull)
+        msg(" after %llu instructions", (uint64)core->icount);
+    msg(", %u breakpoints, %u trace records. It cannot run.\n", core->bp_count, records);
+}
 
-                ev.eid     = BREAKPOINT;
-                ev.pid     = ProcessID;
-                ev.tid     = ThreadID;
-                ev.ea      = address;
-                ev.handled = true;
-                ev.bpt.hea = BADADDR;
-                ev.bpt.kea = BADADDR;
-                ev.exc.ea  = BADADDR;
+// CoreInfo(count): what the open core file holds: the stop, the breakpoints
+// and the last count records of its trace tail (0 for 16). Returns the
+// number of trace records, or -1 without a core file.
+static error_t idaapi idc_core_info(idc_value_t *argv, idc_value_t *res)
+{
+    u32 count = argv[0].num > 0 ? (u32)argv[0].num : 16;
 
-                events.enqueue(ev, IN_BACK);
-            }
+    if (!core_active())
+    {
+        msg("Core: no core file is open\n");
+        res->set_long(-1);
+        return eOk;
+    }
 
-            for (std::set<uint32>::const_iterator step_it = step_bpts.begin(); step_it != step_bpts.end(); ++step_it)
-            {
-                uint32 addr = *step_it;
+    const core_file_t *core = core_file();
+    const trace_record_t *trace;
+    u32 records = core_trace(&trace);
 
-                if (!addr_has_bp(addr))
-                {
-                    main_bpts_map.erase(addr);
+    core_describe();
 
-                    gdb_remove_bp(addr, GDB_BP_TYPE_X, 4);
-                    debug_printf("step bpt cleared: 0x%08X\n", (uint32)addr);
-                }
-            }
-            step_bpts.clear();
-        }
-        break;
-    default:
-        debug_printf("Unknown event signal: 0x%08X\n");
-        break;
+    for (u32 i = 0; i < core->bp_count; i++)
+        msg("  breakpoint %05X %s, %u bytes\n", core->bp[i].addr, core_bp_type_name(core->bp[i].type), core->bp[i].size);
+
+    if (count > records)
+        count = records;
+
+    for (u32 i = records - count; i < records; i++)
+    {
+        spu_insn_t insn;
+        const char *mnemonic = spu_decode(trace[i].insn, &insn) ? spu_mnemonic(insn.itype) : "?";
+
+        msg("  trace %-6d %05X %08X %s\n", (int)(i - records), trace[i].pc, trace[i].insn, mnemonic);
     }
+
+    res->set_long(records);
+    return eOk;
 }
 
-//--------------------------------------------------------------------------
-// Initialize debugger
-static bool idaapi init_debugger(const char *hostname, int port_num, const char *password)
+// CoreSave("file", records): write the stopped target as a core file, with
+// IDA's breakpoints and the last records instructions of the open trace.
+// Returns 1, or 0 on failure.
+static error_t idaapi idc_core_save(idc_value_t *argv, idc_value_t *res)
 {
-    debug_printf("init_debugger\n");
+    static core_file_t header;
+    static u8 ls[LS_SIZE];
+    std::vector<trace_record_t> tail;
 
-    if (!gdb_init(port_num))
-        return false;
+    res->set_long(0);
 
-	set_idc_func_ex("threadlst", idc_threadlst, idc_threadlst_args, 0);
+    if (profile_owns_target("CoreSave"))
+        return eOk;
 
-	return true;
-}
+    memset(&header, 0, sizeof header);
+    if (!gdb_read_registers(header.reg))
+    {
+        msg("Core: cannot read registers\n");
+        return eOk;
+    }
 
-//--------------------------------------------------------------------------
-// Terminate debugger
-static bool idaapi term_debugger(void)
-{
-    debug_printf("term_debugger\n");
+    if (gdb_read_mem(0, ls, LS_SIZE) != LS_SIZE)
+    {
+        msg("Core: cannot read local store\n");
+        return eOk;
+    }
 
-    gdb_deinit();
+    if (!gdb_icount(&header.icount))
+        header.icount = ~0ull;
+    header.signal = gdb_last_stop()->signal;
 
-	set_idc_func_ex("threadlst", NULL, idc_threadlst_args, 0);
+    for (int i = 0; i < get_bpt_qty() && header.bp_count < CORE_MAX_BP; i++)
+    {
+        bpt_t bpt;
+        u32 type;
 
-	return true;
-}
+        if (!getn_bpt(i, &bpt) || !bpt.enabled())
+            continue;
 
-//--------------------------------------------------------------------------
-int idaapi process_get_info(int n, process_info_t *info)
-{
-    if (n > 0)
-        return 0;
+        switch (bpt.type)
+        {
+        case BPT_SOFT:
+        case BPT_EXEC:
+            type = GDB_BP_TYPE_X;
+            break;
+        case BPT_WRITE:
+            type = GDB_BP_TYPE_W;
+            break;
+        case BPT_RDWR:
+            type = GDB_BP_TYPE_A;
+            break;
+        default:
+            continue;
+        }
 
-    info->pid = 0;
-    qstrncpy(info->name, "SPU3", sizeof(info->name));
+        core_bp_t &bp = header.bp[header.bp_count++];
+        bp.addr = (u32)bpt.ea;
+        bp.type = type;
+        bp.size = (u32)bpt.size;
+    }
 
-    return 1;
-}
+    if (trace_idx != NULL && argv[1].num > 0)
+    {
+        u64 total = trace_index_count(trace_idx);
+        u64 n = std::min<u64>((u64)argv[1].num, total);
+        trace_record_t rec;
 
-static const char *get_state_name(uint32 State)
-{
-	switch ( State )
-	{
-		case SNPS3_PPU_IDLE:			return "IDLE";
-		case SNPS3_PPU_RUNNABLE:        return "RUNNABLE";
-		case SNPS3_PPU_ONPROC:			return "ONPROC";
-		case SNPS3_PPU_SLEEP:			return "SLEEP";
-		case SNPS3_PPU_SUSPENDED:       return "SUSPENDED";
-		case SNPS3_PPU_SLEEP_SUSPENDED: return "SLEEP_SUSPENDED";
-		case SNPS3_PPU_STOP:			return "STOP";
-		case SNPS3_PPU_ZOMBIE:			return "ZOMBIE";
-		case SNPS3_PPU_DELETED:			return "DELETED";
-		default:						return "???";
-	}
-}
+        for (u64 i = total - n; i < total && trace_index_seek(trace_idx, i, &rec); i++)
+            tail.push_back(rec);
+    }
 
-static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res)
-{
-	get_threads_info();
-	return eOk;
+    if (!core_save(argv[0].c_str(), &header, ls, tail.empty() ? NULL : &tail[0], (u32)tail.size()))
+    {
+        msg("Core: cannot write %s\n", argv[0].c_str());
+        return eOk;
+    }
+
+    msg("Core: saved %s, %u breakpoints, %u trace records\n", argv[0].c_str(), header.bp_count, (u32)tail.size());
+    res->set_long(1);
+    return eOk;
 }
 
 void get_threads_info(void)
@@ -984,13 +2316,25 @@ int idaapi prepare_to_pause_process(void)
 {
     debug_printf("prepare_to_pause_process\n");
 
-    //gdb_pause();
+    profile_stop();
 
-	debug_event_t ev;
-	ev.eid     = PROCESS_SUSPEND;
-	ev.pid     = ProcessID;
+    u32 sig, pc;
+    if (!gdb_interrupt(PAUSE_TIMEOUT_MS, &sig, &pc))
+    {
+        msg("SPU did not stop within %u ms\n", PAUSE_TIMEOUT_MS);
+        return 0;
+    }
 
-    events.enqueue(ev, IN_BACK);
+    if (pc == ~0u)
+    {
+        u32 reg[4];
+        gdb_read_register(0x81, reg);
+        pc = reg[0];
+    }
+
+    // SIGINT becomes PROCESS_SUSPEND at pc; a breakpoint that beat the
+    // interrupt is reported as the breakpoint
+    handle_events(sig, pc);
 
 	return 1;
 }
@@ -1000,6 +2344,7 @@ int idaapi deci3_exit_process(void)
 {
     debug_printf("deci3_exit_process\n");
 
+    profile_stop();
     gdb_kill();
 
     debug_event_t ev;
@@ -1052,7 +2397,16 @@ gdecode_t idaapi get_debug_event(debug_event_t *event, int ida_is_idle)
 
 	while ( true )
 	{
-        gdb_handle_events(handle_events);
+        // the profiler owns the connection while it samples, and reversals,
+        // lockstep runs and checkpoint files drive it themselves
+        if (!profile_running() && !reverse_busy() && !lockstep_busy() && !checkpoint_busy())
+        {
+            u32 sig, pc;
+            if (profile_take_stop(&sig, &pc))
+                handle_events(sig, pc);
+
+            gdb_handle_events(handle_events);
+        }
 
 		if ( events.retrieve(event) )
 		{
@@ -1115,8 +2469,9 @@ int idaapi continue_after_event(const debug_event_t *event)
 
 #endif
 
+    // reverse_resume is gdb_continue unless reverse execution is recording
     if (event->eid == PROCESS_ATTACH || event->eid == PROCESS_SUSPEND || event->eid == STEP || event->eid == BREAKPOINT)
-        gdb_continue();
+        reverse_resume();
 
     return true;
 }
@@ -1191,7 +2546,13 @@ int idaapi thread_suspend(thid_t tid)
 {
 	debug_printf("thread_suspend: tid = 0x%llX\n", (uint64)tid);
 
-    gdb_pause();
+    u32 sig, pc;
+    if (!gdb_interrupt(PAUSE_TIMEOUT_MS, &sig, &pc))
+        return 0;
+
+    // anything but our own interrupt is still an event IDA has to see
+    if (sig != SIGINT)
+        handle_events(sig, pc);
 
 	return 1;
 }
@@ -1201,216 +2562,13 @@ int idaapi thread_continue(thid_t tid)
 {
 	debug_printf("thread_continue: tid = 0x%llX\n", (uint64)tid);
 
-    gdb_continue();
+    reverse_resume();
 
 	return 1;
 }
 
 #define G_STR_SIZE 256
 
-enum spu_instructions
-{
-    SPU_a  =   58,
-    SPU_absdb  =   150,
-    SPU_addx  =   108,
-    SPU_ah  =   76,
-    SPU_ahi  =   9,
-    SPU_ai  =   8,
-    SPU_and  =   70,
-    SPU_andbi  =   7,
-    SPU_andc  =   59,
-    SPU_andhi  =   6,
-    SPU_andi  =   5,
-    SPU_avgb  =   84,
-    SPU_bg  =   41,
-    SPU_bgx  =   97,
-    SPU_bi  =   109,
-    SPU_bihnz  =   93,
-    SPU_bihz  =   92,
-    SPU_binz  =   91,
-    SPU_bisl  =   110,
-    SPU_bisled  =   112,
-    SPU_biz  =   90,
-    SPU_br  =   171,
-    SPU_bra  =   166,
-    SPU_brasl  =   169,
-    SPU_brhnz  =   163,
-    SPU_brhz  =   161,
-    SPU_brnz  =   159,
-    SPU_brsl  =   172,
-    SPU_brz  =   157,
-    SPU_cbd  =   180,
-    SPU_cbx  =   139,
-    SPU_cdd  =   183,
-    SPU_cdx  =   142,
-    SPU_ceq  =   124,
-    SPU_ceqb  =   138,
-    SPU_ceqbi  =   27,
-    SPU_ceqh  =   131,
-    SPU_ceqhi  =   26,
-    SPU_ceqi  =   25,
-    SPU_cflts  =   195,
-    SPU_cfltu  =   196,
-    SPU_cg  =   60,
-    SPU_cgt  =   39,
-    SPU_cgtb  =   44,
-    SPU_cgtbi  =   17,
-    SPU_cgth  =   42,
-    SPU_cgthi  =   16,
-    SPU_cgti  =   15,
-    SPU_cgx  =   96,
-    SPU_chd  =   181,
-    SPU_chx  =   140,
-    SPU_clgt  =   69,
-    SPU_clgtb  =   83,
-    SPU_clgtbi  =   21,
-    SPU_clgth  =   65,
-    SPU_clgthi  =   20,
-    SPU_clgti  =   19,
-    SPU_clz  =   62,
-    SPU_cntb  =   66,
-    SPU_csflt  =   197,
-    SPU_cuflt  =   198,
-    SPU_cwd  =   182,
-    SPU_cwx  =   141,
-    SPU_dfa  =   80,
-    SPU_dfceq  =   126,
-    SPU_dfcgt  =   72,
-    SPU_dfcmeq  =   133,
-    SPU_dfcmgt  =   79,
-    SPU_dfm  =   82,
-    SPU_dfma  =   101,
-    SPU_dfms  =   102,
-    SPU_dfnma  =   104,
-    SPU_dfnms  =   103,
-    SPU_dfs  =   81,
-    SPU_dftsv  =   178,
-    SPU_dsync  =   32,
-    SPU_eqv  =   43,
-    SPU_fa  =   73,
-    SPU_fceq  =   125,
-    SPU_fcgt  =   71,
-    SPU_fcmeq  =   132,
-    SPU_fcmgt  =   78,
-    SPU_fesd  =   45,
-    SPU_fi  =   86,
-    SPU_fm  =   75,
-    SPU_fma  =   155,
-    SPU_fms  =   156,
-    SPU_fnms  =   154,
-    SPU_frds  =   47,
-    SPU_frest  =   121,
-    SPU_frsqest  =   122,
-    SPU_fs  =   74,
-    SPU_fscrrd  =   107,
-    SPU_fscrwr  =   123,
-    SPU_fsm  =   117,
-    SPU_fsmb  =   119,
-    SPU_fsmbi  =   162,
-    SPU_fsmh  =   118,
-    SPU_gb  =   114,
-    SPU_gbb  =   116,
-    SPU_gbh  =   115,
-    SPU_hbr  =   113,
-    SPU_hbra  =   192,
-    SPU_hbrr  =   194,
-    SPU_heq  =   89,
-    SPU_heqi  =   28,
-    SPU_hgt  =   37,
-    SPU_hgti  =   18,
-    SPU_hlgt  =   85,
-    SPU_hlgti  =   22,
-    SPU_il  =   165,
-    SPU_ila  =   193,
-    SPU_ilh  =   160,
-    SPU_ilhu  =   173,
-    SPU_iohl  =   167,
-    SPU_iret  =   111,
-    SPU_lnop  =   30,
-    SPU_lqa  =   170,
-    SPU_lqd  =   11,
-    SPU_lqr  =   168,
-    SPU_lqx  =   127,
-    SPU_lr  =   199,
-    SPU_mfspr  =   34,
-    SPU_mpy  =   61,
-    SPU_mpya  =   153,
-    SPU_mpyh  =   128,
-    SPU_mpyhh  =   129,
-    SPU_mpyhha  =   99,
-    SPU_mpyhhau  =   100,
-    SPU_mpyhhu  =   136,
-    SPU_mpyi  =   23,
-    SPU_mpys  =   130,
-    SPU_mpyu  =   38,
-    SPU_mpyui  =   24,
-    SPU_mtspr  =   87,
-    SPU_nand  =   68,
-    SPU_nop  =   33,
-    SPU_nor  =   120,
-    SPU_or  =   40,
-    SPU_orbi  =   2,
-    SPU_orc  =   77,
-    SPU_orhi  =   1,
-    SPU_ori  =   0,
-    SPU_orx  =   149,
-    SPU_rchcnt  =   36,
-    SPU_rdch  =   35,
-    SPU_rot  =   48,
-    SPU_roth  =   52,
-    SPU_rothi  =   188,
-    SPU_rothm  =   53,
-    SPU_rothmi  =   189,
-    SPU_roti  =   184,
-    SPU_rotm  =   49,
-    SPU_rotma  =   50,
-    SPU_rotmah  =   54,
-    SPU_rotmahi  =   190,
-    SPU_rotmai  =   186,
-    SPU_rotmi  =   185,
-    SPU_rotqbi  =   143,
-    SPU_rotqbii  =   179,
-    SPU_rotqby  =   146,
-    SPU_rotqbybi  =   134,
-    SPU_rotqbyi  =   176,
-    SPU_rotqmbi  =   144,
-    SPU_rotqmbii  =   174,
-    SPU_rotqmby  =   147,
-    SPU_rotqmbybi  =   135,
-    SPU_rotqmbyi  =   177,
-    SPU_selb  =   151,
-    SPU_sf  =   105,
-    SPU_sfh  =   56,
-    SPU_sfhi  =   4,
-    SPU_sfi  =   3,
-    SPU_sfx  =   95,
-    SPU_shl  =   51,
-    SPU_shlh  =   55,
-    SPU_shlhi  =   57,
-    SPU_shli  =   187,
-    SPU_shlqbi  =   145,
-    SPU_shlqbii  =   191,
-    SPU_shlqby  =   148,
-    SPU_shlqbybi  =   137,
-    SPU_shlqbyi  =   175,
-    SPU_shufb  =   152,
-    SPU_stop  =   29,
-    SPU_stopd  =   94,
-    SPU_stqa  =   158,
-    SPU_stqd  =   10,
-    SPU_stqr  =   164,
-    SPU_stqx  =   98,
-    SPU_sumb  =   46,
-    SPU_sync  =   31,
-    SPU_wrch  =   88,
-    SPU_xor  =   106,
-    SPU_xorbi  =   14,
-    SPU_xorhi  =   13,
-    SPU_xori  =   12,
-    SPU_xsbh  =   67,
-    SPU_xshw  =   64,
-    itype_xswd  =   63,
-};
 
 //-------------------------------------------------------------------------
 int do_step(uint32 tid, uint32 dbg_notification)
@@ -1504,6 +2662,9 @@ int idaapi thread_set_step(thid_t tid)
 {
     debug_printf("thread_set_step\n");
 
+    if (profile_owns_target(NULL))
+        return 0;
+
 	int dbg_notification;
 	int result = 0;
 
@@ -1556,26 +2717,44 @@ int idaapi read_registers(thid_t tid, int clsmask, regval_t *values)
 
     debug_printf("read_registers\n");
 
+    if (profile_owns_target(NULL))
+        return 0;
+
     u32 reg[130][4] = {0};
-    gdb_read_registers(reg);
 
-    for (u32 i = 0; i < 128; ++i)
+    // only the classes IDA shows; the rest stay on the target
+    for (size_t c = 0; c < qnumber(register_class_ranges); c++)
     {
+        const register_class_range &r = register_class_ranges[c];
+        if ((clsmask & r.cls) == 0)
+            continue;
+
+        gdb_read_register_range(r.first, r.count, reg);
+
+        for (u32 i = r.first; i < r.first + r.count; ++i)
+        {
+            if (i == 0x80)
+            {
+                values[SPU_ID_INDEX].set_int(reg[i][0]);
+            }
+            else if (i == 0x81)
+            {
+                values[PC_INDEX].set_int(reg[i][0]);
+            }
+            else
+            {
 #if USE_CUSTOM_FORMAT
-        values[i].set_bytes((u8*)reg[i], 16);
+                values[i].set_bytes((u8*)reg[i], 16);
 #else
-        values[i * 4 + 0].set_int(reg[i][0]);
-        values[i * 4 + 1].set_int(reg[i][1]);
-        values[i * 4 + 2].set_int(reg[i][2]);
-        values[i * 4 + 3].set_int(reg[i][3]);
+                values[i * 4 + 0].set_int(reg[i][0]);
+                values[i * 4 + 1].set_int(reg[i][1]);
+                values[i * 4 + 2].set_int(reg[i][2]);
+                values[i * 4 + 3].set_int(reg[i][3]);
 #endif
+            }
+        }
     }
 
-    // SPU_ID
-    values[SPU_ID_INDEX].set_int(reg[0x80][0]);
-    //PC
-    values[PC_INDEX].set_int(reg[0x81][0]);
-
 	return 1;
 }
 
@@ -1585,6 +2764,9 @@ int idaapi write_register(thid_t tid, int reg_idx, const regval_t *value)
 {
     debug_printf("write_register\n");
 
+    if (profile_owns_target(NULL))
+        return 0;
+
     u32 reg[4] = {0};
 
     if (reg_idx < (GPR_COUNT - 2))
@@ -1654,6 +2836,9 @@ ssize_t idaapi read_memory(ea_t ea, void *buffer, size_t size)
 {
     debug_printf("read_memory\n");
 
+    if (profile_owns_target(NULL))
+        return -1;
+
     return gdb_read_mem(ea, (u8*)buffer, size);
 }
 
@@ -1663,6 +2848,9 @@ ssize_t idaapi write_memory(ea_t ea, const void *buffer, size_t size)
 {
     debug_printf("write_memory\n");
 
+    if (profile_owns_target(NULL))
+        return -1;
+
     return gdb_write_mem(ea, (u8*)buffer, size);
 }
 
@@ -1778,6 +2966,8 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
     int i;
     //std::vector<uint32>::iterator it;
     uint32 orig_inst = -1;
+    std::vector<gdb_mem_range_t> orig_reads;
+    std::vector<uint32> orig_insts(nadd, (uint32)-1);
     uint32 BPCount;
     int cnt = 0;
 
@@ -1785,6 +2975,9 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 
     //bp_list();
 
+    if (profile_owns_target(NULL))
+        return 0;
+
     for (i = 0; i < ndel; i++)
     {
         debug_printf("del_bpt: type: %d, ea: 0x%llX, code: %d\n", (uint32)bpts[nadd + i].type, (uint64)bpts[nadd + i].ea, (uint32)bpts[nadd + i].code);
@@ -1844,6 +3037,19 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
         }
     }
 
+    // original bytes of all new software breakpoints in one go
+    for (i = 0; i < nadd; i++)
+    {
+        if (bpts[i].code != BPT_OK || bpts[i].type != BPT_SOFT)
+            continue;
+
+        gdb_mem_range_t range = {(u32)bpts[i].ea, sizeof(uint32), (u8*)&orig_insts[i], 0};
+        orig_reads.push_back(range);
+    }
+
+    if (!orig_reads.empty())
+        gdb_read_mem_ranges(&orig_reads[0], (u32)orig_reads.size());
+
     for (i = 0; i < nadd; i++)
     {
         if (bpts[i].code != BPT_OK)
@@ -1866,7 +3072,7 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
                 main_bpts.insert(bpts[i].ea);
 
                 // NOTE: Software breakpoints require "original bytes" data
-                gdb_read_mem(bpts[i].ea, (u8*)&orig_inst, sizeof(orig_inst));
+                orig_inst = orig_insts[i];
 
                 bpts[i].orgbytes.qclear();
                 bpts[i].orgbytes.append(&orig_inst,  sizeof(orig_inst));
@@ -1981,8 +3187,37 @@ ea_t idaapi map_address(ea_t off, const regval_t *regs, int regnum)
 }
 
 //-------------------------------------------------------------------------
+// CHECKPOINT_IOCTL_SAVE/RESTORE: buf is the file name, the reply its
+// checkpoint_stats_t. 0 for anything else.
 int idaapi send_ioctl(int fn, const void *buf, size_t size, void **poutbuf, ssize_t *poutsize)
 {
+	checkpoint_stats_t stats;
+
+	switch (fn)
+	{
+	case CHECKPOINT_IOCTL_SAVE:
+	case CHECKPOINT_IOCTL_RESTORE:
+		{
+			if (buf == NULL || size == 0)
+				return -1;
+
+			std::string path((const char *)buf, strnlen((const char *)buf, size));
+			bool ok = checkpoint_run(fn, path.c_str(), &stats);
+
+			if (poutbuf != NULL && poutsize != NULL)
+			{
+				*poutbuf = qalloc(sizeof stats);
+				if (*poutbuf != NULL)
+				{
+					memcpy(*poutbuf, &stats, sizeof stats);
+					*poutsize = sizeof stats;
+				}
+			}
+
+			return ok ? 1 : -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -1997,10 +3232,10 @@ debugger_t debugger =
     DEBUGGER_NAME,				// Short debugger name
     DEBUGGER_ID_PLAYSTATION_3_SPU,	// Debugger API module id
     PROCESSOR_NAME,				// Required processor name
-    DBG_FLAG_REMOTE | DBG_FLAG_NOHOST | DBG_FLAG_NEEDPORT | DBG_FLAG_CAN_CONT_BPT | DBG_FLAG_NOSTARTDIR | DBG_FLAG_NOPARAMETERS | DBG_FLAG_NOPASSWORD | DBG_FLAG_DEBTHREAD,
+    DBG_FLAG_REMOTE | DBG_FLAG_NEEDPORT | DBG_FLAG_CAN_CONT_BPT | DBG_FLAG_NOSTARTDIR | DBG_FLAG_NOPARAMETERS | DBG_FLAG_NOPASSWORD | DBG_FLAG_DEBTHREAD,
 
     register_classes,			// Array of register class names
-    RC_GENERAL,					// Mask of default printed register classes
+    RC_PC | RC_SPECIAL,			// Mask of default printed register classes
     registers,					// Array of registers
     qnumber(registers),			// Number of registers
 
@@ -0,0 +1,232 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "delta.h"
+#include "mirror.h"
+
+#include <string.h>
+#include <chrono>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DELTA_SSE2
+#endif
+
+typedef std::chrono::high_resolution_clock delta_clock;
+
+// LS as of the previous stop
+static u8 snapshot[LS_SIZE];
+
+static bool tracking = false;
+static bool have_snapshot = false;
+
+static std::vector<delta_range_t> ranges;
+static delta_stats_t last_stats;
+
+// private helpers
+static bool test_page(const u32 *bits, u32 i)
+{
+    return (bits[i / 32] & (1u << (i % 32))) != 0;
+}
+
+// bit n set when quadword n of the 64 bytes differs
+static u32 delta_diff64(const u8 *a, const u8 *b)
+{
+#ifdef DELTA_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i d0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a +  0)), _mm_loadu_si128((const __m128i *)(b +  0)));
+    __m128i d1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16)));
+    __m128i d2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + 32)), _mm_loadu_si128((const __m128i *)(b + 32)));
+    __m128i d3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + 48)), _mm_loadu_si128((const __m128i *)(b + 48)));
+
+    // almost all of LS is unchanged: one test for the whole line first
+    __m128i any = _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xffff)
+        return 0;
+
+    u32 mask = 0;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d0, zero)) != 0xffff)
+        mask |= 1;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d1, zero)) != 0xffff)
+        mask |= 2;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d2, zero)) != 0xffff)
+        mask |= 4;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d3, zero)) != 0xffff)
+        mask |= 8;
+    return mask;
+#else
+    u64 x[8], y[8];
+    u32 mask = 0;
+
+    memcpy(x, a, sizeof x);
+    memcpy(y, b, sizeof y);
+
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (((x[i * 2] ^ y[i * 2]) | (x[i * 2 + 1] ^ y[i * 2 + 1])) != 0)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+static void delta_add(std::vector<delta_range_t> *out, u32 addr)
+{
+    if (!out->empty() && out->back().addr + out->back().size == addr)
+    {
+        out->back().size += 16;
+        return;
+    }
+
+    delta_range_t range = {addr, 16};
+    out->push_back(range);
+}
+
+static bool delta_take_snapshot(void)
+{
+    u32 discard[LS_PAGES / 32];
+
+    // start the stub's dirty bitmap afresh
+    gdb_dirty_pages(discard);
+
+    return gdb_read_mem(0, snapshot, LS_SIZE) == LS_SIZE;
+}
+
+// exported functions
+u32 delta_compare(const u8 *prev, const u8 *cur, u32 len, u32 base, std::vector<delta_range_t> *out)
+{
+    u32 changed = 0;
+
+    for (u32 i = 0; i < len; i += 64)
+    {
+        u32 mask = delta_diff64(prev + i, cur + i);
+
+        for (u32 j = 0; mask != 0; j++, mask >>= 1)
+        {
+            if (mask & 1)
+            {
+                delta_add(out, base + i + j * 16);
+                changed++;
+            }
+        }
+    }
+
+    return changed;
+}
+
+void delta_start(void)
+{
+    tracking = true;
+    have_snapshot = false;
+    ranges.clear();
+    memset(&last_stats, 0, sizeof last_stats);
+}
+
+void delta_stop(void)
+{
+    tracking = false;
+    have_snapshot = false;
+    ranges.clear();
+}
+
+bool delta_tracking(void)
+{
+    return tracking;
+}
+
+bool delta_update(void)
+{
+    static u8 current[LS_SIZE];
+    static gdb_mem_range_t reads[LS_PAGES];
+    u32 fetch[LS_PAGES / 32];
+    u32 count = 0;
+    delta_clock::time_point start = delta_clock::now();
+
+    ranges.clear();
+    memset(&last_stats, 0, sizeof last_stats);
+
+    if (!tracking)
+        return false;
+
+    if (!have_snapshot)
+    {
+        have_snapshot = delta_take_snapshot();
+        last_stats.source = DELTA_SOURCE_SNAPSHOT;
+        last_stats.pages = LS_PAGES;
+        last_stats.seconds = std::chrono::duration<double>(delta_clock::now() - start).count();
+        return have_snapshot;
+    }
+
+    memset(fetch, 0, sizeof fetch);
+
+    if (mirror_active())
+    {
+        memset(fetch, 0xff, sizeof fetch);
+        last_stats.source = DELTA_SOURCE_MIRROR;
+    }
+    else if (gdb_dirty_pages(fetch))
+        last_stats.source = DELTA_SOURCE_DIRTY;
+    else
+    {
+        memset(fetch, 0xff, sizeof fetch);
+        last_stats.source = DELTA_SOURCE_FULL;
+    }
+
+    // the changed pages come in one burst
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (!test_page(fetch, i))
+            continue;
+
+        gdb_mem_range_t *range = &reads[count++];
+        range->addr = i * LS_PAGE_SIZE;
+        range->size = LS_PAGE_SIZE;
+        range->buffer = current + i * LS_PAGE_SIZE;
+    }
+
+    if (gdb_read_mem_ranges(reads, count) != count)
+    {
+        have_snapshot = false;
+        ranges.clear();
+        return false;
+    }
+
+    for (u32 i = 0; i < count; i++)
+    {
+        u32 addr = reads[i].addr;
+        u8 *prev = snapshot + addr;
+
+        if (delta_compare(prev, current + addr, LS_PAGE_SIZE, addr, &ranges) != 0)
+            memcpy(prev, current + addr, LS_PAGE_SIZE);
+
+        last_stats.pages++;
+    }
+
+    for (size_t i = 0; i < ranges.size(); i++)
+        last_stats.bytes += ranges[i].size;
+
+    last_stats.seconds = std::chrono::duration<double>(delta_clock::now() - start).count();
+    return true;
+}
+
+const std::vector<delta_range_t> &delta_ranges(void)
+{
+    return ranges;
+}
+
+void delta_stats(delta_stats_t *stats)
+{
+    *stats = last_stats;
+}
+
+const char *delta_source_name(delta_source source)
+{
+    switch (source)
+    {
+    case DELTA_SOURCE_SNAPSHOT: return "snapshot";
+    case DELTA_SOURCE_MIRROR:   return "mirror";
+    case DELTA_SOURCE_DIRTY:    return "qSPUDirty";
+    case DELTA_SOURCE_FULL:     return "page cache";
+    }
+    return "?";
+}
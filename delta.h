@@ -0,0 +1,65 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef DELTA_H__
+#define DELTA_H__
+
+#include <vector>
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Local store changes between stops
+//
+//      While tracking, a copy of LS from the previous stop is kept. At each
+//      stop the pages that may have changed are fetched again and compared
+//      with it one quadword at a time; differing quadwords are merged into
+//      ranges. Which pages to fetch comes from, in order of preference:
+//
+//        mirror          all of them, they are a memcpy away
+//        qSPUDirty       the stub's bitmap of pages written since last asked
+//        nothing         all of them, through gdb.cpp's page cache. That
+//                        only fetches pages again whose qCRC changed.
+//
+//      The first stop after tracking starts only takes the copy.
+//
+
+typedef struct
+{
+    u32 addr;
+    u32 size;
+} delta_range_t;
+
+typedef enum
+{
+    DELTA_SOURCE_SNAPSHOT = 0,  // first stop, nothing to compare with
+    DELTA_SOURCE_MIRROR,
+    DELTA_SOURCE_DIRTY,
+    DELTA_SOURCE_FULL
+} delta_source;
+
+typedef struct
+{
+    delta_source source;
+    u32 pages;                  // pages read and compared
+    u32 bytes;                  // total size of the ranges
+    double seconds;
+} delta_stats_t;
+
+void delta_start(void);
+void delta_stop(void);
+bool delta_tracking(void);
+// call when the target stopped. false if LS could not be read; the next
+// stop takes a new copy then
+bool delta_update(void);
+
+const std::vector<delta_range_t> &delta_ranges(void);
+void delta_stats(delta_stats_t *stats);
+const char *delta_source_name(delta_source source);
+
+// appends the quadwords that differ between prev and cur, len bytes (a
+// multiple of 64) at LS address base, to out. Extends the last range if
+// they are adjacent. Returns the number of quadwords that differ.
+u32 delta_compare(const u8 *prev, const u8 *cur, u32 len, u32 base, std::vector<delta_range_t> *out);
+
+#endif
@@ -5,6 +5,9 @@
 
 #include "types.h"
 #include "gdb.h"
+#include "transport.h"
+#include "mirror.h"
+#include "core.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -22,6 +25,22 @@
 #include <netinet/in.h>
 #endif
 #include <stdarg.h>
+#include <chrono>
+
+// PCLMULQDQ (and SSSE3 byte shuffles) for qCRC, picked at run time
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#define GDB_CRC_CLMUL
+#define GDB_CLMUL_TARGET
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#define GDB_CRC_CLMUL
+#define GDB_CLMUL_TARGET __attribute__((target("ssse3,pclmul")))
+#endif
 
 #include <dbg.hpp>
 
@@ -34,22 +53,103 @@
 #endif
 
 #define		GDB_BFR_MAX	10000
+#define		GDB_READ_CHUNK	((GDB_BFR_MAX - 16) / 2)	// bytes per m packet
 #define		GDB_MAX_BP	10
 
 #define		GDB_STUB_START	'$'
 #define		GDB_STUB_END	'#'
 #define		GDB_STUB_ACK	'+'
 #define		GDB_STUB_NAK	'-'
-
-static int sock = -1;
-static struct sockaddr_in saddr_server, saddr_client;
-
+#define		GDB_STUB_BREAK	0x03
+#define		GDB_STUB_ESCAPE	'}'
+#define		GDB_STUB_RLE	'*'
+#define		GDB_STUB_RLE_BIAS	29
+#define		GDB_STUB_RLE_MAX	('~' - GDB_STUB_RLE_BIAS)
+
+// binary register block: 128 quadwords, SPU_ID and PC, all big endian
+// segments per scatter-gather send, and bytes per binary memory write.
+// Every escaped byte costs two segments, so escape-heavy writes get cut
+// short and gdb_write_mem sends another packet for the rest.
+#define		GDB_IOV_MAX	256
+#define		GDB_WRITE_MAX	0x10000
+
+#define		GDB_REGS_BINARY_SIZE	(128 * 16 + 4 + 4)
+
+// the last packet read, nul terminated
 static u8 cmd_bfr[GDB_BFR_MAX];
 static u32 cmd_len;
 
+// received but not yet consumed bytes
+static u8 rx_bfr[4096];
+static u32 rx_pos, rx_len;
+
+// outgoing packets are built in place: '$', then the payload with its
+// checksum summed as each byte is appended, then '#' and the checksum.
+// Nothing is cleared beforehand; len is all that is valid.
+typedef struct
+{
+    u8 data[GDB_BFR_MAX];
+    u32 len;
+    u8 chksum;
+    bool used;
+    bool overflow;
+} gdb_packet_t;
+
+#define		GDB_PACKET_POOL	4
+
+static gdb_packet_t packet_pool[GDB_PACKET_POOL];
+
+// cleared when the stub answers X with an empty reply; M is used then
+static bool mem_binary = true;
+
+// cleared when the stub answers qSPUDirty, qCRC, qSearch:memory or
+// qSPUICount with an empty reply
+static bool dirty_supported = true;
+static bool crc_supported = true;
+static bool search_supported = true;
+static bool icount_supported = true;
+
+#define		GDB_CRC_POLY	0x04c11db7
+
+static u32 crc_table[256];
+static bool crc_ready = false;
+
+#ifdef GDB_CRC_CLMUL
+static u32 crc_fold[2];
+static bool crc_clmul = false;
+#endif
+
 static u32 sig = 0;
 static u32 send_signal = 0;
 
+static gdb_stop_t last_stop;
+
+// registers known since the last stop; dropped whenever the target runs
+static u32 reg_cache[GDB_REG_COUNT][4];
+static u32 reg_cached[(GDB_REG_COUNT + 31) / 32];
+
+// cleared once the stub answers qSPURegs with an empty (unsupported) reply
+static bool regs_binary = true;
+
+// LS pages read since the target last ran are valid. Pages read before
+// that are stale: they are used again once qCRC (or qSPUDirty) showed
+// that they did not change, and fetched again otherwise.
+static u8 page_cache[LS_PAGES][LS_PAGE_SIZE];
+static u32 page_crc[LS_PAGES];
+static u32 page_valid[LS_PAGES / 32];
+static u32 page_stale[LS_PAGES / 32];
+
+// LS writes not sent yet: the bytes of wc_data whose bit is set in
+// wc_pending, all within [wc_low, wc_high). They go out, adjacent ones
+// merged, before anything the stub has to see them for.
+static u8 wc_data[LS_SIZE];
+static u32 wc_pending[LS_SIZE / 32];
+static u32 wc_low = LS_SIZE, wc_high = 0;
+
+// pages gdb_prefetch fetched that nothing has read yet
+static u32 page_prefetched[LS_PAGES / 32];
+static gdb_prefetch_stats_t prefetch;
+
 typedef struct
 {
 	u32 active;
@@ -150,30 +250,235 @@ static u32 re32hex(u8 *p)
     return res;
 }
 
-static u8 gdb_read_byte(void)
+// undoes the '}' escaping of binary replies in place, returns the new length
+static u32 gdb_unescape(u8 *p, u32 len)
 {
-	size_t res;
-	u8 c;
+	u32 out = 0;
+
+	for (u32 i = 0; i < len; i++)
+	{
+		if (p[i] == GDB_STUB_ESCAPE && i + 1 < len)
+			p[out++] = p[++i] ^ 0x20;
+		else
+			p[out++] = p[i];
+	}
 
-	res = recv(sock, (char*)&c, 1, MSG_WAITALL);
-	if (res != 1)
-		return fail("recv failed");
+	return out;
+}
 
-	return c;
+static u32 rbe32(const u8 *p)
+{
+	return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static bool is_hex(u8 c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool test_bit(const u32 *bits, u32 i)
+{
+	return (bits[i / 32] >> (i % 32)) & 1;
+}
+
+static void clear_bit(u32 *bits, u32 i)
+{
+	bits[i / 32] &= ~(1u << (i % 32));
+}
+
+static void set_bit(u32 *bits, u32 i)
+{
+	bits[i / 32] |= 1 << (i % 32);
+}
+
+static void gdb_iov_set(transport_iov_t *iov, const void *base, u32 len)
+{
+	iov->base = base;
+	iov->len = len;
 }
 
-static u8 gdb_calc_chksum(void)
+static u8 gdb_sum(const u8 *p, u32 len)
 {
-	u32 len = cmd_len;
-	u8 *ptr = cmd_bfr;
 	u8 c = 0;
 
-	while(len-- > 0)
-		c += *ptr++;
+	while (len-- > 0)
+		c += *p++;
 
 	return c;
 }
 
+static void gdb_cache_invalidate(void)
+{
+	memset(reg_cached, 0, sizeof reg_cached);
+}
+
+static void gdb_cache_store(u32 id, const u32 reg[4])
+{
+	memcpy(reg_cache[id], reg, sizeof reg_cache[id]);
+	set_bit(reg_cached, id);
+}
+
+static bool gdb_cache_load(u32 id, u32 reg[4])
+{
+	if (id >= GDB_REG_COUNT || !test_bit(reg_cached, id))
+		return false;
+
+	memcpy(reg, reg_cache[id], sizeof reg_cache[id]);
+	return true;
+}
+
+static u8 gdb_read_byte(void)
+{
+	int res;
+
+	if (rx_pos == rx_len)
+    {
+		res = transport_recv(rx_bfr, sizeof rx_bfr);
+		if (res <= 0)
+			return fail("recv failed");
+
+		rx_pos = 0;
+		rx_len = res;
+	}
+
+	return rx_bfr[rx_pos++];
+}
+
+// one writev/WSASend for all segments, resumed after partial sends
+static bool gdb_sendv(const transport_iov_t *iov, u32 count)
+{
+	if (!transport_sendv(iov, count))
+		return fail("gdb: send failed\n");
+
+	return true;
+}
+
+// '$', the payload segments, '#' and the checksum, without copying the
+// payload. chksum is the sum of all segments.
+static void gdb_send_frame(transport_iov_t *iov, u32 count, u8 chksum)
+{
+	static const u8 start = GDB_STUB_START;
+	u8 end[3] = {GDB_STUB_END, nibble2hex(chksum >> 4), nibble2hex(chksum)};
+
+	if (!transport_is_open())
+		return;
+
+	gdb_iov_set(&iov[0], &start, 1);
+	gdb_iov_set(&iov[count + 1], end, 3);
+
+	gdb_sendv(iov, count + 2);
+}
+
+static gdb_packet_t *gdb_packet_begin(void)
+{
+	for (u32 i = 0; i < GDB_PACKET_POOL; i++)
+    {
+		gdb_packet_t *p = &packet_pool[i];
+		if (!p->used)
+        {
+			p->used = true;
+			p->overflow = false;
+			p->data[0] = GDB_STUB_START;
+			p->len = 1;
+			p->chksum = 0;
+			return p;
+		}
+	}
+
+	fail("gdb: packet pool exhausted\n");
+	return NULL;
+}
+
+// room for n more payload bytes plus '#' and the checksum
+static bool gdb_packet_room(gdb_packet_t *p, u32 n)
+{
+	if (p->len + n + 3 > sizeof p->data)
+		p->overflow = true;
+
+	return !p->overflow;
+}
+
+static void gdb_packet_put(gdb_packet_t *p, u8 c)
+{
+	if (!gdb_packet_room(p, 1))
+		return;
+
+	p->data[p->len++] = c;
+	p->chksum += c;
+}
+
+static void gdb_packet_str(gdb_packet_t *p, const char *str)
+{
+	while (*str)
+		gdb_packet_put(p, *str++);
+}
+
+static void gdb_packet_hex8(gdb_packet_t *p, u8 v)
+{
+	gdb_packet_put(p, nibble2hex(v >> 4));
+	gdb_packet_put(p, nibble2hex(v));
+}
+
+static void gdb_packet_hex32(gdb_packet_t *p, u32 v)
+{
+	if (!gdb_packet_room(p, 8))
+		return;
+
+	for (int i = 28; i >= 0; i -= 4)
+    {
+		u8 c = nibble2hex(v >> i);
+		p->data[p->len++] = c;
+		p->chksum += c;
+	}
+}
+
+static void gdb_packet_mem2hex(gdb_packet_t *p, const u8 *src, u32 len)
+{
+	if (!gdb_packet_room(p, len * 2))
+		return;
+
+	u8 *dst = p->data + p->len;
+	u8 chksum = p->chksum;
+
+	for (u32 i = 0; i < len; i++)
+    {
+		u8 hi = nibble2hex(src[i] >> 4);
+		u8 lo = nibble2hex(src[i]);
+		dst[i * 2] = hi;
+		dst[i * 2 + 1] = lo;
+		chksum += hi + lo;
+	}
+
+	p->len += len * 2;
+	p->chksum = chksum;
+}
+
+// frames, sends and returns the packet to the pool
+static void gdb_packet_send(gdb_packet_t *p)
+{
+	transport_iov_t iov;
+
+	p->used = false;
+
+	if (!transport_is_open())
+		return;
+
+	if (p->overflow)
+    {
+		fail("gdb: packet overflow\n");
+		return;
+	}
+
+	p->data[p->len++] = GDB_STUB_END;
+	p->data[p->len++] = nibble2hex(p->chksum >> 4);
+	p->data[p->len++] = nibble2hex(p->chksum);
+
+	dbgprintf("gdb: reply (len: %d): %.*s\n", p->len, p->len, p->data);
+
+	gdb_iov_set(&iov, p->data, p->len);
+	gdb_sendv(&iov, 1);
+}
+
 static gdb_bp_t *gdb_bp_ptr(u32 type)
 {
 	switch (type)
@@ -267,30 +572,31 @@ static int gdb_bp_check(u32 addr, u32 type)
 static void gdb_nak(void)
 {
 	const char nak = GDB_STUB_NAK;
-	size_t res;
 
-	res = send(sock, &nak, 1, 0);
-	if (res != 1)
+	if (!transport_send(&nak, 1))
 		fail("send failed");
 }
 
 static void gdb_ack(void)
 {
 	const char ack = GDB_STUB_ACK;
-	size_t res;
 
-	res = send(sock, &ack, 1, 0);
-	if (res != 1)
+	if (!transport_send(&ack, 1))
 		fail("send failed");
 }
 
 static bool gdb_read_command(void)
 {
 	u8 c;
-	u8 chk_read, chk_calc;
+	u8 chk_read, chk_calc = 0;
+	bool escaped = false;
 
 	cmd_len = 0;
-	memset(cmd_bfr, 0, sizeof cmd_bfr);
+	cmd_bfr[0] = 0;
+
+	// nothing comes from a core file, or after the connection went away
+	if (!transport_is_open())
+		return false;
 
 	c = gdb_read_byte();
 
@@ -298,6 +604,7 @@ static bool gdb_read_command(void)
         c == GDB_STUB_NAK)
     {
         cmd_bfr[cmd_len++] = c;
+        cmd_bfr[cmd_len] = 0;
         dbgprintf("gdb: read command %c with a length of %d: %s\n", cmd_bfr[0], cmd_len, cmd_bfr);
         return true;
     }
@@ -308,18 +615,40 @@ static bool gdb_read_command(void)
 		return false;
 	}
 
+	// the checksum covers the bytes on the wire, so it is summed here while
+	// run-length encoded replies are expanded
 	while ((c = gdb_read_byte()) != GDB_STUB_END)
     {
+		chk_calc += c;
+
+		// "X*n" is X followed by n - 29 more copies of it. The byte after an
+		// escape is data, even if it happens to be '*'.
+		if (c == GDB_STUB_RLE && !escaped && cmd_len > 0)
+        {
+			c = gdb_read_byte();
+			chk_calc += c;
+
+			u32 run = (u32)c - GDB_STUB_RLE_BIAS;
+			if (c < GDB_STUB_RLE_BIAS || cmd_len + run >= sizeof cmd_bfr)
+				return fail("gdb: invalid run length %02x\n", c);
+
+			memset(cmd_bfr + cmd_len, cmd_bfr[cmd_len - 1], run);
+			cmd_len += run;
+			continue;
+		}
+
+		escaped = !escaped && c == GDB_STUB_ESCAPE;
+
 		cmd_bfr[cmd_len++] = c;
-		if (cmd_len == sizeof cmd_bfr)
+		if (cmd_len == sizeof cmd_bfr - 1)
 			return fail("gdb: cmd_bfr overflow\n");
 	}
 
+	cmd_bfr[cmd_len] = 0;
+
 	chk_read = hex2char(gdb_read_byte()) << 4;
 	chk_read |= hex2char(gdb_read_byte());
 
-	chk_calc = gdb_calc_chksum();
-
 	if (chk_calc != chk_read)
     {
 		dbgprintf("gdb: invalid checksum: calculated %02x and read %02x for $%s# (length: %d)\n", chk_calc, chk_read, cmd_bfr, cmd_len);
@@ -335,70 +664,80 @@ static bool gdb_read_command(void)
     return true;
 }
 
-static int gdb_data_available(void)
+static int gdb_data_wait(u32 usec)
 {
-	struct timeval t;
-	fd_set _fds, *fds = &_fds;
-	
-	FD_ZERO(fds);
-	FD_SET(sock, fds);
-
-	t.tv_sec = 0;
-	t.tv_usec = 2000;
+	if (rx_pos < rx_len)
+		return 1;
 
-	if (select(sock + 1, fds, NULL, NULL, &t) < 0)
+	int res = transport_wait(usec);
+	if (res < 0)
 		return fail("select failed");
 
-	if (FD_ISSET(sock, fds))
-		return 1;
-	return 0;
+	return res;
 }
 
-static void gdb_reply(const char *reply)
+static int gdb_data_available(void)
 {
-    if (sock == -1)
-        return;
-
-	u8 chk;
-	u32 left;
-	u8 *ptr;
-	int n;
-
-	memset(cmd_bfr, 0, sizeof cmd_bfr);
+	return gdb_data_wait(2000);
+}
 
-	cmd_len = strlen(reply);
-	if (cmd_len + 4 > sizeof cmd_bfr)
-    {
-        fail("cmd_bfr overflow in gdb_reply\n");
+static void gdb_reply(const char *reply)
+{
+    if (!transport_is_open())
         return;
-    }
 
-	memcpy(cmd_bfr + 1, reply, cmd_len);
+	transport_iov_t iov[3];
+	u32 len = strlen(reply);
 
-	cmd_len++;
-	chk = gdb_calc_chksum();
-	cmd_len--;
-	cmd_bfr[0] = GDB_STUB_START;
-	cmd_bfr[cmd_len + 1] = GDB_STUB_END;
-	cmd_bfr[cmd_len + 2] = nibble2hex(chk >> 4);
-	cmd_bfr[cmd_len + 3] = nibble2hex(chk);
+	dbgprintf("gdb: reply (len: %d): %s\n", len, reply);
 
-	dbgprintf("gdb: reply (len: %d): %s\n", cmd_len, cmd_bfr);
+	gdb_iov_set(&iov[1], reply, len);
+	gdb_send_frame(iov, 1, gdb_sum((const u8 *)reply, len));
 
-	ptr = cmd_bfr;
-	left = cmd_len + 4;
-	while ((int)left > 0)
-    {
-		n = send(sock, (char*)ptr, left, 0);
-        dbgprintf("gdb: reply (sent: %d of %d)\n", n, cmd_len);
-		if (n < 0)
+/*
+	// gdb_reply, run-length encoding the payload before the checksum is
+	// taken. Runs are a byte, '*' and the number of extra copies + 29, so
+	// 3 to 97 copies fit in one printable character; 6 and 7 would give
+	// '#' and '$' and are shortened to 5. Escaped pairs in binary payloads
+	// are copied as they are and never start a run.
+	static u32 gdb_rle_encode(u8 *dst, const u8 *src, u32 len)
+	{
+		u32 i = 0, out = 0;
+		u32 run;
+		u8 c;
+
+		while (i < len)
         {
-            fail("gdb: send failed\n");
-            return;
-        }
-		left -= n;
-		ptr += n;
+			c = src[i++];
+			dst[out++] = c;
+
+			if (c == GDB_STUB_ESCAPE && i < len)
+            {
+				dst[out++] = src[i++];
+				continue;
+			}
+
+			run = 0;
+			while (i + run < len && src[i + run] == c && run < GDB_STUB_RLE_MAX)
+				run++;
+
+			if (run == 6 || run == 7)
+				run = 5;
+
+			if (run >= 3)
+            {
+				dst[out++] = GDB_STUB_RLE;
+				dst[out++] = (u8)(run + GDB_STUB_RLE_BIAS);
+				i += run;
+			}
+		}
+
+		return out;
 	}
+
+	// in the stub's gdb_reply, replacing the memcpy into cmd_bfr + 1
+	cmd_len = gdb_rle_encode(cmd_bfr + 1, (const u8 *)reply, cmd_len);
+*/
 }
 
 static void gdb_handle_query(void)
@@ -417,61 +756,327 @@ static void gdb_handle_set_thread(void)
 	gdb_reply("E01");
 }
 
-static void gdb_handle_signal(event_callback* callback)
+// parses the T/S reply in cmd_bfr into last_stop and seeds the register
+// cache with the expedited registers
+static bool gdb_parse_stop(void)
 {
-    dbgprintf("gdb_handle_signal\n");
+	gdb_stop_t *stop = &last_stop;
+
+	if (cmd_len < 3 || (cmd_bfr[0] != 'T' && cmd_bfr[0] != 'S'))
+		return false;
+
+	memset(stop, 0, sizeof *stop);
+	stop->signal = (hex2char(cmd_bfr[1]) << 4) | hex2char(cmd_bfr[2]);
+	stop->thread = ~0u;
+	stop->watch = GDB_BP_TYPE_NONE;
 
-    u32 sig = 0;
+	gdb_cache_invalidate();
+
+	// n:r; pairs
+	u32 i = 3;
+	while (i < cmd_len)
+	{
+		u32 name = i;
+		while (i < cmd_len && cmd_bfr[i] != ':' && cmd_bfr[i] != ';')
+			i++;
+		u32 name_len = i - name;
+
+		u32 value = (i < cmd_len && cmd_bfr[i] == ':') ? i + 1 : i;
+		i = value;
+		while (i < cmd_len && cmd_bfr[i] != ';')
+			i++;
+		u32 value_len = i - value;
+		i++;
+
+		const char *n = (const char *)cmd_bfr + name;
+		u8 *v = cmd_bfr + value;
+
+		bool numeric = (name_len > 0);
+		for (u32 j = 0; j < name_len; j++)
+			numeric = numeric && is_hex(n[j]);
+
+		if (numeric)
+		{
+			u32 id = 0;
+			for (u32 j = 0; j < name_len; j++)
+				id = (id << 4) | hex2char(n[j]);
+
+			if (id >= GDB_REG_COUNT)
+				continue;
+
+			// quadwords are 32 digits, SPU_ID and PC 8
+			u32 words = (id < 128) ? 4 : 1;
+			if (value_len < words * 8)
+				continue;
+
+			for (u32 w = 0; w < words; w++)
+				stop->reg[id][w] = re32hex(v + w * 8);
+
+			set_bit(stop->valid, id);
+			gdb_cache_store(id, stop->reg[id]);
+		}
+		else if (name_len == 6 && memcmp(n, "thread", 6) == 0)
+		{
+			// "p<pid>.<tid>" in multiprocess form; keep the thread part
+			u32 t = 0;
+			for (u32 j = 0; j < value_len; j++)
+			{
+				if (v[j] == '.')
+					t = 0;
+				else if (is_hex(v[j]))
+					t = (t << 4) | hex2char(v[j]);
+			}
+			stop->thread = t;
+		}
+		else if ((name_len == 5 && memcmp(n, "watch", 5) == 0) ||
+		         (name_len == 6 && memcmp(n, "rwatch", 6) == 0) ||
+		         (name_len == 6 && memcmp(n, "awatch", 6) == 0))
+		{
+			stop->watch = (n[0] == 'w') ? GDB_BP_TYPE_W : (n[0] == 'r') ? GDB_BP_TYPE_R : GDB_BP_TYPE_A;
+			stop->watch_addr = 0;
+			for (u32 j = 0; j < value_len && is_hex(v[j]); j++)
+				stop->watch_addr = (stop->watch_addr << 4) | hex2char(v[j]);
+		}
+		else if (name_len == 7 && memcmp(n, "swbreak", 7) == 0)
+		{
+			stop->swbreak = true;
+		}
+		else if (name_len == 7 && memcmp(n, "hwbreak", 7) == 0)
+		{
+			stop->hwbreak = true;
+		}
+		// anything else (core, library, ...) is ignored
+	}
 
-    sig = hex2char(cmd_bfr[1]) << 4;
-    sig |= hex2char(cmd_bfr[2]);
+	return true;
+}
 
-    u32 reg = 0;
+static u32 gdb_stop_pc(void)
+{
+	return gdb_stop_has_reg(&last_stop, GDB_REG_PC) ? last_stop.reg[GDB_REG_PC][0] : ~0u;
+}
 
-    reg = hex2char(cmd_bfr[3]) << 4;
-    reg |= hex2char(cmd_bfr[4]);
+static void gdb_handle_signal(event_callback* callback)
+{
+    dbgprintf("gdb_handle_signal\n");
 
-    u32 val = re32hex(cmd_bfr + 6);
+    if (!gdb_parse_stop())
+        return;
 
     if (0 != callback)
     {
-        callback(sig, val);
+        u32 pc = gdb_stop_pc();
+
+        // a plain S reply, or a T reply without the PC: ask for it
+        if (!gdb_stop_has_reg(&last_stop, GDB_REG_PC))
+        {
+            u32 reg[4] = {~0u};
+            gdb_read_register(GDB_REG_PC, reg);
+            pc = reg[0];
+        }
+
+        callback(last_stop.signal, pc);
     }
 /*
-    char bfr[128];
+    char bfr[256];
+    char *p = bfr;
 
 	gdb_ack();
 	memset(bfr, 0, sizeof bfr);
-	sprintf(bfr, "T%02x81:%08x;", sig, ctx->pc);
+
+	// PC and the link and stack registers, so that the debugger can show
+	// where it stopped without another round trip
+	p += sprintf(p, "T%02x81:%08x;", sig, ctx->pc);
+	for (i = 0; i < 2; i++)
+		p += sprintf(p, "%02x:%08x%08x%08x%08x;", i, ctx->reg[i][0], ctx->reg[i][1], ctx->reg[i][2], ctx->reg[i][3]);
+	p += sprintf(p, "thread:1;");
+
+	if (watch_type != GDB_BP_TYPE_NONE)
+		p += sprintf(p, "%s:%08x;", watch_type == GDB_BP_TYPE_W ? "watch" : watch_type == GDB_BP_TYPE_R ? "rwatch" : "awatch", watch_addr);
+	else if (sig == SIGTRAP && gdb_bp_x(ctx->pc))
+		p += sprintf(p, "swbreak:;");
+
 	gdb_reply(bfr);
 */
 }
 
-void gdb_read_registers(u32 reg[130][4])
+static u32 gdb_block_offset(u32 id)
 {
-    u8 reply[4] = {0};
+    return (id < 128) ? id * 16 : 128 * 16 + (id - 128) * 4;
+}
 
-    //memset(reply, 0, sizeof reply);
+// registers first..first+count-1 in one binary reply
+static bool gdb_read_block(u32 first, u32 count, u32 reg[130][4])
+{
+    char query[32];
 
-    reply[0] = 'g';
+    if (first == 0 && count == GDB_REG_COUNT)
+        strcpy(query, "qSPURegs");
+    else
+        sprintf(query, "qSPURegs:%x,%x", first, count);
 
-    gdb_reply((char *)reply);
+    gdb_reply(query);
 
     // read ack/nak
     gdb_read_command();
-    // read register values
+    // read the register block, "" or E##
     gdb_read_command();
 
+    if (cmd_len == 0)
+    {
+        regs_binary = false;
+        return false;
+    }
+
+    u32 len = gdb_unescape(cmd_bfr, cmd_len);
+    if (len != gdb_block_offset(first + count) - gdb_block_offset(first))
+        return false;
+
+    for (u32 i = first; i < first + count; i++)
+    {
+        u8 *p = cmd_bfr + gdb_block_offset(i) - gdb_block_offset(first);
+
+        reg[i][0] = rbe32(p);
+        if (i < 128)
+        {
+            reg[i][1] = rbe32(p + 4);
+            reg[i][2] = rbe32(p + 8);
+            reg[i][3] = rbe32(p + 12);
+        }
+        gdb_cache_store(i, reg[i]);
+    }
+
+    return true;
+
+/*
+	// gdb_handle_query, for "qSPURegs" (all registers) or
+	// "qSPURegs:first,count". Binary payloads escape '#', '$', '}' and '*'
+	// as '}' followed by the byte xor 0x20, and need a gdb_reply variant
+	// that takes a length instead of using strlen.
+	static u8 raw[128 * 16 + 8];
+	static u8 bfr[sizeof raw * 2];
+	u32 first = 0, count = 130;
+	u32 i, j, len;
+
+	if (cmd_bfr[8] == ':')
+    {
+		i = 9;
+		first = 0;
+		while (cmd_bfr[i] != ',')
+			first = (first << 4) | hex2char(cmd_bfr[i++]);
+		i++;
+		count = 0;
+		while (i < cmd_len)
+			count = (count << 4) | hex2char(cmd_bfr[i++]);
+	}
+
+	gdb_ack();
+	if (first >= 130 || count > 130 - first)
+		return gdb_reply("E01");
+
+	len = 0;
+	for (i = first; i < first + count; i++)
+    {
+		if (i < 128)
+        {
+			for (j = 0; j < 4; j++, len += 4)
+				wbe32(raw + len, ctx->reg[i][j]);
+		}
+		else
+        {
+			wbe32(raw + len, (i == 128) ? SPU_ID : ctx->pc);
+			len += 4;
+		}
+	}
+
+	j = 0;
+	for (i = 0; i < len; i++)
+    {
+		if (raw[i] == '#' || raw[i] == '$' || raw[i] == '}' || raw[i] == '*')
+        {
+			bfr[j++] = '}';
+			bfr[j++] = raw[i] ^ 0x20;
+		}
+		else
+			bfr[j++] = raw[i];
+	}
+
+	gdb_reply_binary(bfr, j);
+*/
+}
+
+// true if a p/g reply holds count registers from first on, not E##
+static bool gdb_register_reply(u32 first, u32 count)
+{
+    u32 length = 0;
+
+    for (u32 i = first; i < first + count; i++)
+        length += (i < 128) ? 32 : 8;
+
+    return cmd_len >= length && cmd_bfr[0] != 'E';
+}
+
+// one p per register, all sent before the first reply is read
+static bool gdb_read_pipelined(u32 first, u32 count, u32 reg[130][4])
+{
+    bool ok = true;
+
+    for (u32 i = first; i < first + count; i++)
+    {
+        u8 request[4] = {'p', nibble2hex(i >> 4), nibble2hex(i), 0};
+        gdb_reply((char *)request);
+    }
+
+    for (u32 i = first; i < first + count; i++)
+    {
+        // read ack/nak; nothing follows a nak
+        if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+        {
+            ok = false;
+            continue;
+        }
+        // read register value or E##, the rest are still read
+        if (!gdb_read_command() || !gdb_register_reply(i, 1))
+        {
+            ok = false;
+            continue;
+        }
+
+        reg[i][0] = re32hex(cmd_bfr + 0);
+        if (i < 128)
+        {
+            reg[i][1] = re32hex(cmd_bfr +  8);
+            reg[i][2] = re32hex(cmd_bfr + 16);
+            reg[i][3] = re32hex(cmd_bfr + 24);
+        }
+        gdb_cache_store(i, reg[i]);
+    }
+
+    return ok;
+}
+
+static bool gdb_read_all(u32 reg[130][4])
+{
+    gdb_reply("g");
+
+    // read ack/nak; nothing follows a nak
+    if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+        return false;
+    // read register values or E##
+    if (!gdb_read_command() || !gdb_register_reply(0, 128))
+        return false;
+
     for (u32 i = 0; i < 128; i++)
     {
         reg[i][0] = re32hex(cmd_bfr + i * 32 + 0);
         reg[i][1] = re32hex(cmd_bfr + i * 32 + 8);
         reg[i][2] = re32hex(cmd_bfr + i * 32 + 16);
         reg[i][3] = re32hex(cmd_bfr + i * 32 + 24);
+        gdb_cache_store(i, reg[i]);
     }
 
-    gdb_read_register(0x80, reg[0x80]);
-    gdb_read_register(0x81, reg[0x81]);
+    return gdb_read_register(GDB_REG_SPU_ID, reg[GDB_REG_SPU_ID]) &&
+           gdb_read_register(GDB_REG_PC, reg[GDB_REG_PC]);
 
 /*
 	static u8 bfr[GDB_BFR_MAX - 4];
@@ -492,28 +1097,88 @@ void gdb_read_registers(u32 reg[130][4])
 */
 }
 
-void gdb_write_registers(u32 reg[130][4])
+bool gdb_read_register_range(u32 first, u32 count, u32 reg[130][4])
 {
-    u8 reply[GDB_BFR_MAX - 4];
+    u32 end = min(first + count, (u32)GDB_REG_COUNT);
+    u32 i = first;
+    bool ok = true;
 
-    memset(reply, 0, sizeof reply);
+    if (core_active())
+    {
+        for (; i < end; i++)
+            core_read_register(i, reg[i]);
+        return true;
+    }
+
+    while (i < end)
+    {
+        // skip what the cache already has, fetch the next uncached run
+        if (gdb_cache_load(i, reg[i]))
+        {
+            i++;
+            continue;
+        }
+
+        u32 run = i;
+        while (run < end && !test_bit(reg_cached, run))
+            run++;
+
+        if (!regs_binary || !gdb_read_block(i, run - i, reg))
+        {
+            // beyond a few dozen p packets a full g is cheaper
+            if (run - i > 32)
+                ok = gdb_read_all(reg) && ok;
+            else
+                ok = gdb_read_pipelined(i, run - i, reg) && ok;
+        }
+
+        i = run;
+    }
+
+    return ok;
+}
+
+bool gdb_read_registers(u32 reg[130][4])
+{
+    return gdb_read_register_range(0, GDB_REG_COUNT, reg);
+}
+
+// reads the ack and the OK/E## reply to a G or P
+static bool gdb_read_ok(void)
+{
+    // read ack/nak; nothing follows a nak
+    if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+        return false;
+    // read OK/E##
+    if (!gdb_read_command())
+        return false;
+
+    return cmd_len == 2 && cmd_bfr[0] == 'O' && cmd_bfr[1] == 'K';
+}
+
+bool gdb_write_registers(u32 reg[130][4])
+{
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return false;
 
-    reply[0] = 'G';
+    gdb_packet_put(p, 'G');
 
     for (u32 i = 0; i < 128; i++)
     {
-        wbe32hex(reply + 1 + i*32 + 0, reg[i][0]);
-        wbe32hex(reply + 1 + i*32 + 8, reg[i][1]);
-        wbe32hex(reply + 1 + i*32 + 16, reg[i][2]);
-        wbe32hex(reply + 1 + i*32 + 24, reg[i][3]);
+        gdb_packet_hex32(p, reg[i][0]);
+        gdb_packet_hex32(p, reg[i][1]);
+        gdb_packet_hex32(p, reg[i][2]);
+        gdb_packet_hex32(p, reg[i][3]);
     }
 
-    gdb_reply((char *)reply);
+    gdb_packet_send(p);
 
-    // read ack/nak
-    gdb_read_command();
-    // read OK/E##
-    gdb_read_command();
+    bool ok = gdb_read_ok();
+
+    gdb_cache_invalidate();
+
+    return ok;
 
 /*
 	gdb_ack();
@@ -532,263 +1197,1298 @@ void gdb_write_registers(u32 reg[130][4])
 */
 }
 
-void gdb_read_register(u32 id, u32 reg[4])
+bool gdb_read_register(u32 id, u32 reg[4])
+{
+    if (core_read_register(id, reg) || gdb_cache_load(id, reg))
+        return true;
+
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return false;
+
+    gdb_packet_put(p, 'p');
+    gdb_packet_hex8(p, id);
+    gdb_packet_send(p);
+
+    // read ack/nak; nothing follows a nak
+    if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+        return false;
+    // read register value or E##
+    if (!gdb_read_command() || !gdb_register_reply(id, 1))
+        return false;
+
+    reg[0] = re32hex(cmd_bfr +  0);
+    if (id < 128)
+    {
+        reg[1] = re32hex(cmd_bfr +  8);
+        reg[2] = re32hex(cmd_bfr + 16);
+        reg[3] = re32hex(cmd_bfr + 24);
+    }
+
+    if (id < GDB_REG_COUNT)
+        gdb_cache_store(id, reg);
+
+    return true;
+
+/*
+    static u8 reply[32];
+    u32 id;
+
+    memset(reply, 0, sizeof reply);
+
+	id = hex2char(cmd_bfr[1]) << 4;
+	id |= hex2char(cmd_bfr[2]);
+
+	gdb_ack();
+	switch (id)
+    {
+		case 0 ... 127:
+			wbe32hex(reply +  0, ctx->reg[id][0]);
+			wbe32hex(reply +  8, ctx->reg[id][1]);
+			wbe32hex(reply + 16, ctx->reg[id][2]);
+			wbe32hex(reply + 24, ctx->reg[id][3]);
+			break;
+		case 128:
+			// SPU ID
+			wbe32hex(reply, SPU_ID);
+			break;
+		case 129:
+			// PC
+			wbe32hex(reply, ctx->pc);
+			break;
+		default:
+			wbe32hex(reply, 0);
+	}
+	gdb_reply((char *)reply);
+*/
+}
+
+bool gdb_write_register(u32 id, u32 reg[4])
+{
+    if (id > 127 && id != 129)
+        return false;
+
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return false;
+
+    gdb_packet_put(p, 'P');
+    gdb_packet_hex8(p, id);
+    gdb_packet_put(p, '=');
+    gdb_packet_hex32(p, reg[0]);
+    if (id < 128)
+    {
+        gdb_packet_hex32(p, reg[1]);
+        gdb_packet_hex32(p, reg[2]);
+        gdb_packet_hex32(p, reg[3]);
+    }
+
+    gdb_packet_send(p);
+
+    bool ok = gdb_read_ok();
+
+    // re-read rather than trust what was written, the stub may adjust it
+    gdb_cache_invalidate();
+
+    return ok;
+
+/*
+	u32 id;
+	u32 i;
+
+	gdb_ack();
+
+	id = hex2char(cmd_bfr[1]) << 4;
+	id |= hex2char(cmd_bfr[2]);
+
+	if (id == 129)
+    {
+		ctx->pc = 0;
+		i = 4;
+		while (i < cmd_len)
+			ctx->pc = (ctx->pc << 4) | hex2char(cmd_bfr[i++]);
+		ctx->pc -= 4;
+		gdb_reply("OK");
+		return;
+	}
+
+	if (id > 127)
+		return gdb_reply("E01");
+
+	// XXX: wrong?
+	ctx->reg[id][0] = re32hex(cmd_bfr + 4 +  0);
+	ctx->reg[id][1] = re32hex(cmd_bfr + 4 +  8);
+	ctx->reg[id][2] = re32hex(cmd_bfr + 4 + 16);
+	ctx->reg[id][3] = re32hex(cmd_bfr + 4 + 24);
+	gdb_reply("OK");
+*/
+}
+
+static bool gdb_crc_query(const u32 *pages, u32 count, u32 *crc)
+{
+    bool ok = true;
+
+    if (!crc_supported)
+        return false;
+
+    for (u32 i = 0; i < count; i++)
+    {
+        gdb_packet_t *p = gdb_packet_begin();
+        if (p == NULL)
+            return false;
+
+        gdb_packet_str(p, "qCRC:");
+        gdb_packet_hex32(p, pages[i] * LS_PAGE_SIZE);
+        gdb_packet_put(p, ',');
+        gdb_packet_hex32(p, LS_PAGE_SIZE);
+        gdb_packet_send(p);
+    }
+
+    for (u32 i = 0; i < count; i++)
+    {
+        // read ack/nak
+        gdb_read_command();
+        // read C########, "" or E##
+        gdb_read_command();
+
+        if (cmd_len == 0)
+            crc_supported = false;
+
+        if (cmd_len != 9 || cmd_bfr[0] != 'C')
+        {
+            ok = false;
+            continue;
+        }
+
+        crc[i] = re32hex(cmd_bfr + 1);
+    }
+
+    return ok && crc_supported;
+
+/*
+	// gdb_handle_query
+	if (memcmp(cmd_bfr, "qCRC:", 5) == 0)
+    {
+		i = 5;
+		addr = 0;
+		while (cmd_bfr[i] != ',')
+			addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+		i++;
+		len = 0;
+		while (i < cmd_len)
+			len = (len << 4) | hex2char(cmd_bfr[i++]);
+
+		gdb_ack();
+		if (addr >= LS_SIZE || len > LS_SIZE - addr)
+			return gdb_reply("E01");
+
+		reply[0] = 'C';
+		wbe32hex(reply + 1, gdb_crc32(0xffffffff, ctx->ls + addr, len));
+		reply[9] = 0;
+		return gdb_reply((char *)reply);
+	}
+*/
+}
+
+static void gdb_page_cache_flush(void)
+{
+    memset(page_valid, 0, sizeof page_valid);
+    memset(page_stale, 0, sizeof page_stale);
+    memset(page_prefetched, 0, sizeof page_prefetched);
+}
+
+// the target is about to run
+static void gdb_page_cache_resume(void)
+{
+    // prefetched pages nobody read are not worth a qCRC next time
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (test_bit(page_prefetched, i))
+        {
+            clear_bit(page_valid, i);
+            prefetch.wasted++;
+        }
+    }
+    memset(page_prefetched, 0, sizeof page_prefetched);
+
+    for (u32 i = 0; i < LS_PAGES / 32; i++)
+    {
+        page_stale[i] = crc_supported ? page_stale[i] | page_valid[i] : 0;
+        page_valid[i] = 0;
+    }
+}
+
+static void gdb_page_cache_drop(u32 addr, u32 size)
+{
+    if (size == 0 || addr >= LS_SIZE)
+        return;
+
+    u32 last = (min(addr + size, (u32)LS_SIZE) - 1) / LS_PAGE_SIZE;
+    for (u32 i = addr / LS_PAGE_SIZE; i <= last; i++)
+    {
+        clear_bit(page_valid, i);
+        clear_bit(page_stale, i);
+        clear_bit(page_prefetched, i);
+    }
+}
+
+// pages the stub reports written are dropped, stale ones it does not are
+// valid again
+static void gdb_page_cache_clean(const u32 dirty[LS_PAGES / 32])
+{
+    for (u32 i = 0; i < LS_PAGES / 32; i++)
+    {
+        page_valid[i] = (page_valid[i] | page_stale[i]) & ~dirty[i];
+        page_stale[i] = 0;
+    }
+}
+
+// one pipelined qCRC round for every stale page
+static void gdb_page_cache_validate(void)
+{
+    u32 pages[LS_PAGES];
+    u32 crc[LS_PAGES];
+    u32 count = 0;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (test_bit(page_stale, i))
+            pages[count++] = i;
+    }
+    memset(page_stale, 0, sizeof page_stale);
+
+    if (count == 0 || !gdb_crc_query(pages, count, crc))
+        return;
+
+    for (u32 i = 0; i < count; i++)
+    {
+        if (crc[i] == page_crc[pages[i]])
+            set_bit(page_valid, pages[i]);
+    }
+}
+
+// fetches the pages with pipelined "m" packets. false if one could not be
+// read
+static bool gdb_page_cache_fill(const u32 *pages, u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        gdb_packet_t *p = gdb_packet_begin();
+        if (p == NULL)
+            return false;
+
+        gdb_packet_put(p, 'm');
+        gdb_packet_hex32(p, pages[i] * LS_PAGE_SIZE);
+        gdb_packet_put(p, ',');
+        gdb_packet_hex32(p, LS_PAGE_SIZE);
+        gdb_packet_send(p);
+    }
+
+    bool ok = true;
+    for (u32 i = 0; i < count; i++)
+    {
+        // read ack/nak
+        gdb_read_command();
+        // read the page or E##
+        gdb_read_command();
+
+        if (cmd_len != LS_PAGE_SIZE * 2)
+        {
+            ok = false;
+            continue;
+        }
+
+        u8 *page = page_cache[pages[i]];
+        hex2mem(page, cmd_bfr, LS_PAGE_SIZE);
+        if (crc_supported)
+            page_crc[pages[i]] = gdb_crc32(0xffffffff, page, LS_PAGE_SIZE);
+        set_bit(page_valid, pages[i]);
+    }
+
+    return ok;
+}
+
+// serves the read from whole cached pages, fetching the missing ones
+static bool gdb_page_cache_read(u32 addr, u8 *buffer, u32 size)
+{
+    if (size == 0 || addr >= LS_SIZE || size > LS_SIZE - addr)
+        return false;
+
+    u32 first = addr / LS_PAGE_SIZE;
+    u32 last = (addr + size - 1) / LS_PAGE_SIZE;
+    u32 missing[LS_PAGES];
+    u32 count = 0;
+
+    for (u32 i = first; i <= last; i++)
+    {
+        if (test_bit(page_stale, i))
+        {
+            gdb_page_cache_validate();
+            break;
+        }
+    }
+
+    for (u32 i = first; i <= last; i++)
+    {
+        if (test_bit(page_prefetched, i))
+        {
+            clear_bit(page_prefetched, i);
+            prefetch.used++;
+        }
+
+        if (!test_bit(page_valid, i))
+            missing[count++] = i;
+    }
+
+    if (!gdb_page_cache_fill(missing, count))
+        return false;
+
+    for (u32 done = 0; done < size; )
+    {
+        u32 a = addr + done;
+        u32 n = min(size - done, LS_PAGE_SIZE - a % LS_PAGE_SIZE);
+
+        memcpy(buffer + done, page_cache[a / LS_PAGE_SIZE] + a % LS_PAGE_SIZE, n);
+        done += n;
+    }
+
+    return true;
+}
+
+// validates the stale pages among those set and fetches the missing ones,
+// all in one burst. Returns how many were fetched, their numbers in
+// missing.
+static u32 gdb_page_cache_load(const u32 pages[LS_PAGES / 32], u32 missing[LS_PAGES])
+{
+    u32 count = 0;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (test_bit(pages, i) && test_bit(page_stale, i))
+        {
+            gdb_page_cache_validate();
+            break;
+        }
+    }
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (test_bit(pages, i) && !test_bit(page_valid, i))
+            missing[count++] = i;
+    }
+
+    gdb_page_cache_fill(missing, count);
+    return count;
+}
+
+void gdb_prefetch(const u32 pages[LS_PAGES / 32])
+{
+    u32 missing[LS_PAGES];
+
+    if (mirror_active() || core_active())
+        return;
+
+    u32 count = gdb_page_cache_load(pages, missing);
+
+    for (u32 i = 0; i < count; i++)
+    {
+        if (test_bit(page_valid, missing[i]))
+        {
+            set_bit(page_prefetched, missing[i]);
+            prefetch.fetched++;
+        }
+    }
+}
+
+void gdb_prefetch_stats(gdb_prefetch_stats_t *stats)
+{
+    *stats = prefetch;
+}
+
+void gdb_prefetch_reset(void)
+{
+    memset(&prefetch, 0, sizeof prefetch);
+}
+
+static u32 gdb_read_mem_direct(u32 addr, u8* buffer, u32 size)
+{
+    if (core_read(addr, buffer, size) || mirror_read(addr, buffer, size))
+        return size;
+
+    if (gdb_page_cache_read(addr, buffer, size))
+        return size;
+
+    // the hex reply to each m has to fit cmd_bfr
+    u32 length = 0;
+
+    while (length < size)
+    {
+        u32 chunk = min(GDB_READ_CHUNK, size - length);
+
+        gdb_packet_t *p = gdb_packet_begin();
+        if (p == NULL)
+            break;
+
+        gdb_packet_put(p, 'm');
+        gdb_packet_hex32(p, addr + length);
+        gdb_packet_put(p, ',');
+        gdb_packet_hex32(p, chunk);
+        gdb_packet_send(p);
+
+        // read ack/nak
+        gdb_read_command();
+        // read the bytes or E##
+        if (!gdb_read_command() || cmd_len % 2 != 0)
+            break;
+
+        u32 n = min(cmd_len / 2, chunk);
+        hex2mem(buffer + length, cmd_bfr, n);
+        length += n;
+
+        if (n < chunk)
+            break;
+    }
+
+    return length;
+
+/*
+	static u8 reply[GDB_BFR_MAX - 4];
+	u32 addr, len;
+	u32 i;
+
+	gdb_ack();
+
+	i = 1;
+	addr = 0;
+	while (cmd_bfr[i] != ',')
+		addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+
+	addr &= LSLR;
+	i++;
+
+	len = 0;
+	while (i < cmd_len)
+		len = (len << 4) | hex2char(cmd_bfr[i++]);
+	dbgprintf("gdb: read memory: %08x bytes from %08x\n", len, addr);
+
+	if (len*2 > sizeof reply)
+		gdb_reply("E01");
+
+	mem2hex(reply, ctx->ls + addr, len);
+	gdb_reply((char *)reply);	
+*/
+}
+
+// X packet straight from buffer: runs of plain bytes are segments of it,
+// escaped bytes are two-byte segments of their own. The checksum is
+// summed in the same pass that looks for bytes to escape. Returns the
+// bytes written, or 0 if the stub does not support X.
+static u32 gdb_write_mem_binary(u32 addr, const u8 *buffer, u32 size)
+{
+	static u8 escaped[GDB_IOV_MAX][2];
+	transport_iov_t iov[GDB_IOV_MAX + 2];
+	u8 header[20];
+	u32 length = min(GDB_WRITE_MAX, size);
+	u32 used = 0, run = 0, i;
+	u8 chksum = 0;
+
+	// iov[0] is the '$', iov[1] the header; both are filled in last
+	u32 count = 2;
+	for (i = 0; i < length; i++)
+    {
+		u8 c = buffer[i];
+
+		if (c == GDB_STUB_START || c == GDB_STUB_END || c == GDB_STUB_ESCAPE || c == GDB_STUB_RLE)
+        {
+			// the run, the escape and whatever follows must still fit
+			if (count + 3 > GDB_IOV_MAX)
+				break;
+
+			if (i > run)
+				gdb_iov_set(&iov[count++], buffer + run, i - run);
+
+			escaped[used][0] = GDB_STUB_ESCAPE;
+			escaped[used][1] = c ^ 0x20;
+			chksum += GDB_STUB_ESCAPE + (c ^ 0x20);
+			gdb_iov_set(&iov[count++], escaped[used++], 2);
+
+			run = i + 1;
+		}
+		else
+			chksum += c;
+	}
+
+	length = i;
+	if (length > run)
+		gdb_iov_set(&iov[count++], buffer + run, length - run);
+
+	header[0] = 'X';
+	wbe32hex(header + 1, addr);
+	header[9] = ',';
+	wbe32hex(header + 10, length);
+	header[18] = ':';
+	chksum += gdb_sum(header, 19);
+	gdb_iov_set(&iov[1], header, 19);
+
+	gdb_send_frame(iov, count - 1, chksum);
+
+	// read ack/nak; nothing follows a nak
+	if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+		return 0;
+	// read OK/E##/""
+	if (!gdb_read_command())
+		return 0;
+
+	// only an empty reply means X is not supported, not a lost connection
+	if (cmd_len == 0)
+    {
+		mem_binary = false;
+		return 0;
+	}
+
+	return length;
+
+/*
+	// gdb_parse_command, case 'X'. The stub's cmd_bfr has to hold a full
+	// GDB_WRITE_MAX write, escaped: 2 * 0x10000 + 32 bytes.
+	u32 addr, len;
+	u32 i;
+
+	gdb_ack();
+
+	i = 1;
+	addr = 0;
+	while (cmd_bfr[i] != ',')
+		addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+
+	addr &= LSLR;
+	i++;
+
+	len = 0;
+	while (cmd_bfr[i] != ':')
+		len = (len << 4) | hex2char(cmd_bfr[i++]);
+	i++;
+
+	if (gdb_unescape(cmd_bfr + i, cmd_len - i) != len || addr + len > LSLR + 1)
+		return gdb_reply("E01");
+
+	memcpy(ctx->ls + addr, cmd_bfr + i, len);
+	gdb_reply("OK");
+*/
+}
+
+// hex encoded M packet, for stubs without X
+static u32 gdb_write_mem_hex(u32 addr, const u8 *buffer, u32 size)
+{
+    // 'M', address, ',', length, ':' and the hex bytes must fit one packet
+    u32 length = min((GDB_BFR_MAX - 23) / 2, size);
+
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return 0;
+
+    gdb_packet_put(p, 'M');
+    gdb_packet_hex32(p, addr);
+    gdb_packet_put(p, ',');
+    gdb_packet_hex32(p, length);
+    gdb_packet_put(p, ':');
+    gdb_packet_mem2hex(p, buffer, length);
+    gdb_packet_send(p);
+
+    // read ack/nak; nothing follows a nak
+    if (!gdb_read_command() || cmd_bfr[0] != GDB_STUB_ACK)
+        return 0;
+    // read OK/E##/""
+    if (!gdb_read_command() || cmd_len == 0)
+        return 0;
+
+    return length;
+}
+
+static u32 gdb_write_mem_direct(u32 addr, const u8 *buffer, u32 size)
+{
+    u32 length = 0;
+
+    while (length < size)
+    {
+        u32 n = 0;
+
+        if (mem_binary)
+            n = gdb_write_mem_binary(addr + length, buffer + length, size - length);
+        if (!mem_binary)
+            n = gdb_write_mem_hex(addr + length, buffer + length, size - length);
+
+        if (n == 0 || cmd_bfr[0] == 'E')
+            break;
+
+        length += n;
+    }
+
+    return length;
+
+/*
+	u32 addr, len;
+	u32 i;
+
+	gdb_ack();
+
+	i = 1;
+	addr = 0;
+	while (cmd_bfr[i] != ',')
+		addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+
+	addr &= LSLR;
+	i++;
+
+	len = 0;
+	while (cmd_bfr[i] != ':')
+		len = (len << 4) | hex2char(cmd_bfr[i++]);
+	dbgprintf("gdb: write memory: %08x bytes to %08x\n", len, addr);
+
+	hex2mem(ctx->ls + addr, cmd_bfr + i, len);
+	gdb_reply("OK");
+*/
+}
+// after a write went through: valid pages take the new bytes, stale ones
+// are dropped as the rest of them is not known to be current
+static void gdb_page_cache_written(u32 addr, const u8 *data, u32 size)
+{
+    for (u32 done = 0; done < size; )
+    {
+        u32 a = addr + done;
+        u32 page = a / LS_PAGE_SIZE;
+        u32 n = min(size - done, LS_PAGE_SIZE - a % LS_PAGE_SIZE);
+
+        if (test_bit(page_valid, page))
+        {
+            memcpy(page_cache[page] + a % LS_PAGE_SIZE, data + done, n);
+            if (crc_supported)
+                page_crc[page] = gdb_crc32(0xffffffff, page_cache[page], LS_PAGE_SIZE);
+        }
+        else
+            clear_bit(page_stale, page);
+
+        done += n;
+    }
+}
+
+static void gdb_write_discard(void)
+{
+    if (wc_low < wc_high)
+        memset(wc_pending + wc_low / 32, 0, ((wc_high + 31) / 32 - wc_low / 32) * sizeof(u32));
+
+    wc_low = LS_SIZE;
+    wc_high = 0;
+}
+
+// buffered bytes over what was read from the target
+static void gdb_write_overlay(u32 addr, u8 *buffer, u32 size)
+{
+    u32 start = addr > wc_low ? addr : wc_low;
+    u32 end = addr + size < wc_high ? addr + size : wc_high;
+
+    for (u32 a = start; a < end; a++)
+    {
+        if (test_bit(wc_pending, a))
+            buffer[a - addr] = wc_data[a];
+    }
+}
+
+bool gdb_flush_writes(void)
+{
+    u32 a = wc_low;
+    bool ok = true;
+
+    while (a < wc_high)
+    {
+        if (!test_bit(wc_pending, a))
+        {
+            a = (a % 32 == 0 && wc_pending[a / 32] == 0) ? a + 32 : a + 1;
+            continue;
+        }
+
+        u32 end = a;
+        while (end < wc_high && test_bit(wc_pending, end))
+            end = (end % 32 == 0 && wc_pending[end / 32] == ~0u && end + 32 <= wc_high) ? end + 32 : end + 1;
+
+        u32 n = gdb_write_mem_direct(a, wc_data + a, end - a);
+        if (n != end - a)
+        {
+            ok = fail("gdb: buffered write of %x bytes to %05x failed\n", end - a, a);
+            gdb_page_cache_drop(a, end - a);
+        }
+        else
+            gdb_page_cache_written(a, wc_data + a, n);
+
+        a = end;
+    }
+
+    gdb_write_discard();
+    return ok;
+}
+
+u32 gdb_read_mem(u32 addr, u8* buffer, u32 size)
+{
+    u32 length = gdb_read_mem_direct(addr, buffer, size);
+
+    gdb_write_overlay(addr, buffer, length);
+    return length;
+}
+
+u32 gdb_read_mem_ranges(gdb_mem_range_t *ranges, u32 count)
+{
+    u32 pages[LS_PAGES / 32];
+    u32 missing[LS_PAGES];
+    u32 complete = 0;
+
+    if (!mirror_active() && !core_active())
+    {
+        memset(pages, 0, sizeof pages);
+
+        for (u32 i = 0; i < count; i++)
+        {
+            u32 addr = ranges[i].addr;
+            u32 size = ranges[i].size;
+
+            if (size == 0 || addr >= LS_SIZE || size > LS_SIZE - addr)
+                continue;
+
+            for (u32 page = addr / LS_PAGE_SIZE; page <= (addr + size - 1) / LS_PAGE_SIZE; page++)
+                set_bit(pages, page);
+        }
+
+        gdb_page_cache_load(pages, missing);
+    }
+
+    // served from the cache now, apart from ranges outside LS
+    for (u32 i = 0; i < count; i++)
+    {
+        ranges[i].length = gdb_read_mem(ranges[i].addr, ranges[i].buffer, ranges[i].size);
+        if (ranges[i].length == ranges[i].size)
+            complete++;
+    }
+
+    return complete;
+}
+
+u32 gdb_write_mem(u32 addr, u8* buffer, u32 size)
+{
+    // a core file is read-only
+    if (core_active())
+        return 0;
+
+    if (size == 0 || addr >= LS_SIZE || size > LS_SIZE - addr)
+    {
+        // keep the order with what is buffered
+        gdb_flush_writes();
+        gdb_page_cache_drop(addr, size);
+        return gdb_write_mem_direct(addr, buffer, size);
+    }
+
+    memcpy(wc_data + addr, buffer, size);
+    for (u32 i = addr; i < addr + size; i++)
+        set_bit(wc_pending, i);
+
+    if (addr < wc_low)
+        wc_low = addr;
+    if (addr + size > wc_high)
+        wc_high = addr + size;
+
+    return size;
+}
+
+
+bool gdb_dirty_pages(u32 bits[LS_PAGES / 32])
+{
+    u8 raw[LS_PAGES / 8];
+
+    if (!dirty_supported)
+        return false;
+
+    gdb_flush_writes();
+    gdb_reply("qSPUDirty");
+
+    // read ack/nak
+    gdb_read_command();
+    // read the hex bitmap, "" or E##
+    gdb_read_command();
+
+    if (cmd_len == 0)
+    {
+        dirty_supported = false;
+        return false;
+    }
+
+    if (cmd_len != sizeof raw * 2)
+        return false;
+
+    for (u32 i = 0; i < cmd_len; i++)
+    {
+        if (!is_hex(cmd_bfr[i]))
+            return false;
+    }
+
+    hex2mem(raw, cmd_bfr, sizeof raw);
+
+    memset(bits, 0, LS_PAGES / 8);
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (raw[i / 8] & (1 << (i % 8)))
+            set_bit(bits, i);
+    }
+
+    gdb_page_cache_clean(bits);
+
+    return true;
+
+/*
+	// every store, DMA and M/X packet into LS marks its pages:
+	//   ls_dirty[(addr / 4096) / 8] |= 1 << ((addr / 4096) % 8);
+	// gdb_handle_query then hands the bitmap over and starts a new one
+	if (strcmp((char *)cmd_bfr, "qSPUDirty") == 0)
+    {
+		gdb_ack();
+		mem2hex(reply, ls_dirty, sizeof ls_dirty);
+		reply[sizeof ls_dirty * 2] = 0;
+		memset(ls_dirty, 0, sizeof ls_dirty);
+		return gdb_reply((char *)reply);
+	}
+*/
+}
+
+bool gdb_crc_pages(const u32 *pages, u32 count, u32 *crc)
+{
+    gdb_flush_writes();
+    return gdb_crc_query(pages, count, crc);
+}
+
+int gdb_search_mem(u32 addr, u32 size, const u8 *pattern, u32 len, u32 *found)
+{
+    if (!search_supported || len == 0 || len > GDB_SEARCH_MAX)
+        return -1;
+
+    // the stub has to see what IDA wrote
+    gdb_flush_writes();
+
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return -1;
+
+    gdb_packet_str(p, "qSearch:memory:");
+    gdb_packet_hex32(p, addr);
+    gdb_packet_put(p, ';');
+    gdb_packet_hex32(p, size);
+    gdb_packet_put(p, ';');
+    for (u32 i = 0; i < len; i++)
+    {
+        u8 c = pattern[i];
+
+        if (c == GDB_STUB_START || c == GDB_STUB_END || c == GDB_STUB_ESCAPE || c == GDB_STUB_RLE)
+        {
+            gdb_packet_put(p, GDB_STUB_ESCAPE);
+            c ^= 0x20;
+        }
+        gdb_packet_put(p, c);
+    }
+    gdb_packet_send(p);
+
+    // read ack/nak
+    gdb_read_command();
+    // read 0, 1,addr, "" or E##
+    gdb_read_command();
+
+    if (cmd_len == 0)
+    {
+        search_supported = false;
+        return -1;
+    }
+
+    if (cmd_len == 1 && cmd_bfr[0] == '0')
+        return 0;
+
+    if (cmd_len < 3 || cmd_len > 10 || cmd_bfr[0] != '1' || cmd_bfr[1] != ',')
+        return -1;
+
+    *found = 0;
+    for (u32 i = 2; i < cmd_len; i++)
+    {
+        if (!is_hex(cmd_bfr[i]))
+            return -1;
+        *found = (*found << 4) | hex2char(cmd_bfr[i]);
+    }
+
+    return 1;
+
+/*
+	// gdb_handle_query. The pattern is binary, escaped like X data.
+	// Candidates are positions whose first and last byte both match,
+	// 16 at a time; only those get a memcmp.
+	if (memcmp(cmd_bfr, "qSearch:memory:", 15) == 0)
+    {
+		i = 15;
+		addr = 0;
+		while (cmd_bfr[i] != ';')
+			addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+		i++;
+		len = 0;
+		while (cmd_bfr[i] != ';')
+			len = (len << 4) | hex2char(cmd_bfr[i++]);
+		i++;
+
+		u8 *pat = cmd_bfr + i;
+		u32 plen = gdb_unescape(pat, cmd_len - i);
+
+		gdb_ack();
+		if (plen == 0 || addr >= LS_SIZE || len > LS_SIZE - addr)
+			return gdb_reply("E01");
+
+		const u8 *ls = ctx->ls + addr;
+		__m128i first = _mm_set1_epi8(pat[0]);
+		__m128i last = _mm_set1_epi8(pat[plen - 1]);
+
+		for (u32 pos = 0; pos + plen <= len; pos += 16)
+        {
+			u32 mask = 0xffff;
+			if (pos + 15 + plen <= len)
+            {
+				__m128i a = _mm_loadu_si128((const __m128i *)(ls + pos));
+				__m128i b = _mm_loadu_si128((const __m128i *)(ls + pos + plen - 1));
+				mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+			}
+
+			for (; mask != 0; mask &= mask - 1)
+            {
+				u32 at = pos + ctz(mask);
+				if (at + plen <= len && memcmp(ls + at, pat, plen) == 0)
+                {
+					sprintf((char *)reply, "1,%x", addr + at);
+					return gdb_reply((char *)reply);
+				}
+			}
+		}
+
+		return gdb_reply("0");
+	}
+*/
+}
+
+#ifdef GDB_CRC_CLMUL
+static bool gdb_cpu_has_clmul(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) != 0 && (info[2] & (1 << 9)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) != 0 && (ecx & bit_SSSE3) != 0;
+#endif
+}
+#endif
+
+static void gdb_crc_init(void)
+{
+    for (u32 i = 0; i < 256; i++)
+    {
+        u32 c = i << 24;
+
+        for (u32 j = 0; j < 8; j++)
+            c = (c & 0x80000000) ? (c << 1) ^ GDB_CRC_POLY : (c << 1);
+
+        crc_table[i] = c;
+    }
+
+#ifdef GDB_CRC_CLMUL
+    // x^128 and x^192 mod P fold the high and low half of a 128 bit block
+    // 128 bits further along
+    u32 x = 1;
+    for (u32 i = 1; i <= 192; i++)
+    {
+        x = (x & 0x80000000) ? (x << 1) ^ GDB_CRC_POLY : (x << 1);
+        if (i == 128)
+            crc_fold[0] = x;
+        if (i == 192)
+            crc_fold[1] = x;
+    }
+
+    crc_clmul = gdb_cpu_has_clmul();
+#endif
+
+    crc_ready = true;
+}
+
+static u32 gdb_crc32_table(u32 crc, const u8 *p, u32 len)
+{
+    while (len-- > 0)
+        crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *p++) & 0xff];
+
+    return crc;
+}
+
+#ifdef GDB_CRC_CLMUL
+// len is a multiple of 16. Blocks are byte reversed on load, most
+// significant bit first, so the carry-less products are plain polynomial
+// products. Seeding with crc is the same as xoring it into the first four
+// bytes. What is left is congruent to the message mod P; the table turns
+// it into the CRC.
+GDB_CLMUL_TARGET static u32 gdb_crc32_clmul(u32 crc, const u8 *p, u32 len)
+{
+    u8 rest[16];
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i fold = _mm_set_epi32(0, (int)crc_fold[1], 0, (int)crc_fold[0]);
+
+    __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), reverse);
+    acc = _mm_xor_si128(acc, _mm_set_epi32((int)crc, 0, 0, 0));
+
+    for (u32 i = 16; i < len; i += 16)
+    {
+        __m128i next = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + i)), reverse);
+        __m128i hi = _mm_clmulepi64_si128(acc, fold, 0x11);
+        __m128i lo = _mm_clmulepi64_si128(acc, fold, 0x00);
+        acc = _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+    }
+
+    _mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(acc, reverse));
+    return gdb_crc32_table(0, rest, sizeof rest);
+}
+#endif
+
+u32 gdb_crc32(u32 crc, const u8 *p, u32 len)
 {
-	u8 reply[64];
+    if (!crc_ready)
+        gdb_crc_init();
 
-	memset(reply, 0, sizeof reply);
-
-    reply[0] = 'p';
-    reply[1] = nibble2hex(id >> 4);
-    reply[2] = nibble2hex(id);
+#ifdef GDB_CRC_CLMUL
+    if (crc_clmul && len >= 16)
+    {
+        u32 n = len & ~15u;
 
-    gdb_reply((char *)reply);
+        crc = gdb_crc32_clmul(crc, p, n);
+        p += n;
+        len -= n;
+    }
+#endif
 
-    // read ack/nak
-    gdb_read_command();
-    // read register value
-    gdb_read_command();
+    return gdb_crc32_table(crc, p, len);
+}
 
-    reg[0] = re32hex(cmd_bfr +  0);
-    if (id < 128)
+void gdb_continue(void)
+{
+    // a core file cannot run; it stops again where it is
+    if (core_active())
     {
-        reg[1] = re32hex(cmd_bfr +  8);
-        reg[2] = re32hex(cmd_bfr + 16);
-        reg[3] = re32hex(cmd_bfr + 24);
+        core_request_stop();
+        return;
     }
 
-/*
-    static u8 reply[32];
-    u32 id;
-
-    memset(reply, 0, sizeof reply);
-
-	id = hex2char(cmd_bfr[1]) << 4;
-	id |= hex2char(cmd_bfr[2]);
+    gdb_flush_writes();
+    gdb_cache_invalidate();
+    gdb_page_cache_resume();
+    gdb_reply("c");
+    // read ack/nak
+    gdb_read_command();
 
+/*
 	gdb_ack();
-	switch (id)
-    {
-		case 0 ... 127:
-			wbe32hex(reply +  0, ctx->reg[id][0]);
-			wbe32hex(reply +  8, ctx->reg[id][1]);
-			wbe32hex(reply + 16, ctx->reg[id][2]);
-			wbe32hex(reply + 24, ctx->reg[id][3]);
-			break;
-		case 128:
-			// SPU ID
-			wbe32hex(reply, SPU_ID);
-			break;
-		case 129:
-			// PC
-			wbe32hex(reply, ctx->pc);
-			break;
-		default:
-			wbe32hex(reply, 0);
-	}
-	gdb_reply((char *)reply);
+	ctx->paused = 0;
+	send_signal = 1;
 */
 }
 
-void gdb_write_register(u32 id, u32 reg[4])
+void gdb_step(void)
 {
-    u8 reply[64];
-
-    if (id > 127 && id != 129)
+    if (core_active())
+    {
+        core_request_stop();
         return;
+    }
 
-    memset(reply, 0, sizeof reply);
+    gdb_flush_writes();
+    gdb_cache_invalidate();
+    gdb_page_cache_resume();
+    gdb_reply("s");
+    // read ack/nak
+    gdb_read_command();
+}
 
-    reply[0] = 'P';
-    reply[1] = nibble2hex(id >> 4);
-    reply[2] = nibble2hex(id);
-    reply[3] = '=';
-    wbe32hex(reply + 4 +  0, reg[0]);
-    if (id < 128)
+void gdb_continue_count(u32 count)
+{
+    if (core_active())
     {
-        wbe32hex(reply + 4 +  8, reg[1]);
-        wbe32hex(reply + 4 + 16, reg[2]);
-        wbe32hex(reply + 4 + 24, reg[3]);
+        core_request_stop();
+        return;
     }
 
-    gdb_reply((char *)reply);
+    gdb_flush_writes();
+    gdb_cache_invalidate();
+    gdb_page_cache_resume();
+
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return;
+
+    gdb_packet_str(p, "i,");
+    gdb_packet_hex32(p, count);
+    gdb_packet_send(p);
 
     // read ack/nak
     gdb_read_command();
-    // read OK/E##
-    gdb_read_command();
 
 /*
-	u32 id;
-	u32 i;
-
+	// gdb_parse_command, case 'i': run like 'c', but stop with SIGTRAP once
+	// count more instructions retired. Breakpoints still stop it early.
 	gdb_ack();
+	i = 1;
+	if (cmd_bfr[i] != ',')
+		return gdb_reply("E01");
+	i++;
+	ctx->stop_count = 0;
+	while (i < cmd_len)
+		ctx->stop_count = (ctx->stop_count << 4) | hex2char(cmd_bfr[i++]);
+	ctx->stop_count += ctx->icount;
+	ctx->paused = 0;
+	send_signal = 1;
 
-	id = hex2char(cmd_bfr[1]) << 4;
-	id |= hex2char(cmd_bfr[2]);
-
-	if (id == 129)
+	// and in the emulator loop, after ctx->icount++:
+	if (ctx->stop_count != 0 && ctx->icount == ctx->stop_count)
     {
-		ctx->pc = 0;
-		i = 4;
-		while (i < cmd_len)
-			ctx->pc = (ctx->pc << 4) | hex2char(cmd_bfr[i++]);
-		ctx->pc -= 4;
-		gdb_reply("OK");
-		return;
+		ctx->stop_count = 0;
+		ctx->paused = 1;
+		sig = SIGTRAP;
+		gdb_handle_signal();
 	}
-
-	if (id > 127)
-		return gdb_reply("E01");
-
-	// XXX: wrong?
-	ctx->reg[id][0] = re32hex(cmd_bfr + 4 +  0);
-	ctx->reg[id][1] = re32hex(cmd_bfr + 4 +  8);
-	ctx->reg[id][2] = re32hex(cmd_bfr + 4 + 16);
-	ctx->reg[id][3] = re32hex(cmd_bfr + 4 + 24);
-	gdb_reply("OK");
 */
 }
 
-u32 gdb_read_mem(u32 addr, u8* buffer, u32 size)
+bool gdb_icount(u64 *count)
 {
-    u8 reply[32];
-
-    memset(reply, 0, sizeof reply);
-
-    reply[0] = 'm';
-    wbe32hex(reply + 1, addr);
-    reply[9] = ',';
-    wbe32hex(reply + 10, size);
+    if (!icount_supported)
+        return false;
 
-    gdb_reply((char *)reply);
+    gdb_reply("qSPUICount");
 
     // read ack/nak
     gdb_read_command();
-    // read OK/E##/""
+    // read 16 hex digits, "" or E##
     gdb_read_command();
 
-    u32 length = min(cmd_len, size);
-
-    if (length > 0)
+    if (cmd_len == 0)
     {
-        hex2mem(buffer, cmd_bfr, length);
+        icount_supported = false;
+        return false;
     }
 
-    return length;
-
-/*
-	static u8 reply[GDB_BFR_MAX - 4];
-	u32 addr, len;
-	u32 i;
-
-	gdb_ack();
-
-	i = 1;
-	addr = 0;
-	while (cmd_bfr[i] != ',')
-		addr = (addr << 4) | hex2char(cmd_bfr[i++]);
-
-	addr &= LSLR;
-	i++;
+    if (cmd_len != 16)
+        return false;
 
-	len = 0;
-	while (i < cmd_len)
-		len = (len << 4) | hex2char(cmd_bfr[i++]);
-	dbgprintf("gdb: read memory: %08x bytes from %08x\n", len, addr);
+    for (u32 i = 0; i < cmd_len; i++)
+    {
+        if (!is_hex(cmd_bfr[i]))
+            return false;
+    }
 
-	if (len*2 > sizeof reply)
-		gdb_reply("E01");
+    *count = ((u64)re32hex(cmd_bfr) << 32) | re32hex(cmd_bfr + 8);
+    return true;
 
-	mem2hex(reply, ctx->ls + addr, len);
-	gdb_reply((char *)reply);	
+/*
+	// gdb_handle_query. ctx->icount counts retired instructions and is
+	// never reset, so the debugger can tell how far 'i' or 'c' got.
+	if (strcmp((char *)cmd_bfr, "qSPUICount") == 0)
+    {
+		gdb_ack();
+		wbe32hex(reply + 0, (u32)(ctx->icount >> 32));
+		wbe32hex(reply + 8, (u32)ctx->icount);
+		reply[16] = 0;
+		return gdb_reply((char *)reply);
+	}
 */
 }
 
-u32 gdb_write_mem(u32 addr, u8* buffer, u32 size)
+void gdb_pause(void)
 {
-    u8 reply[GDB_BFR_MAX - 4];
+    // out of band: a bare byte, not a packet, and never acknowledged
+    const char brk = GDB_STUB_BREAK;
 
-    u32 length = min(GDB_BFR_MAX - 23, size);
-
-    if (length > 0)
+    if (core_active())
     {
-        memset(reply, 0, sizeof reply);
-
-        reply[0] = 'M';
-        wbe32hex(reply + 1, addr);
-        reply[9] = ',';
-        wbe32hex(reply + 10, size);
-        reply[18] = ':';
+        core_request_stop();
+        return;
+    }
 
-        mem2hex(reply + 19, buffer, length);
+    if (!transport_is_open())
+        return;
 
-        gdb_reply((char *)reply);
+    if (!transport_send(&brk, 1))
+        fail("send failed");
 
-        // read ack/nak
-        gdb_read_command();
-        // read OK/E##/""
-        gdb_read_command();
-    }
+/*
+	// gdb_read_command, before looking for GDB_STUB_START. The emulator
+	// polls for it between instructions, so the stop lands on an
+	// instruction boundary and ctx->pc is the next one to execute.
+	if (c == GDB_STUB_BREAK)
+    {
+		ctx->paused = 1;
+		sig = SIGINT;
+		gdb_handle_signal();
+		return false;
+	}
+*/
+}
 
-    return length;
+bool gdb_wait_stop(u32 timeout_ms, u32 *signal, u32 *pc)
+{
+    if (core_take_stop(signal, pc))
+        return true;
 
-/*
-	u32 addr, len;
-	u32 i;
+    if (!transport_is_open())
+        return false;
 
-	gdb_ack();
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
-	i = 1;
-	addr = 0;
-	while (cmd_bfr[i] != ',')
-		addr = (addr << 4) | hex2char(cmd_bfr[i++]);
+    for (;;)
+    {
+        long long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0 || !gdb_data_wait((u32)left))
+            return false;
 
-	addr &= LSLR;
-	i++;
+        if (!gdb_read_command() || cmd_len < 3)
+            continue;
 
-	len = 0;
-	while (cmd_bfr[i] != ':')
-		len = (len << 4) | hex2char(cmd_bfr[i++]);
-	dbgprintf("gdb: write memory: %08x bytes to %08x\n", len, addr);
+        // anything else that arrives first (late acks...) is dropped
+        if (!gdb_parse_stop())
+            continue;
 
-	hex2mem(ctx->ls + addr, cmd_bfr + i, len);
-	gdb_reply("OK");
-*/
+        *signal = last_stop.signal;
+        *pc = gdb_stop_pc();
+        return true;
+    }
 }
 
-void gdb_continue(void)
+const gdb_stop_t *gdb_last_stop(void)
 {
-    gdb_reply("c");
-    // read ack/nak
-    gdb_read_command();
-
-/*
-	gdb_ack();
-	ctx->paused = 0;
-	send_signal = 1;
-*/
+    return &last_stop;
 }
 
-void gdb_step(void)
+bool gdb_stop_has_reg(const gdb_stop_t *stop, u32 id)
 {
-    gdb_reply("s");
-    // read ack/nak
-    gdb_read_command();
+    return id < GDB_REG_COUNT && test_bit(stop->valid, id);
 }
 
-void gdb_pause(void)
+bool gdb_interrupt(u32 timeout_ms, u32 *signal, u32 *pc)
 {
-    gdb_reply(" ");
-    // read ack/nak
-    gdb_read_command();
+    gdb_pause();
+    return gdb_wait_stop(timeout_ms, signal, pc);
 }
 
 void gdb_add_bp(u32 addr, gdb_bp_type type, u32 size)
 {
-    u8 reply[32];
-
     u8 bpt = 0;
+
+    // a stub that plants breakpoints in LS must save the patched bytes
+    gdb_flush_writes();
+
     switch (type)
     {
     case GDB_BP_TYPE_X:
@@ -809,16 +2509,17 @@ void gdb_add_bp(u32 addr, gdb_bp_type type, u32 size)
         return;
     }
 
-    memset(reply, 0, sizeof reply);
-
-    reply[0] = 'Z';
-    reply[1] = nibble2hex(bpt);
-    reply[2] = ',';
-    wbe32hex(reply +  3, addr);
-    reply[11] = ',';
-    wbe32hex(reply + 12, size);
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return;
 
-    gdb_reply((char *)reply);
+    gdb_packet_put(p, 'Z');
+    gdb_packet_put(p, nibble2hex(bpt));
+    gdb_packet_put(p, ',');
+    gdb_packet_hex32(p, addr);
+    gdb_packet_put(p, ',');
+    gdb_packet_hex32(p, size);
+    gdb_packet_send(p);
 
     // read ack/nak
     gdb_read_command();
@@ -875,9 +2576,10 @@ void gdb_add_bp(u32 addr, gdb_bp_type type, u32 size)
 
 void gdb_remove_bp(u32 addr, gdb_bp_type type, u32 size)
 {
-    u8 reply[32];
-
     u8 bpt = 0;
+
+    gdb_flush_writes();
+
     switch (type)
     {
     case GDB_BP_TYPE_X:
@@ -898,16 +2600,17 @@ void gdb_remove_bp(u32 addr, gdb_bp_type type, u32 size)
         return;
     }
 
-    memset(reply, 0, sizeof reply);
-
-    reply[0] = 'z';
-    reply[1] = nibble2hex(bpt);
-    reply[2] = ',';
-    wbe32hex(reply +  3, addr);
-    reply[11] = ',';
-    wbe32hex(reply + 12, size);
+    gdb_packet_t *p = gdb_packet_begin();
+    if (p == NULL)
+        return;
 
-    gdb_reply((char *)reply);
+    gdb_packet_put(p, 'z');
+    gdb_packet_put(p, nibble2hex(bpt));
+    gdb_packet_put(p, ',');
+    gdb_packet_hex32(p, addr);
+    gdb_packet_put(p, ',');
+    gdb_packet_hex32(p, size);
+    gdb_packet_send(p);
 
     // read ack/nak
     gdb_read_command();
@@ -968,6 +2671,7 @@ static void gdb_parse_command(event_callback* callback)
     case GDB_STUB_NAK:
         dbgprintf("NAK received.\n");
         break;
+    case 'S':
     case 'T':
         gdb_handle_signal(callback);
         break;
@@ -1023,56 +2727,181 @@ static void gdb_parse_command(event_callback* callback)
 	}
 }
 
-#ifdef _WIN32
-	WSADATA InitData;
-#endif
 
 // exported functions
 
-bool gdb_init(u32 port)
+// maps the emulator's local store if it offers one
+static void gdb_open_mirror(void)
+{
+	char name[256];
+
+	gdb_reply("qSPULsMirror");
+
+	// read ack/nak
+	gdb_read_command();
+	// read the hex encoded segment name or ""
+	gdb_read_command();
+
+	if (cmd_len == 0 || cmd_len % 2 != 0 || cmd_len / 2 >= sizeof name)
+		return;
+
+	for (u32 i = 0; i < cmd_len; i++)
+    {
+		if (!is_hex(cmd_bfr[i]))
+			return;
+	}
+
+	hex2mem((u8 *)name, cmd_bfr, cmd_len / 2);
+	name[cmd_len / 2] = 0;
+
+	if (!mirror_open(name))
+		dbgprintf("gdb: cannot map local store mirror %s\n", name);
+
+/*
+	// gdb_handle_query, when the emulator was started with a mirror
+	if (strcmp((char *)cmd_bfr, "qSPULsMirror") == 0)
+    {
+		gdb_ack();
+		mem2hex(reply, (u8 *)mirror_name, strlen(mirror_name));
+		reply[strlen(mirror_name) * 2] = 0;
+		return gdb_reply((char *)reply);
+	}
+*/
+}
+
+static void gdb_reset(void)
 {
-	int tmpsock;
-	socklen_t len;
-	int on;
-#ifdef _WIN32
-	WSAStartup(MAKEWORD(2,2), &InitData);
-#endif
 	memset(bp_x, 0, sizeof bp_x);
 	memset(bp_r, 0, sizeof bp_r);
 	memset(bp_w, 0, sizeof bp_w);
 	memset(bp_a, 0, sizeof bp_a);
 
-	tmpsock = socket(AF_INET, SOCK_STREAM, 0);
-	if (tmpsock == -1)
-		return fail("Failed to create gdb socket");
+	regs_binary = true;
+	mem_binary = true;
+	dirty_supported = true;
+	crc_supported = true;
+	search_supported = true;
+	icount_supported = true;
+	gdb_cache_invalidate();
+	gdb_page_cache_flush();
+	gdb_write_discard();
+	rx_pos = rx_len = 0;
+}
+
+// what gdb_select swaps. The register and page caches are not kept: they
+// are dropped on every switch, after the buffered writes went out.
+typedef struct
+{
+	bool used;
+	u8 rx_bfr[sizeof rx_bfr];
+	u32 rx_pos, rx_len;
+	bool mem_binary;
+	bool regs_binary;
+	bool dirty_supported;
+	bool crc_supported;
+	bool search_supported;
+	bool icount_supported;
+	u32 sig;
+	u32 send_signal;
+	gdb_stop_t last_stop;
+	gdb_bp_t bp_x[GDB_MAX_BP];
+	gdb_bp_t bp_r[GDB_MAX_BP];
+	gdb_bp_t bp_w[GDB_MAX_BP];
+	gdb_bp_t bp_a[GDB_MAX_BP];
+	gdb_prefetch_stats_t prefetch;
+} gdb_connection_t;
+
+static gdb_connection_t connections[GDB_CONNECTIONS];
+static u32 selected = 0;
+
+void gdb_select(u32 connection)
+{
+	if (connection >= GDB_CONNECTIONS || connection == selected)
+		return;
+
+	gdb_flush_writes();
+
+	gdb_connection_t *c = &connections[selected];
+	c->used = true;
+	memcpy(c->rx_bfr, rx_bfr + rx_pos, rx_len - rx_pos);
+	c->rx_pos = 0;
+	c->rx_len = rx_len - rx_pos;
+	c->mem_binary = mem_binary;
+	c->regs_binary = regs_binary;
+	c->dirty_supported = dirty_supported;
+	c->crc_supported = crc_supported;
+	c->search_supported = search_supported;
+	c->icount_supported = icount_supported;
+	c->sig = sig;
+	c->send_signal = send_signal;
+	c->last_stop = last_stop;
+	memcpy(c->bp_x, bp_x, sizeof bp_x);
+	memcpy(c->bp_r, bp_r, sizeof bp_r);
+	memcpy(c->bp_w, bp_w, sizeof bp_w);
+	memcpy(c->bp_a, bp_a, sizeof bp_a);
+	c->prefetch = prefetch;
+
+	selected = connection;
+	transport_select(connection);
+	mirror_select(connection);
+	core_select(connection);
+
+	gdb_reset();
+
+	c = &connections[selected];
+	if (!c->used)
+	{
+		sig = send_signal = 0;
+		memset(&last_stop, 0, sizeof last_stop);
+		memset(&prefetch, 0, sizeof prefetch);
+		return;
+	}
+
+	memcpy(rx_bfr, c->rx_bfr, c->rx_len);
+	rx_pos = 0;
+	rx_len = c->rx_len;
+	mem_binary = c->mem_binary;
+	regs_binary = c->regs_binary;
+	dirty_supported = c->dirty_supported;
+	crc_supported = c->crc_supported;
+	search_supported = c->search_supported;
+	icount_supported = c->icount_supported;
+	sig = c->sig;
+	send_signal = c->send_signal;
+	last_stop = c->last_stop;
+	memcpy(bp_x, c->bp_x, sizeof bp_x);
+	memcpy(bp_r, c->bp_r, sizeof bp_r);
+	memcpy(bp_w, c->bp_w, sizeof bp_w);
+	memcpy(bp_a, c->bp_a, sizeof bp_a);
+	prefetch = c->prefetch;
+}
+
+u32 gdb_selected(void)
+{
+	return selected;
+}
 
-    sock = tmpsock;
+bool gdb_init(const char *host, u32 port)
+{
+	gdb_reset();
 
-	on = 1;
-	if (setsockopt(tmpsock, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof on) < 0)
-		return fail("Failed to setsockopt");
+	if (host != NULL && strncmp(host, "core:", 5) == 0)
+	{
+		if (!core_open(host + 5))
+			return fail("Cannot open core file %s", host + 5);
 
-	memset(&saddr_server, 0, sizeof saddr_server);
-	saddr_server.sin_family = AF_INET;
-	saddr_server.sin_port = htons(port);
-	saddr_server.sin_addr.s_addr = inet_addr("127.0.0.1");
+		dbgprintf("Opened core file %s.\n", host + 5);
+		return true;
+	}
 
 	dbgprintf("Connecting to gdb server...\n");
-	int result = connect(tmpsock, (struct sockaddr *)&saddr_server, sizeof saddr_server);
-
-	if (result < 0)
-		return fail("Failed to connect to gdb server");
-
-	dbgprintf("Server connected.\n");
-    
-	saddr_client.sin_addr.s_addr = ntohl(saddr_client.sin_addr.s_addr);
-	/*if (((saddr_client.sin_addr.s_addr >> 24) & 0xff) != 127 ||
-	    ((saddr_client.sin_addr.s_addr >> 16) & 0xff) !=   0 ||
-	    ((saddr_client.sin_addr.s_addr >>  8) & 0xff) !=   0 ||
-	    ((saddr_client.sin_addr.s_addr >>  0) & 0xff) !=   1)
-		fail("gdb: incoming connection not from localhost");
-	*/
-	//close(tmpsock);
+
+	if (!transport_open(host, port))
+		return fail("Failed to connect to gdb server (%s)", transport_name());
+
+	dbgprintf("Server connected over %s.\n", transport_name());
+
+	gdb_open_mirror();
 
     return true;
 }
@@ -1080,19 +2909,22 @@ bool gdb_init(u32 port)
 
 void gdb_deinit(void)
 {
-	if (sock == -1)
-		return;
+	mirror_close();
+	core_close();
 
-	closesocket(sock);
-	sock = -1;
+	if (!transport_is_open())
+		return;
 
-#ifdef _WIN32
-	WSACleanup();
-#endif
+	gdb_flush_writes();
+	transport_close();
 }
 
 void gdb_kill()
 {
+    gdb_cache_invalidate();
+    gdb_page_cache_flush();
+    gdb_write_discard();
+
     gdb_reply("k");
     // read ack/nak
     gdb_read_command();
@@ -1103,7 +2935,13 @@ void gdb_kill()
 
 void gdb_handle_events(event_callback* callback)
 {
-	if (sock == -1)
+	u32 signal, pc;
+
+	// the stop stays pending until someone can take it
+	if (0 != callback && core_take_stop(&signal, &pc))
+		callback(signal, pc);
+
+	if (!transport_is_open())
 		return;
 
 	while (gdb_data_available())
@@ -1116,7 +2954,7 @@ void gdb_handle_events(event_callback* callback)
 /*
 int gdb_signal(u32 s)
 {
-	if (sock == -1)
+	if (!transport_is_open())
 		return 1;
 
 	sig = s;
@@ -1133,7 +2971,7 @@ int gdb_signal(u32 s)
 
 int gdb_bp_x(u32 addr)
 {
-	if (sock == -1)
+	if (!transport_is_open())
 		return 0;
 
 	return gdb_bp_check(addr, GDB_BP_TYPE_X);
@@ -1141,7 +2979,7 @@ int gdb_bp_x(u32 addr)
 
 int gdb_bp_r(u32 addr)
 {
-	if (sock == -1)
+	if (!transport_is_open())
 		return 0;
 
 	return gdb_bp_check(addr, GDB_BP_TYPE_R);
@@ -1149,7 +2987,7 @@ int gdb_bp_r(u32 addr)
 
 int gdb_bp_w(u32 addr)
 {
-	if (sock == -1)
+	if (!transport_is_open())
 		return 0;
 
 	return gdb_bp_check(addr, GDB_BP_TYPE_W);
@@ -1157,7 +2995,7 @@ int gdb_bp_w(u32 addr)
 
 int gdb_bp_a(u32 addr)
 {
-	if (sock == -1)
+	if (!transport_is_open())
 		return 0;
 
 	return gdb_bp_check(addr, GDB_BP_TYPE_A);
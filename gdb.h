@@ -17,6 +17,10 @@
 #define	LS_SIZE	256 * 1024
 #define	LSLR	(LS_SIZE - 1)
 
+// granularity of the stub's dirty tracking and of page CRCs
+#define	LS_PAGE_SIZE	4096
+#define	LS_PAGES	(LS_SIZE / LS_PAGE_SIZE)
+
 typedef enum
 {
 	GDB_BP_TYPE_NONE = 0,
@@ -26,8 +30,53 @@ typedef enum
 	GDB_BP_TYPE_A
 } gdb_bp_type;
 
-bool gdb_init(u32 port);
+#define GDB_REG_COUNT	130
+#define GDB_REG_SPU_ID	0x80
+#define GDB_REG_PC		0x81
+
+// longest pattern gdb_search_mem sends
+#define GDB_SEARCH_MAX	256
+
+// everything a T stop reply carried
+typedef struct
+{
+	u32 signal;
+	u32 thread;					// ~0 if not reported
+	gdb_bp_type watch;			// watchpoint that triggered, or GDB_BP_TYPE_NONE
+	u32 watch_addr;
+	bool swbreak;
+	bool hwbreak;
+	u32 valid[(GDB_REG_COUNT + 31) / 32];	// expedited registers
+	u32 reg[GDB_REG_COUNT][4];
+} gdb_stop_t;
+
+// pages brought in by gdb_prefetch, and what became of them
+typedef struct
+{
+	u32 fetched;
+	u32 used;					// read before the target ran again
+	u32 wasted;					// not read before the target ran again
+} gdb_prefetch_stats_t;
+
+// one range for gdb_read_mem_ranges
+typedef struct
+{
+	u32 addr;
+	u32 size;
+	u8 *buffer;
+	u32 length;					// bytes read
+} gdb_mem_range_t;
+
+// connection 0 is the debugger's and selected at start; the others are
+// for lockstep. Everything below talks to the selected one. Switching
+// sends the buffered writes and drops the register and page caches.
+#define GDB_CONNECTIONS	3
+
+// host selects the transport, see transport.h
+bool gdb_init(const char *host, u32 port);
 void gdb_deinit(void);
+void gdb_select(u32 connection);
+u32 gdb_selected(void);
 
 typedef void event_callback(u32 signal, u32 address);
 
@@ -43,15 +92,60 @@ void gdb_handle_query();
 void gdb_handle_set_thread();
 void gdb_handle_signal(event_callback* callback);
 void gdb_ack();
-void gdb_read_registers(u32 reg[130][4]);
-void gdb_write_registers(u32 reg[130][4]);
-void gdb_read_register(u32 id, u32 reg[4]);
-void gdb_write_register(u32 id, u32 reg[4]);
+// the register functions return false if the stub sent E## or no usable
+// reply; registers that were not read are left as they were
+bool gdb_read_registers(u32 reg[130][4]);
+// fills reg[first] to reg[first + count - 1], fetching only what is not cached
+bool gdb_read_register_range(u32 first, u32 count, u32 reg[130][4]);
+bool gdb_write_registers(u32 reg[130][4]);
+bool gdb_read_register(u32 id, u32 reg[4]);
+bool gdb_write_register(u32 id, u32 reg[4]);
 u32 gdb_read_mem(u32 addr, u8* buffer, u32 size);
+// reads all ranges after one pipelined burst. Ranges are coalesced into
+// the 4 KB pages the page cache holds, so nearby ones share a fetch.
+// Returns how many were read in full.
+u32 gdb_read_mem_ranges(gdb_mem_range_t *ranges, u32 count);
+// LS writes are buffered while the target is stopped and sent, adjacent
+// ones merged, by gdb_flush_writes. That happens by itself before the
+// target runs and before breakpoint, qCRC and qSPUDirty packets. Reads
+// see the buffered bytes.
 u32 gdb_write_mem(u32 addr, u8* buffer, u32 size);
+// false if any of the buffered writes failed; they are dropped either way
+bool gdb_flush_writes(void);
+// warms the page cache with the pages set in pages, in one pipelined batch
+void gdb_prefetch(const u32 pages[LS_PAGES / 32]);
+void gdb_prefetch_stats(gdb_prefetch_stats_t *stats);
+void gdb_prefetch_reset(void);
+// pages written since the previous call, bit n of bits[n / 32] for page n.
+// false if the stub does not track them
+bool gdb_dirty_pages(u32 bits[LS_PAGES / 32]);
+// the stub's qCRC of each of count pages (page numbers), all requests sent
+// before the first reply is read. false if any of them failed
+bool gdb_crc_pages(const u32 *pages, u32 count, u32 *crc);
+// the CRC qCRC computes: CRC-32, polynomial 0x04c11db7, MSB first, seeded
+// with ~0 and not inverted at the end
+u32 gdb_crc32(u32 crc, const u8 *p, u32 len);
+// qSearch:memory for the first len byte pattern in [addr, addr + size).
+// 1 with its address in found, 0 if there is none, -1 if the stub does not
+// support it or the query failed
+int gdb_search_mem(u32 addr, u32 size, const u8 *pattern, u32 len, u32 *found);
 void gdb_continue();
+// resume for at most count instructions ("i,count"); the stop reply is
+// read as after gdb_continue
+void gdb_continue_count(u32 count);
 void gdb_step();
+// instructions the SPU retired so far (qSPUICount). false if the stub does
+// not count them
+bool gdb_icount(u64 *count);
 void gdb_pause();
+// wait for the stop reply after a pause; pc is ~0 if the reply has none
+bool gdb_wait_stop(u32 timeout_ms, u32 *signal, u32 *pc);
+// the last stop reply seen
+const gdb_stop_t *gdb_last_stop(void);
+bool gdb_stop_has_reg(const gdb_stop_t *stop, u32 id);
+// pause and wait. The signal is SIGINT unless the target stopped on its own
+// (breakpoint...) before the interrupt arrived.
+bool gdb_interrupt(u32 timeout_ms, u32 *signal, u32 *pc);
 void gdb_remove_bp(u32 addr, gdb_bp_type type, u32 size);
 void gdb_add_bp(u32 addr, gdb_bp_type type, u32 size);
 void gdb_kill();
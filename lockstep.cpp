@@ -0,0 +1,400 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "lockstep.h"
+#include "checkpoint.h"
+#include "mirror.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock lockstep_clock;
+
+#define LOCKSTEP_SIDES          2
+
+typedef struct
+{
+    u32 reg[GDB_REG_COUNT][4];
+    u32 crc[LS_PAGES];
+    u64 count;                  // qSPUICount
+    u64 ran;                    // retired by the last run
+    u32 signal;
+} lockstep_side_t;
+
+static lockstep_side_t side[LOCKSTEP_SIDES];
+
+// the state both agreed on last
+static u8 base_ls[LS_SIZE];
+static u32 base_crc[LS_PAGES];
+static u32 base_reg[GDB_REG_COUNT][4];
+
+// set for the whole run, while the global connection state is swapped
+static std::atomic<bool> busy(false);
+
+// private helpers
+static void lockstep_select(u32 s)
+{
+    gdb_select(1 + s);
+}
+
+// registers and page CRCs of the selected side
+static bool lockstep_read_state(lockstep_side_t *t)
+{
+    static u8 ls[LS_SIZE];
+    u32 numbers[LS_PAGES];
+
+    if (!gdb_read_registers(t->reg))
+        return false;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        numbers[i] = i;
+
+    if (!mirror_active() && gdb_crc_pages(numbers, LS_PAGES, t->crc))
+        return true;
+
+    if (gdb_read_mem(0, ls, LS_SIZE) != LS_SIZE)
+        return false;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        t->crc[i] = gdb_crc32(0xffffffff, ls + i * LS_PAGE_SIZE, LS_PAGE_SIZE);
+
+    return true;
+}
+
+static bool lockstep_same_reg(u32 id)
+{
+    // only the preferred slot of the PC means anything
+    u32 words = id == GDB_REG_PC ? 1 : 4;
+
+    return memcmp(side[0].reg[id], side[1].reg[id], words * sizeof(u32)) == 0;
+}
+
+static bool lockstep_same(void)
+{
+    if (side[0].ran != side[1].ran || side[0].signal != side[1].signal)
+        return false;
+
+    if (memcmp(side[0].crc, side[1].crc, sizeof side[0].crc) != 0)
+        return false;
+
+    for (u32 i = 0; i < 128; i++)
+    {
+        if (!lockstep_same_reg(i))
+            return false;
+    }
+
+    return lockstep_same_reg(GDB_REG_PC);
+}
+
+// runs both for count instructions, side by side
+static bool lockstep_step(u32 count)
+{
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        lockstep_select(s);
+        gdb_continue_count(count);
+    }
+
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        u32 pc;
+        u64 now;
+
+        lockstep_select(s);
+        if (!gdb_wait_stop(LOCKSTEP_TIMEOUT_MS, &side[s].signal, &pc) || !gdb_icount(&now))
+            return false;
+
+        side[s].ran = now - side[s].count;
+        side[s].count = now;
+
+        if (!lockstep_read_state(&side[s]))
+            return false;
+    }
+
+    return true;
+}
+
+// both agree: what side 0 holds becomes the base. Only the pages whose CRC
+// changed are read, unless all is set
+static bool lockstep_rebase(bool all)
+{
+    gdb_mem_range_t ranges[LS_PAGES];
+    u32 count = 0;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (!all && side[0].crc[i] == base_crc[i])
+            continue;
+
+        ranges[count].addr = i * LS_PAGE_SIZE;
+        ranges[count].size = LS_PAGE_SIZE;
+        ranges[count].buffer = base_ls + i * LS_PAGE_SIZE;
+        count++;
+    }
+
+    lockstep_select(0);
+    if (gdb_read_mem_ranges(ranges, count) != count)
+        return false;
+
+    memcpy(base_crc, side[0].crc, sizeof base_crc);
+    memcpy(base_reg, side[0].reg, sizeof base_reg);
+    return true;
+}
+
+static bool lockstep_restore(void)
+{
+    const u8 *pages[LS_PAGES];
+    checkpoint_stats_t stats;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        pages[i] = base_ls + i * LS_PAGE_SIZE;
+
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        lockstep_select(s);
+        if (!checkpoint_apply(pages, base_crc, base_reg, &stats))
+            return false;
+
+        memcpy(side[s].crc, base_crc, sizeof base_crc);
+        memcpy(side[s].reg, base_reg, sizeof base_reg);
+    }
+
+    return true;
+}
+
+static void lockstep_diff_reg(u32 id, lockstep_report_t *report)
+{
+    lockstep_reg_diff_t diff;
+
+    if (lockstep_same_reg(id))
+        return;
+
+    diff.id = id;
+    memcpy(diff.a, side[0].reg[id], sizeof diff.a);
+    memcpy(diff.b, side[1].reg[id], sizeof diff.b);
+    report->regs.push_back(diff);
+}
+
+// what the two hold differently now
+static bool lockstep_diff(lockstep_report_t *report)
+{
+    static u8 data[LOCKSTEP_SIDES][LS_SIZE];
+    gdb_mem_range_t ranges[LS_PAGES];
+    u32 count = 0;
+
+    for (u32 i = 0; i < 128; i++)
+        lockstep_diff_reg(i, report);
+    lockstep_diff_reg(GDB_REG_PC, report);
+
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        count = 0;
+        for (u32 i = 0; i < LS_PAGES; i++)
+        {
+            if (side[0].crc[i] == side[1].crc[i])
+                continue;
+
+            ranges[count].addr = i * LS_PAGE_SIZE;
+            ranges[count].size = LS_PAGE_SIZE;
+            ranges[count].buffer = data[s] + i * LS_PAGE_SIZE;
+            count++;
+        }
+
+        lockstep_select(s);
+        if (gdb_read_mem_ranges(ranges, count) != count)
+            return false;
+    }
+
+    // runs of differing bytes; a run can go on into the next page
+    lockstep_mem_diff_t *run = NULL;
+
+    for (u32 r = 0; r < count; r++)
+    {
+        for (u32 addr = ranges[r].addr; addr < ranges[r].addr + LS_PAGE_SIZE; addr++)
+        {
+            if (data[0][addr] == data[1][addr])
+            {
+                run = NULL;
+                continue;
+            }
+
+            report->mem_bytes++;
+
+            if (run == NULL || run->addr + run->size != addr)
+            {
+                run = NULL;
+                if (report->mem.size() >= LOCKSTEP_MEM_DIFFS)
+                    continue;
+
+                report->mem.push_back(lockstep_mem_diff_t());
+                run = &report->mem.back();
+                run->addr = addr;
+                run->size = 0;
+            }
+
+            if (run->size < LOCKSTEP_MEM_SHOWN)
+            {
+                run->a[run->size] = data[0][addr];
+                run->b[run->size] = data[1][addr];
+            }
+            run->size++;
+        }
+    }
+
+    return true;
+}
+
+static void lockstep_report_stop(u32 pc, lockstep_report_t *report)
+{
+    u8 word[4];
+
+    report->pc = pc;
+    report->insn = 0;
+
+    lockstep_select(0);
+    if (gdb_read_mem(pc & LSLR & ~3, word, sizeof word) == sizeof word)
+        report->insn = (word[0] << 24) | (word[1] << 16) | (word[2] << 8) | word[3];
+
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        report->ran[s] = (u32)side[s].ran;
+        report->signal[s] = side[s].signal;
+    }
+}
+
+static lockstep_result lockstep_drive(u32 batch, u64 limit, lockstep_report_t *report)
+{
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        lockstep_select(s);
+
+        side[s].ran = 0;
+        side[s].signal = 0;
+        if (!gdb_icount(&side[s].count) || !lockstep_read_state(&side[s]))
+            return LOCKSTEP_FAILED;
+    }
+
+    // apart from the start
+    if (!lockstep_same())
+    {
+        lockstep_report_stop(side[0].reg[GDB_REG_PC][0], report);
+        return lockstep_diff(report) ? LOCKSTEP_DIVERGED : LOCKSTEP_FAILED;
+    }
+
+    if (!lockstep_rebase(true))
+        return LOCKSTEP_FAILED;
+
+    for (;;)
+    {
+        u32 count = batch;
+
+        if (limit != 0)
+        {
+            if (report->position >= limit)
+                return LOCKSTEP_SAME;
+            if (limit - report->position < count)
+                count = (u32)(limit - report->position);
+        }
+
+        if (!lockstep_step(count))
+            return LOCKSTEP_FAILED;
+        report->batches++;
+
+        if (lockstep_same())
+        {
+            report->position += side[0].ran;
+
+            // both stopped early, the same way
+            if (side[0].ran < count)
+            {
+                lockstep_report_stop(side[0].reg[GDB_REG_PC][0], report);
+                return LOCKSTEP_SAME;
+            }
+
+            if (!lockstep_rebase(false))
+                return LOCKSTEP_FAILED;
+            continue;
+        }
+
+        // the base holds and count from it does not: halve that
+        bool at_base = false;
+
+        while (count > 1)
+        {
+            u32 half = count / 2;
+
+            if (!lockstep_restore() || !lockstep_step(half))
+                return LOCKSTEP_FAILED;
+            report->replays++;
+
+            at_base = lockstep_same() && side[0].ran == half;
+            if (at_base)
+            {
+                if (!lockstep_rebase(false))
+                    return LOCKSTEP_FAILED;
+
+                report->position += half;
+                count -= half;
+            }
+            else
+                count = half;
+        }
+
+        // the one instruction at the base
+        if ((!at_base && !lockstep_restore()) || !lockstep_step(1))
+            return LOCKSTEP_FAILED;
+        report->replays++;
+
+        lockstep_report_stop(base_reg[GDB_REG_PC][0], report);
+        return lockstep_diff(report) ? LOCKSTEP_DIVERGED : LOCKSTEP_FAILED;
+    }
+}
+
+// exported functions
+lockstep_result lockstep_run(const char *host_a, u32 port_a, const char *host_b, u32 port_b,
+                             u32 batch, u64 limit, lockstep_report_t *report)
+{
+    lockstep_clock::time_point start = lockstep_clock::now();
+    lockstep_result result = LOCKSTEP_FAILED;
+    u32 previous = gdb_selected();
+
+    report->position = 0;
+    report->pc = 0;
+    report->insn = 0;
+    report->ran[0] = report->ran[1] = 0;
+    report->signal[0] = report->signal[1] = 0;
+    report->batches = 0;
+    report->replays = 0;
+    report->regs.clear();
+    report->mem.clear();
+    report->mem_bytes = 0;
+
+    if (batch == 0)
+        batch = LOCKSTEP_BATCH;
+
+    busy = true;
+    lockstep_select(0);
+    if (gdb_init(host_a, port_a))
+    {
+        lockstep_select(1);
+        if (gdb_init(host_b, port_b))
+            result = lockstep_drive(batch, limit, report);
+    }
+
+    for (u32 s = 0; s < LOCKSTEP_SIDES; s++)
+    {
+        lockstep_select(s);
+        gdb_deinit();
+    }
+    gdb_select(previous);
+    busy = false;
+
+    report->seconds = std::chrono::duration<double>(lockstep_clock::now() - start).count();
+    return result;
+}
+
+bool lockstep_busy(void)
+{
+    return busy;
+}
@@ -0,0 +1,78 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef LOCKSTEP_H__
+#define LOCKSTEP_H__
+
+#include <vector>
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Lockstep
+//
+//      Two emulators loaded with the same image are driven side by side on
+//      gdb connections 1 and 2 (see gdb_select). Both run batch instructions
+//      with "i,count", at the same time, and then their registers and LS
+//      page CRCs are compared. qSPUICount tells how far each got.
+//
+//      The state both agreed on last is kept here. Once a batch ends with
+//      them apart, both are put back to it (only the pages that changed are
+//      sent) and the batch is bisected, one replay of each per halving,
+//      down to the first instruction after which they differ. Both are left
+//      standing after it.
+//
+//      The SPU id register is not compared.
+//
+
+#define LOCKSTEP_BATCH          100000          // default instructions per batch
+#define LOCKSTEP_TIMEOUT_MS     10000           // for a batch to stop
+#define LOCKSTEP_MEM_DIFFS      64              // runs of differing LS bytes kept
+#define LOCKSTEP_MEM_SHOWN      16              // bytes kept of each run
+
+typedef enum
+{
+    LOCKSTEP_DIVERGED = 0,
+    LOCKSTEP_SAME,              // the limit was reached, or both stopped alike
+    LOCKSTEP_FAILED             // no connection, no qSPUICount, or a run failed
+} lockstep_result;
+
+typedef struct
+{
+    u32 id;
+    u32 a[4];
+    u32 b[4];
+} lockstep_reg_diff_t;
+
+typedef struct
+{
+    u32 addr;
+    u32 size;
+    u8 a[LOCKSTEP_MEM_SHOWN];
+    u8 b[LOCKSTEP_MEM_SHOWN];
+} lockstep_mem_diff_t;
+
+typedef struct
+{
+    u64 position;               // instructions both ran alike
+    u32 pc;                     // the next one, where they part
+    u32 insn;                   // its word
+    u32 ran[2];                 // how many of it each retired (0 or 1)
+    u32 signal[2];
+    u32 batches;
+    u32 replays;                // bisection runs
+    double seconds;
+    std::vector<lockstep_reg_diff_t> regs;
+    std::vector<lockstep_mem_diff_t> mem;   // at most LOCKSTEP_MEM_DIFFS
+    u32 mem_bytes;              // all bytes that differ
+} lockstep_report_t;
+
+// connects to both emulators, runs them until they part, limit
+// instructions went by (0 for no limit) or both stopped on their own, and
+// disconnects. The selected connection is selected again afterwards.
+lockstep_result lockstep_run(const char *host_a, u32 port_a, const char *host_b, u32 port_b,
+                             u32 batch, u64 limit, lockstep_report_t *report);
+// true while lockstep_run has the gdb connections swapped
+bool lockstep_busy(void);
+
+#endif
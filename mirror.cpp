@@ -0,0 +1,153 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "mirror.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const mirror_ls_t *mirror = NULL;
+
+#ifdef _WIN32
+static HANDLE mirror_mapping = NULL;
+#endif
+
+// what mirror_select swaps
+typedef struct
+{
+    const mirror_ls_t *mirror;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} mirror_connection_t;
+
+static mirror_connection_t connections[GDB_CONNECTIONS];
+static u32 selected = 0;
+
+void mirror_select(u32 connection)
+{
+    if (connection >= GDB_CONNECTIONS || connection == selected)
+        return;
+
+    connections[selected].mirror = mirror;
+#ifdef _WIN32
+    connections[selected].mapping = mirror_mapping;
+#endif
+
+    selected = connection;
+    mirror = connections[selected].mirror;
+#ifdef _WIN32
+    mirror_mapping = connections[selected].mapping;
+#endif
+}
+
+bool mirror_open(const char *name)
+{
+    mirror_close();
+
+#ifdef _WIN32
+    mirror_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (mirror_mapping == NULL)
+        return false;
+
+    mirror = (const mirror_ls_t *)MapViewOfFile(mirror_mapping, FILE_MAP_READ, 0, 0, sizeof(mirror_ls_t));
+#else
+    char path[256];
+    struct stat st;
+
+    if (strlen(name) + 2 > sizeof path)
+        return false;
+
+    sprintf(path, "%s%s", name[0] == '/' ? "" : "/", name);
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(mirror_ls_t))
+    {
+        void *p = mmap(NULL, sizeof(mirror_ls_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            mirror = (const mirror_ls_t *)p;
+    }
+
+    close(fd);
+#endif
+
+    if (mirror == NULL ||
+        mirror->magic != MIRROR_MAGIC ||
+        mirror->version != MIRROR_VERSION ||
+        mirror->size != LS_SIZE)
+    {
+        mirror_close();
+        return false;
+    }
+
+    return true;
+
+/*
+	// emulator side: ctx->ls points into the segment, so there is nothing
+	// to copy. The generation updates go where the SPU resumes and stops,
+	// and after M and X packets.
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ftruncate(fd, sizeof(mirror_ls_t));
+	mirror = (mirror_ls_t *)mmap(NULL, sizeof(mirror_ls_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	mirror->version = MIRROR_VERSION;
+	mirror->size = LS_SIZE;
+	mirror->magic = MIRROR_MAGIC;
+	ctx->ls = mirror->ls;
+
+	mirror->generation.fetch_add(1);	// resume: odd
+	mirror->generation.fetch_add(1);	// stop: even
+	mirror->generation.fetch_add(2);	// written while stopped
+*/
+}
+
+void mirror_close(void)
+{
+#ifdef _WIN32
+    if (mirror != NULL)
+        UnmapViewOfFile(mirror);
+    if (mirror_mapping != NULL)
+        CloseHandle(mirror_mapping);
+    mirror_mapping = NULL;
+#else
+    if (mirror != NULL)
+        munmap((void *)mirror, sizeof(mirror_ls_t));
+#endif
+    mirror = NULL;
+}
+
+bool mirror_active(void)
+{
+    return mirror != NULL;
+}
+
+bool mirror_read(u32 addr, u8 *buffer, u32 size)
+{
+    if (mirror == NULL || addr >= LS_SIZE || size > LS_SIZE - addr)
+        return false;
+
+    u32 generation = mirror->generation.load(std::memory_order_acquire);
+    if (generation & 1)
+        return false;
+
+    memcpy(buffer, mirror->ls + addr, size);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mirror->generation.load(std::memory_order_relaxed) == generation;
+}
+
+u32 mirror_generation(void)
+{
+    return mirror != NULL ? mirror->generation.load(std::memory_order_acquire) : 1;
+}
@@ -0,0 +1,53 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef MIRROR_H__
+#define MIRROR_H__
+
+#include <atomic>
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Local store mirror
+//
+//      An emulator started with its mirror option keeps the SPU local store
+//      in a named shared memory segment (a POSIX shm object, or a file
+//      mapping on Windows) and answers "qSPULsMirror" with the hex encoded
+//      name. The debugger maps it read-only and serves memory reads from it
+//      instead of "m" packets. Writes still go through the stub.
+//
+//      generation is a sequence count: the emulator makes it odd before the
+//      SPU resumes and even again once it stopped, and adds 2 after every
+//      write it makes while stopped (M/X packets, DMA from the PPU side...).
+//      A copy is only good if generation was even before it and unchanged
+//      after it.
+//
+
+#define MIRROR_MAGIC            0x534c5053      // 'SPLS'
+#define MIRROR_VERSION          1
+#define MIRROR_HEADER_SIZE      4096            // keeps ls page aligned
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 size;                   // LS_SIZE
+    std::atomic<u32> generation;
+    u8 pad[MIRROR_HEADER_SIZE - 16];
+    u8 ls[LS_SIZE];
+} mirror_ls_t;
+
+// one mirror per gdb connection, see gdb_select
+void mirror_select(u32 connection);
+
+bool mirror_open(const char *name);
+void mirror_close(void);
+bool mirror_active(void);
+// copies size bytes at addr. false if there is no mirror, the range is
+// outside LS, or the SPU was running or the emulator wrote to LS meanwhile
+bool mirror_read(u32 addr, u8 *buffer, u32 size);
+// current generation, or 1 (running) without a mirror
+u32 mirror_generation(void);
+
+#endif
@@ -0,0 +1,151 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "prefetch.h"
+#include "gdb.h"
+#include "mirror.h"
+
+#include <string.h>
+#include <chrono>
+
+// smaller values in argument registers are taken for counts and flags
+#define PREFETCH_MIN_POINTER    0x100
+
+typedef std::chrono::high_resolution_clock prefetch_clock;
+
+typedef struct
+{
+    u32 enable;
+    u32 code_before;
+    u32 code_after;
+    u32 stack_below;
+    u32 stack_above;
+    u32 args;
+    u32 arg_window;
+} prefetch_config_t;
+
+static prefetch_config_t config = {1, 256, 1024, 128, 2048, 0xff, 256};
+
+static const struct
+{
+    const char *name;
+    u32 prefetch_config_t::*field;
+} settings[] =
+{
+    {"enable",      &prefetch_config_t::enable},
+    {"code_before", &prefetch_config_t::code_before},
+    {"code_after",  &prefetch_config_t::code_after},
+    {"stack_below", &prefetch_config_t::stack_below},
+    {"stack_above", &prefetch_config_t::stack_above},
+    {"args",        &prefetch_config_t::args},
+    {"arg_window",  &prefetch_config_t::arg_window},
+};
+
+static u32 stops;
+static u32 pages_asked;
+static double seconds;
+
+// private helpers
+static void prefetch_mark(u32 pages[LS_PAGES / 32], u32 addr, u32 before, u32 after)
+{
+    addr &= LSLR;
+
+    u32 start = addr > before ? addr - before : 0;
+    u32 end = LS_SIZE - addr > after ? addr + after : LS_SIZE;
+
+    for (u32 a = start & ~(LS_PAGE_SIZE - 1); a < end; a += LS_PAGE_SIZE)
+        pages[a / LS_PAGE_SIZE / 32] |= 1u << (a / LS_PAGE_SIZE % 32);
+}
+
+// exported functions
+void prefetch_stop(u32 pc)
+{
+    static u32 reg[GDB_REG_COUNT][4];
+    u32 pages[LS_PAGES / 32];
+
+    // reads are a memcpy away already
+    if (!config.enable || mirror_active())
+        return;
+
+    prefetch_clock::time_point start = prefetch_clock::now();
+
+    memset(pages, 0, sizeof pages);
+
+    prefetch_mark(pages, pc, config.code_before, config.code_after);
+
+    // the register window reads r0-r2 next, so they come along in the
+    // same request and that read is served from the register cache
+    bool args = (config.args & 0xff) != 0 && config.arg_window != 0;
+
+    gdb_read_register_range(0, args ? 11 : 3, reg);
+    prefetch_mark(pages, reg[1][0], config.stack_below, config.stack_above);
+
+    if (args)
+    {
+        for (u32 i = 0; i < 8; i++)
+        {
+            u32 value = reg[3 + i][0];
+
+            if ((config.args & (1 << i)) && value >= PREFETCH_MIN_POINTER && value < LS_SIZE && (value & 3) == 0)
+                prefetch_mark(pages, value, 0, config.arg_window);
+        }
+    }
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (pages[i / 32] & (1u << (i % 32)))
+            pages_asked++;
+    }
+
+    gdb_prefetch(pages);
+
+    stops++;
+    seconds += std::chrono::duration<double>(prefetch_clock::now() - start).count();
+}
+
+bool prefetch_set(const char *name, u32 value, u32 *old)
+{
+    for (u32 i = 0; i < sizeof settings / sizeof settings[0]; i++)
+    {
+        if (strcmp(settings[i].name, name) == 0)
+        {
+            if (old != NULL)
+                *old = config.*settings[i].field;
+            config.*settings[i].field = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char *prefetch_setting(u32 index, u32 *value)
+{
+    if (index >= sizeof settings / sizeof settings[0])
+        return NULL;
+
+    *value = config.*settings[index].field;
+    return settings[index].name;
+}
+
+void prefetch_stats(prefetch_stats_t *stats)
+{
+    gdb_prefetch_stats_t gdb_stats;
+
+    gdb_prefetch_stats(&gdb_stats);
+
+    stats->stops = stops;
+    stats->pages = pages_asked;
+    stats->fetched = gdb_stats.fetched;
+    stats->used = gdb_stats.used;
+    stats->wasted = gdb_stats.wasted;
+    stats->seconds = seconds;
+}
+
+void prefetch_reset(void)
+{
+    stops = 0;
+    pages_asked = 0;
+    seconds = 0;
+    gdb_prefetch_reset();
+}
@@ -0,0 +1,52 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef PREFETCH_H__
+#define PREFETCH_H__
+
+#include "types.h"
+
+//
+//      Stop-time prefetch
+//
+//      When the target stops, the pages IDA is about to read are fetched
+//      in one pipelined batch: code around the PC, the stack from r1 up,
+//      and a window at each of r3-r10 whose preferred word looks like an
+//      LS pointer (word aligned, past the first 256 bytes, inside LS).
+//      r0-r10 are read in one request, which also covers the r0-r2 the
+//      register window reads next. gdb.cpp counts how many of the
+//      prefetched pages were read before the target ran again.
+//
+//      Settings, by the names prefetch_set takes:
+//
+//        enable          0 turns prefetching off
+//        code_before     bytes before the PC
+//        code_after      bytes from the PC on
+//        stack_below     bytes below r1
+//        stack_above     bytes from r1 on
+//        args            bit n follows r(3 + n)
+//        arg_window      bytes from each followed pointer
+//
+
+typedef struct
+{
+    u32 stops;
+    u32 pages;                  // pages asked for, cached or not
+    u32 fetched;
+    u32 used;
+    u32 wasted;
+    double seconds;             // spent prefetching
+} prefetch_stats_t;
+
+// call when the target stopped at pc
+void prefetch_stop(u32 pc);
+
+// false for an unknown name. old gets the previous value if not NULL
+bool prefetch_set(const char *name, u32 value, u32 *old);
+// NULL past the last setting
+const char *prefetch_setting(u32 index, u32 *value);
+
+void prefetch_stats(prefetch_stats_t *stats);
+void prefetch_reset(void);
+
+#endif
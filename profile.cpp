@@ -0,0 +1,241 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "profile.h"
+#include "gdb.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// a stop reply has to arrive within this time or the sample is skipped
+#define PROFILE_TIMEOUT_MS  100
+
+typedef std::chrono::high_resolution_clock profile_clock;
+
+// keys are (caller << 32) | pc | PROFILE_KEY_USED; 0 marks a free slot
+#define PROFILE_KEY_USED    0x80000000ull
+
+static std::atomic<u64> slot_keys[PROFILE_SLOTS];
+static std::atomic<u32> slot_counts[PROFILE_SLOTS];
+
+static std::thread sampler;
+static std::atomic<bool> running(false);
+static std::atomic<bool> stopping(false);
+
+static std::atomic<u32> samples(0);
+static std::atomic<u32> timeouts(0);
+static std::atomic<u32> dropped(0);
+static std::atomic<u64> sampled_ns(0);
+static std::atomic<u64> stopped_ns(0);
+static u32 sample_rate;
+static bool sample_callers;
+
+static bool stop_pending;
+static u32 stop_signal;
+static u32 stop_pc;
+
+// private helpers
+static u32 slot_hash(u64 key)
+{
+    key *= 0x9E3779B97F4A7C15ull;
+    return (u32)(key >> 40) & (PROFILE_SLOTS - 1);
+}
+
+static void profile_add(u32 pc, u32 caller)
+{
+    u64 key = ((u64)caller << 32) | pc | PROFILE_KEY_USED;
+    u32 slot = slot_hash(key);
+
+    for (u32 i = 0; i < PROFILE_SLOTS; i++, slot = (slot + 1) & (PROFILE_SLOTS - 1))
+    {
+        u64 cur = slot_keys[slot].load(std::memory_order_acquire);
+
+        if (cur == 0)
+        {
+            // claim the slot; if another writer won, it may have used our key
+            u64 expected = 0;
+            if (slot_keys[slot].compare_exchange_strong(expected, key, std::memory_order_acq_rel))
+                cur = key;
+            else
+                cur = expected;
+        }
+
+        if (cur == key)
+        {
+            slot_counts[slot].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    dropped++;
+}
+
+static u64 elapsed_ns(profile_clock::time_point from, profile_clock::time_point to)
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+static void profile_thread(void)
+{
+    profile_clock::time_point start = profile_clock::now();
+    profile_clock::duration period = std::chrono::nanoseconds(1000000000ull / sample_rate);
+    profile_clock::time_point next = start;
+
+    while (!stopping)
+    {
+        next += period;
+
+        profile_clock::time_point now = profile_clock::now();
+        if (next > now)
+            std::this_thread::sleep_until(next);
+        else
+            next = now;     // fell behind, don't try to catch up in a burst
+
+        profile_clock::time_point t0 = profile_clock::now();
+
+        u32 sig, pc;
+        if (!gdb_interrupt(PROFILE_TIMEOUT_MS, &sig, &pc))
+        {
+            timeouts++;
+            continue;
+        }
+
+        // a stop reply that did not carry the PC
+        if (pc == ~0u)
+        {
+            u32 reg[4] = {~0u};
+            gdb_read_register(GDB_REG_PC, reg);
+            pc = reg[0];
+        }
+
+        if (sig != SIGINT)
+        {
+            // the target stopped on its own while we were interrupting it
+            stop_signal = sig;
+            stop_pc = pc;
+            stop_pending = true;
+            break;
+        }
+
+        // no PC, no sample
+        if (pc == ~0u)
+        {
+            gdb_continue();
+            dropped++;
+            continue;
+        }
+
+        u32 caller = 0;
+        if (sample_callers)
+        {
+            u32 reg[4];
+            gdb_read_register(0, reg);
+            caller = reg[0] & LSLR;
+        }
+
+        gdb_continue();
+
+        profile_clock::time_point t1 = profile_clock::now();
+        stopped_ns += elapsed_ns(t0, t1);
+        sampled_ns = elapsed_ns(start, t1);
+        samples++;
+
+        profile_add(pc & LSLR, caller);
+    }
+
+    sampled_ns = elapsed_ns(start, profile_clock::now());
+    running = false;
+}
+
+// exported functions
+bool profile_start(u32 rate, bool callers)
+{
+    if (running || rate == 0)
+        return false;
+
+    if (sampler.joinable())
+        sampler.join();
+
+    for (u32 i = 0; i < PROFILE_SLOTS; i++)
+    {
+        slot_keys[i] = 0;
+        slot_counts[i] = 0;
+    }
+
+    samples = 0;
+    timeouts = 0;
+    dropped = 0;
+    sampled_ns = 0;
+    stopped_ns = 0;
+    sample_rate = rate;
+    sample_callers = callers;
+    stop_pending = false;
+
+    stopping = false;
+    running = true;
+    sampler = std::thread(profile_thread);
+
+    return true;
+}
+
+void profile_stop(void)
+{
+    stopping = true;
+
+    if (sampler.joinable())
+        sampler.join();
+}
+
+bool profile_running(void)
+{
+    return running;
+}
+
+bool profile_take_stop(u32 *signal, u32 *pc)
+{
+    if (running)
+        return false;
+
+    if (sampler.joinable())
+        sampler.join();
+
+    if (!stop_pending)
+        return false;
+
+    stop_pending = false;
+    *signal = stop_signal;
+    *pc = stop_pc;
+    return true;
+}
+
+void profile_stats(profile_stats_t *stats)
+{
+    stats->rate = sample_rate;
+    stats->samples = samples;
+    stats->timeouts = timeouts;
+    stats->dropped = dropped;
+    stats->seconds = sampled_ns / 1e9;
+    stats->stopped = stopped_ns / 1e9;
+}
+
+void profile_samples(std::vector<profile_sample_t> *out)
+{
+    out->clear();
+
+    for (u32 i = 0; i < PROFILE_SLOTS; i++)
+    {
+        u64 key = slot_keys[i].load(std::memory_order_acquire);
+        u32 count = slot_counts[i].load(std::memory_order_relaxed);
+
+        // a slot can be claimed before its first count lands
+        if (key == 0 || count == 0)
+            continue;
+
+        profile_sample_t s;
+        s.pc = (u32)key & ~(u32)PROFILE_KEY_USED;
+        s.caller = (u32)(key >> 32);
+        s.count = count;
+        out->push_back(s);
+    }
+}
@@ -0,0 +1,54 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef PROFILE_H__
+#define PROFILE_H__
+
+#include <vector>
+#include "types.h"
+
+//
+//      Sampling PC profiler
+//
+//      A sampler thread interrupts the running target at a fixed rate, takes
+//      the PC from the stop reply (and optionally r0, the return address of
+//      leaf functions), and resumes it straight away. Samples go into a
+//      fixed size open addressing table keyed by (pc, caller) that is only
+//      updated with atomic operations, so it can be read while sampling.
+//
+//      The sampler owns the gdb connection while it runs: the debugger
+//      callbacks and IDC functions that talk to the target refuse to while
+//      profile_running(). A stop that was not caused by the sampler
+//      (breakpoint, exit) ends the run and is handed back through
+//      profile_take_stop().
+//
+
+#define PROFILE_SLOTS   65536
+
+typedef struct
+{
+    u32 pc;
+    u32 caller;                 // r0 at the sample, 0 when not read
+    u32 count;
+} profile_sample_t;
+
+typedef struct
+{
+    u32 rate;                   // requested samples per second
+    u32 samples;
+    u32 timeouts;               // interrupts the target did not answer in time
+    u32 dropped;                // samples lost to a full table, or without a PC
+    double seconds;             // wall time sampled
+    double stopped;             // time the target spent interrupted
+} profile_stats_t;
+
+bool profile_start(u32 rate, bool callers);
+void profile_stop(void);
+bool profile_running(void);
+// a stop that ended the run, if any
+bool profile_take_stop(u32 *signal, u32 *pc);
+
+void profile_stats(profile_stats_t *stats);
+void profile_samples(std::vector<profile_sample_t> *out);
+
+#endif
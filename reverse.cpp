@@ -0,0 +1,581 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "reverse.h"
+#include "checkpoint.h"
+#include "mirror.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock reverse_clock;
+
+typedef struct
+{
+    u8 data[LS_PAGE_SIZE];
+    u32 crc;                    // gdb_crc32, as qCRC reports it
+    u32 refs;                   // checkpoints sharing it
+} reverse_page_t;
+
+typedef struct
+{
+    u64 position;
+    u32 reg[GDB_REG_COUNT][4];
+    u32 page[LS_PAGES];         // arena indices
+} reverse_checkpoint_t;
+
+static std::vector<reverse_page_t> arena;
+static std::vector<u32> arena_free;
+static std::deque<reverse_checkpoint_t> checkpoints;
+
+static bool recording = false;
+static std::atomic<bool> busy(false);
+static u32 interval;
+static u64 budget;
+
+// position = qSPUICount - offset. A restore moves the position, not the count
+static u64 offset;
+// where the running "i,count" ends, 0 if none is
+static u64 boundary;
+
+static reverse_stats_t totals;
+
+// private helpers
+static bool reverse_position(u64 *position)
+{
+    u64 count;
+
+    if (!gdb_icount(&count))
+        return false;
+
+    *position = count - offset;
+    return true;
+}
+
+static u64 reverse_bytes(void)
+{
+    return (u64)(arena.size() - arena_free.size()) * sizeof(reverse_page_t) +
+           (u64)checkpoints.size() * sizeof(reverse_checkpoint_t);
+}
+
+static void reverse_release(const reverse_checkpoint_t *cp)
+{
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (--arena[cp->page[i]].refs == 0)
+            arena_free.push_back(cp->page[i]);
+    }
+}
+
+// drops the oldest checkpoint, never the last one
+static bool reverse_evict(void)
+{
+    if (checkpoints.size() <= 1)
+        return false;
+
+    reverse_release(&checkpoints.front());
+    checkpoints.pop_front();
+    totals.evicted++;
+    return true;
+}
+
+// an arena page, evicting checkpoints to stay within the budget. ~0 if
+// even that is not enough
+static u32 reverse_alloc(void)
+{
+    for (;;)
+    {
+        if (!arena_free.empty())
+        {
+            u32 index = arena_free.back();
+            arena_free.pop_back();
+            return index;
+        }
+
+        if (arena.size() < arena.capacity() && reverse_bytes() + sizeof(reverse_page_t) <= budget)
+        {
+            arena.resize(arena.size() + 1);
+            return (u32)arena.size() - 1;
+        }
+
+        if (!reverse_evict())
+            return ~0u;
+    }
+}
+
+static bool reverse_checkpoint(u64 position)
+{
+    static u8 current[LS_SIZE];
+    static reverse_checkpoint_t cp;
+    gdb_mem_range_t reads[LS_PAGES];
+    u32 numbers[LS_PAGES];
+    u32 crc[LS_PAGES];
+    u32 fresh[LS_PAGES];
+    u32 count = 0;
+
+    while (reverse_bytes() + sizeof(reverse_checkpoint_t) > budget && reverse_evict())
+        ;
+
+    cp.position = position;
+    if (!gdb_read_registers(cp.reg))
+        return false;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+        numbers[i] = i;
+
+    // the CRCs say which pages changed; without qCRC all of LS is read
+    bool remote = !mirror_active() && gdb_crc_pages(numbers, LS_PAGES, crc);
+    if (!remote)
+    {
+        if (gdb_read_mem(0, current, LS_SIZE) != LS_SIZE)
+            return false;
+
+        for (u32 i = 0; i < LS_PAGES; i++)
+            crc[i] = gdb_crc32(0xffffffff, current + i * LS_PAGE_SIZE, LS_PAGE_SIZE);
+    }
+
+    const reverse_checkpoint_t *prev = checkpoints.empty() ? NULL : &checkpoints.back();
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        if (prev != NULL && arena[prev->page[i]].crc == crc[i])
+        {
+            cp.page[i] = prev->page[i];
+            arena[cp.page[i]].refs++;
+            continue;
+        }
+
+        u32 index = reverse_alloc();
+        if (index == ~0u)
+        {
+            // give back what this checkpoint took so far
+            for (u32 j = 0; j < i; j++)
+            {
+                if (--arena[cp.page[j]].refs == 0)
+                    arena_free.push_back(cp.page[j]);
+            }
+            return false;
+        }
+
+        cp.page[i] = index;
+        arena[index].crc = crc[i];
+        arena[index].refs = 1;
+        fresh[count++] = i;
+    }
+
+    // the arena does not move any more, so the pages can be filled in
+    for (u32 j = 0; j < count; j++)
+    {
+        u32 i = fresh[j];
+
+        if (remote)
+        {
+            reads[j].addr = i * LS_PAGE_SIZE;
+            reads[j].size = LS_PAGE_SIZE;
+            reads[j].buffer = arena[cp.page[i]].data;
+        }
+        else
+            memcpy(arena[cp.page[i]].data, current + i * LS_PAGE_SIZE, LS_PAGE_SIZE);
+    }
+
+    if (remote && gdb_read_mem_ranges(reads, count) != count)
+    {
+        reverse_release(&cp);
+        return false;
+    }
+
+    checkpoints.push_back(cp);
+    return true;
+}
+
+static bool reverse_restore(const reverse_checkpoint_t *cp)
+{
+    const u8 *pages[LS_PAGES];
+    u32 crc[LS_PAGES];
+    checkpoint_stats_t stats;
+    u64 count;
+
+    for (u32 i = 0; i < LS_PAGES; i++)
+    {
+        pages[i] = arena[cp->page[i]].data;
+        crc[i] = arena[cp->page[i]].crc;
+    }
+
+    if (!checkpoint_apply(pages, crc, cp->reg, &stats) || !gdb_icount(&count))
+        return false;
+
+    totals.restored += stats.sent;
+    offset = count - cp->position;
+    return true;
+}
+
+// runs at most count instructions; a breakpoint stops it early
+static bool reverse_run(u32 count, u64 *position)
+{
+    u32 signal, pc;
+
+    gdb_continue_count(count);
+    if (!gdb_wait_stop(REVERSE_TIMEOUT_MS, &signal, &pc) || signal != SIGTRAP)
+        return false;
+
+    return reverse_position(position);
+}
+
+// the last checkpoint at or before position (before it, if strictly)
+static int reverse_find(u64 position, bool strictly)
+{
+    for (int i = (int)checkpoints.size() - 1; i >= 0; i--)
+    {
+        if (checkpoints[i].position < position || (!strictly && checkpoints[i].position == position))
+            return i;
+    }
+    return -1;
+}
+
+// replays from position up to target, through any breakpoints
+static bool reverse_forward(u64 position, u64 target)
+{
+    u64 start = position;
+
+    while (position < target)
+    {
+        u64 from = position;
+
+        if (!reverse_run((u32)(target - position), &position) || position <= from)
+            return false;
+    }
+
+    totals.replayed += target - start;
+    return position == target;
+}
+
+// restores checkpoint k and replays up to target
+static bool reverse_goto(int k, u64 target)
+{
+    return reverse_restore(&checkpoints[k]) && reverse_forward(checkpoints[k].position, target);
+}
+
+// whether LS holds value at addr in checkpoint cp
+static bool reverse_holds(const reverse_checkpoint_t *cp, u32 addr, const u8 *value, u32 size)
+{
+    for (u32 i = 0; i < size; i++)
+    {
+        u32 a = addr + i;
+
+        if (arena[cp->page[a / LS_PAGE_SIZE]].data[a % LS_PAGE_SIZE] != value[i])
+            return false;
+    }
+    return true;
+}
+
+// the same on the target
+static bool reverse_target_holds(u32 addr, const u8 *value, u32 size)
+{
+    u8 current[GDB_SEARCH_MAX];
+
+    return gdb_read_mem(addr, current, size) == size && memcmp(current, value, size) == 0;
+}
+
+static u32 reverse_pc(void)
+{
+    u32 reg[4];
+
+    gdb_read_register(GDB_REG_PC, reg);
+    return reg[0];
+}
+
+static void reverse_resume_at(u64 position)
+{
+    // running forward from an earlier point makes the later history void
+    while (checkpoints.size() > 1 && checkpoints.back().position > position)
+    {
+        reverse_release(&checkpoints.back());
+        checkpoints.pop_back();
+    }
+
+    u64 next = checkpoints.back().position + interval;
+    if (next <= position)
+    {
+        reverse_checkpoint(position);
+        next = position + interval;
+    }
+
+    boundary = next;
+    gdb_continue_count((u32)(next - position));
+}
+
+static void reverse_done(reverse_clock::time_point start)
+{
+    double seconds = std::chrono::duration<double>(reverse_clock::now() - start).count();
+
+    totals.reversals++;
+    totals.last = seconds;
+    totals.total += seconds;
+    if (seconds > totals.worst)
+        totals.worst = seconds;
+    busy = false;
+}
+
+// exported functions
+bool reverse_start(u32 count, u32 bytes)
+{
+    u64 position;
+
+    reverse_stop();
+
+    interval = count != 0 ? count : REVERSE_INTERVAL;
+    budget = bytes != 0 ? bytes : REVERSE_BUDGET;
+
+    offset = 0;
+    if (!reverse_position(&position))
+        return false;
+
+    // indices would survive a move, the read buffers would not
+    arena.reserve((size_t)(budget / sizeof(reverse_page_t)));
+
+    if (!reverse_checkpoint(position))
+    {
+        reverse_stop();
+        return false;
+    }
+
+    recording = true;
+    return true;
+}
+
+void reverse_stop(void)
+{
+    recording = false;
+    boundary = 0;
+    checkpoints.clear();
+    arena_free.clear();
+    std::vector<reverse_page_t>().swap(arena);
+}
+
+bool reverse_recording(void)
+{
+    return recording;
+}
+
+bool reverse_busy(void)
+{
+    return busy;
+}
+
+void reverse_resume(void)
+{
+    u64 position;
+
+    if (!recording || !reverse_position(&position))
+    {
+        gdb_continue();
+        return;
+    }
+
+    reverse_resume_at(position);
+}
+
+bool reverse_stopped(bool breakpoint)
+{
+    u64 position;
+    u64 end = boundary;
+
+    boundary = 0;
+    if (!recording || end == 0 || breakpoint)
+        return false;
+
+    if (!reverse_position(&position) || position != end)
+        return false;
+
+    if (!reverse_checkpoint(position))
+    {
+        // out of budget with a single checkpoint, or LS unreadable
+        reverse_stop();
+        gdb_continue();
+        return true;
+    }
+
+    reverse_resume_at(position);
+    return true;
+}
+
+bool reverse_step(u32 count, u32 *pc)
+{
+    reverse_clock::time_point start = reverse_clock::now();
+    u64 position;
+
+    *pc = ~0u;
+    if (!recording || !reverse_position(&position))
+        return false;
+
+    busy = true;
+
+    u64 first = checkpoints.front().position;
+    u64 target = position - first >= count ? position - count : first;
+
+    int k = reverse_find(target, false);
+    bool ok = k >= 0 && reverse_goto(k, target) && target + count == position;
+
+    *pc = reverse_pc();
+    reverse_done(start);
+    return ok;
+}
+
+bool reverse_continue(reverse_bp_check *is_bp, u32 *pc)
+{
+    reverse_clock::time_point start = reverse_clock::now();
+    u64 position, end;
+
+    *pc = ~0u;
+    if (!recording || !reverse_position(&position))
+        return false;
+
+    busy = true;
+
+    // newest interval first; end is where the interval stops
+    end = position;
+    for (int k = reverse_find(position, true); k >= 0; k--)
+    {
+        u64 at = checkpoints[k].position;
+        u64 hit = ~0ull;
+
+        if (!reverse_restore(&checkpoints[k]))
+            break;
+
+        if (is_bp(checkpoints[k].reg[GDB_REG_PC][0]))
+            hit = at;
+
+        while (at < end)
+        {
+            u64 from = at;
+
+            if (!reverse_run((u32)(end - at), &at) || at <= from)
+            {
+                *pc = reverse_pc();
+                reverse_done(start);
+                return false;
+            }
+
+            if (at < end)
+                hit = at;
+        }
+
+        totals.replayed += end - checkpoints[k].position;
+
+        if (hit != ~0ull)
+        {
+            bool ok = reverse_goto(k, hit);
+
+            *pc = reverse_pc();
+            reverse_done(start);
+            return ok;
+        }
+
+        end = checkpoints[k].position;
+    }
+
+    // nothing before: stop at the start of the history
+    if (!checkpoints.empty())
+        reverse_restore(&checkpoints.front());
+
+    *pc = reverse_pc();
+    reverse_done(start);
+    return false;
+}
+
+reverse_write_result reverse_who_wrote(u32 addr, const u8 *value, u32 size, reverse_write_t *result)
+{
+    reverse_clock::time_point start = reverse_clock::now();
+    u64 now;
+
+    memset(result, 0, sizeof *result);
+    result->pc = ~0u;
+
+    if (size == 0 || size > GDB_SEARCH_MAX || addr >= LS_SIZE || size > LS_SIZE - addr)
+        return REVERSE_WRITE_FAILED;
+    if (!recording || !reverse_position(&now))
+        return REVERSE_WRITE_FAILED;
+    if (!reverse_target_holds(addr, value, size))
+        return REVERSE_WRITE_NOT_THERE;
+
+    busy = true;
+
+    // the checkpoints are in memory: the first one holding the value ends
+    // the interval, without a replay. Only those up to now count; after a
+    // reverse step the later ones are kept until the target resumes.
+    int last = reverse_find(now, false);
+    int k = 0;
+    while (k <= last && !reverse_holds(&checkpoints[k], addr, value, size))
+        k++;
+
+    if (k == 0)
+    {
+        reverse_done(start);
+        return REVERSE_WRITE_BEFORE_HISTORY;
+    }
+
+    // the value is not there at lo and is at hi
+    int base = k - 1;
+    u64 lo = checkpoints[base].position;
+    u64 hi = k <= last ? checkpoints[k].position : now;
+    u64 here = now;
+    bool ok = true;
+
+    if (lo >= hi)
+    {
+        reverse_done(start);
+        return REVERSE_WRITE_FAILED;
+    }
+
+    while (ok && hi - lo > 1)
+    {
+        u64 mid = lo + (hi - lo) / 2;
+
+        // forward from here when that is on the way, else from the checkpoint
+        if (here >= lo && here <= mid)
+            ok = reverse_forward(here, mid);
+        else
+            ok = reverse_goto(base, mid);
+        result->replays++;
+        here = mid;
+
+        if (ok && reverse_target_holds(addr, value, size))
+            hi = mid;
+        else
+            lo = mid;
+    }
+
+    // stop right before the write; here is lo or hi by now
+    if (ok && here != lo)
+    {
+        ok = reverse_goto(base, lo);
+        result->replays++;
+    }
+
+    result->position = lo;
+    result->pc = reverse_pc();
+    reverse_done(start);
+    result->seconds = totals.last;
+
+    return ok ? REVERSE_WRITE_FOUND : REVERSE_WRITE_FAILED;
+}
+
+void reverse_stats(reverse_stats_t *stats)
+{
+    *stats = totals;
+    stats->checkpoints = (u32)checkpoints.size();
+    stats->pages = (u32)(arena.size() - arena_free.size());
+    stats->bytes = reverse_bytes();
+    stats->budget = budget;
+    stats->first = checkpoints.empty() ? 0 : checkpoints.front().position;
+    if (!recording || busy || !reverse_position(&stats->position))
+        stats->position = 0;
+}
+
+void reverse_reset_stats(void)
+{
+    memset(&totals, 0, sizeof totals);
+}
@@ -0,0 +1,111 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef REVERSE_H__
+#define REVERSE_H__
+
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Reverse execution
+//
+//      While recording, the target never runs freely: it is resumed with
+//      "i,count" so it stops every interval instructions (qSPUICount tells
+//      a count stop from a breakpoint). Each of those stops takes a
+//      checkpoint of the registers and LS and resumes at once. Pages are
+//      copy on write: a checkpoint shares every page whose qCRC did not
+//      change with the one before it, and only changed pages are fetched
+//      (in one burst) into the page arena.
+//
+//      The arena and the checkpoints stay within the budget; the oldest
+//      checkpoint goes when they would not, and with it the start of the
+//      history moves forward.
+//
+//      Reverse step (bs) restores the nearest checkpoint before the wanted
+//      instruction and replays up to it with "i,count". Reverse continue
+//      (bc) replays the checkpoint intervals before the current position,
+//      newest first, and stops at the last breakpoint hit in the first
+//      interval that has one, or at the start of the history.
+//
+//      "Who wrote" looks for the checkpoint where a value first appears in
+//      LS and bisects the interval before it, one replay per halving.
+//
+//      Only registers and LS are checkpointed. Replay is exact as long as
+//      the code does not read channels, DMA or the decrementer in between.
+//      Resuming forward from an earlier position drops the checkpoints
+//      after it.
+//
+
+#define REVERSE_INTERVAL        100000          // default instructions between checkpoints
+#define REVERSE_BUDGET          (32 << 20)      // default bytes
+#define REVERSE_TIMEOUT_MS      10000           // for a replay to stop
+
+typedef struct
+{
+    u32 checkpoints;
+    u32 pages;                  // arena pages in use
+    u64 bytes;                  // pages and checkpoints
+    u64 budget;
+    u64 first;                  // instruction number the history starts at
+    u64 position;               // current instruction number
+    u32 evicted;                // checkpoints dropped for the budget
+    u32 reversals;              // reverse steps and continues
+    u64 replayed;               // instructions run again for them
+    u32 restored;               // pages sent for them
+    double last;                // seconds the last reversal took
+    double total;
+    double worst;
+} reverse_stats_t;
+
+typedef bool reverse_bp_check(u32 pc);
+
+typedef enum
+{
+    REVERSE_WRITE_FOUND = 0,
+    REVERSE_WRITE_NOT_THERE,        // LS does not hold the value now
+    REVERSE_WRITE_BEFORE_HISTORY,   // it already did at the first checkpoint
+    REVERSE_WRITE_FAILED            // not recording, or a replay failed
+} reverse_write_result;
+
+typedef struct
+{
+    u64 position;               // instruction number of the write
+    u32 pc;                     // its address; the target stands there
+    u32 replays;
+    double seconds;
+} reverse_write_t;
+
+// starts recording at the current stop. false without qSPUICount or if the
+// first checkpoint could not be taken
+bool reverse_start(u32 interval, u32 budget);
+void reverse_stop(void);
+bool reverse_recording(void);
+// true while a reversal drives the connection itself
+bool reverse_busy(void);
+
+// resumes the target up to the next checkpoint
+void reverse_resume(void);
+// call for every SIGTRAP stop while recording. true if it was a checkpoint
+// stop; the target has been resumed again then and nothing is to be reported
+bool reverse_stopped(bool breakpoint);
+
+// goes count instructions back. false if the history does not reach that
+// far (the target is then at its start) or a replay failed; pc is where the
+// target stands either way
+bool reverse_step(u32 count, u32 *pc);
+// goes back to the last instruction is_bp accepts, or the start of the
+// history (false then)
+bool reverse_continue(reverse_bp_check *is_bp, u32 *pc);
+
+// finds the instruction that wrote size bytes of value to addr, and leaves
+// the target right before it. The checkpoints that already hold the value
+// are found in memory; inside the interval before the first of them the
+// instruction is bisected by replay, which assumes the value stays once
+// written there.
+reverse_write_result reverse_who_wrote(u32 addr, const u8 *value, u32 size, reverse_write_t *result);
+
+void reverse_stats(reverse_stats_t *stats);
+void reverse_reset_stats(void);
+
+#endif
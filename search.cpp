@@ -0,0 +1,137 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "search.h"
+#include "mirror.h"
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SEARCH_SSE2
+#endif
+
+// private helpers
+static bool search_match(const u8 *data, const u8 *pattern, u32 len, u32 addr, u32 align)
+{
+    return addr % align == 0 && memcmp(data, pattern, len) == 0;
+}
+
+// exported functions
+u32 search_scan(const u8 *data, u32 size, const u8 *pattern, u32 len, u32 base, u32 align, u32 max,
+                std::vector<u32> *out)
+{
+    u32 found = 0;
+    u32 pos = 0;
+
+    if (len == 0 || len > size || align == 0)
+        return 0;
+
+#ifdef SEARCH_SSE2
+    __m128i first = _mm_set1_epi8((char)pattern[0]);
+    __m128i last = _mm_set1_epi8((char)pattern[len - 1]);
+
+    // both loads must stay inside data
+    for (; pos + 15 + len <= size; pos += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + pos));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + pos + len - 1));
+        u32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        for (u32 j = 0; mask != 0; j++, mask >>= 1)
+        {
+            if ((mask & 1) && search_match(data + pos + j, pattern, len, base + pos + j, align))
+            {
+                if (out->size() >= max)
+                    return found;
+                out->push_back(base + pos + j);
+                found++;
+            }
+        }
+    }
+#endif
+
+    for (; pos + len <= size; pos++)
+    {
+        const u8 *p = (const u8 *)memchr(data + pos, pattern[0], size - len + 1 - pos);
+        if (p == NULL)
+            break;
+
+        pos = (u32)(p - data);
+        if (p[len - 1] == pattern[len - 1] && search_match(p, pattern, len, base + pos, align))
+        {
+            if (out->size() >= max)
+                return found;
+            out->push_back(base + pos);
+            found++;
+        }
+    }
+
+    return found;
+}
+
+bool search_memory(u32 addr, u32 size, const u8 *pattern, u32 len, u32 align, u32 max,
+                   std::vector<u32> *out, search_source *source)
+{
+    static u8 data[LS_SIZE];
+    u32 start = addr;
+    u32 asked = 0;
+    u32 found;
+
+    *source = SEARCH_SOURCE_NONE;
+
+    if (len == 0 || align == 0 || addr >= LS_SIZE)
+        return true;
+
+    if (size > LS_SIZE - addr)
+        size = LS_SIZE - addr;
+
+    u32 end = addr + size;
+
+    // with a mirror the local scan is a memcpy away
+    while (!mirror_active() && asked < SEARCH_STUB_MATCHES && out->size() < max && start + len <= end)
+    {
+        int res = gdb_search_mem(start, end - start, pattern, len, &found);
+        if (res < 0)
+            break;
+
+        *source = SEARCH_SOURCE_STUB;
+        if (res == 0)
+            return true;
+
+        // scan the rest here rather than trust a match outside the range
+        if (found < start || found > end - len)
+            break;
+
+        if (found % align == 0)
+            out->push_back(found);
+        start = found + 1;
+        asked++;
+    }
+
+    if (out->size() >= max || start + len > end)
+        return true;
+
+    u32 rest = end - start;
+    if (gdb_read_mem(start, data, rest) != rest)
+        return false;
+
+    *source = *source == SEARCH_SOURCE_STUB ? SEARCH_SOURCE_BOTH : SEARCH_SOURCE_LOCAL;
+    search_scan(data, rest, pattern, len, start, align, max, out);
+    return true;
+}
+
+const char *search_source_name(search_source source)
+{
+    switch (source)
+    {
+    case SEARCH_SOURCE_STUB:
+        return "qSearch:memory";
+    case SEARCH_SOURCE_LOCAL:
+        return "local scan";
+    case SEARCH_SOURCE_BOTH:
+        return "qSearch:memory, then local scan";
+    default:
+        return "nothing";
+    }
+}
@@ -0,0 +1,47 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef SEARCH_H__
+#define SEARCH_H__
+
+#include <vector>
+#include "types.h"
+#include "gdb.h"
+
+//
+//      Local store search
+//
+//      A stub that answers qSearch:memory scans LS itself, so only the
+//      match addresses cross the connection. Each match costs a round trip
+//      though. After SEARCH_STUB_MATCHES of them, or with a stub that does
+//      not support the query, the rest of the range is read in one burst
+//      through gdb.cpp's page cache (or the mirror) and scanned here.
+//
+//      Both scans only compare in full where the first and the last byte
+//      of the pattern match, and test 16 positions at a time for that.
+//
+
+#define SEARCH_STUB_MATCHES     16
+
+typedef enum
+{
+    SEARCH_SOURCE_NONE = 0,     // nothing was searched
+    SEARCH_SOURCE_STUB,
+    SEARCH_SOURCE_LOCAL,
+    SEARCH_SOURCE_BOTH          // the stub, then locally
+} search_source;
+
+// appends the addresses of up to max matches of pattern (len bytes) in
+// [addr, addr + size) to out, only those that are multiples of align.
+// false if LS could not be read.
+bool search_memory(u32 addr, u32 size, const u8 *pattern, u32 len, u32 align, u32 max,
+                   std::vector<u32> *out, search_source *source);
+
+// the local scan over size bytes of data at LS address base. Appends
+// matches to out until it holds max; returns how many were appended.
+u32 search_scan(const u8 *data, u32 size, const u8 *pattern, u32 len, u32 base, u32 align, u32 max,
+                std::vector<u32> *out);
+
+const char *search_source_name(search_source source);
+
+#endif
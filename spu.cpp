@@ -0,0 +1,679 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "spu.h"
+#include "gdb.h"
+
+#include <string.h>
+
+static const char *spu_names[SPU_INSN_COUNT] =
+{
+    "ori",
+    "orhi",
+    "orbi",
+    "sfi",
+    "sfhi",
+    "andi",
+    "andhi",
+    "andbi",
+    "ai",
+    "ahi",
+    "stqd",
+    "lqd",
+    "xori",
+    "xorhi",
+    "xorbi",
+    "cgti",
+    "cgthi",
+    "cgtbi",
+    "hgti",
+    "clgti",
+    "clgthi",
+    "clgtbi",
+    "hlgti",
+    "mpyi",
+    "mpyui",
+    "ceqi",
+    "ceqhi",
+    "ceqbi",
+    "heqi",
+    "stop",
+    "lnop",
+    "sync",
+    "dsync",
+    "nop",
+    "mfspr",
+    "rdch",
+    "rchcnt",
+    "hgt",
+    "mpyu",
+    "cgt",
+    "or",
+    "bg",
+    "cgth",
+    "eqv",
+    "cgtb",
+    "fesd",
+    "sumb",
+    "frds",
+    "rot",
+    "rotm",
+    "rotma",
+    "shl",
+    "roth",
+    "rothm",
+    "rotmah",
+    "shlh",
+    "sfh",
+    "shlhi",
+    "a",
+    "andc",
+    "cg",
+    "mpy",
+    "clz",
+    "xswd",
+    "xshw",
+    "clgth",
+    "cntb",
+    "xsbh",
+    "nand",
+    "clgt",
+    "and",
+    "fcgt",
+    "dfcgt",
+    "fa",
+    "fs",
+    "fm",
+    "ah",
+    "orc",
+    "fcmgt",
+    "dfcmgt",
+    "dfa",
+    "dfs",
+    "dfm",
+    "clgtb",
+    "avgb",
+    "hlgt",
+    "fi",
+    "mtspr",
+    "wrch",
+    "heq",
+    "biz",
+    "binz",
+    "bihz",
+    "bihnz",
+    "stopd",
+    "sfx",
+    "cgx",
+    "bgx",
+    "stqx",
+    "mpyhha",
+    "mpyhhau",
+    "dfma",
+    "dfms",
+    "dfnms",
+    "dfnma",
+    "sf",
+    "xor",
+    "fscrrd",
+    "addx",
+    "bi",
+    "bisl",
+    "iret",
+    "bisled",
+    "hbr",
+    "gb",
+    "gbh",
+    "gbb",
+    "fsm",
+    "fsmh",
+    "fsmb",
+    "nor",
+    "frest",
+    "frsqest",
+    "fscrwr",
+    "ceq",
+    "fceq",
+    "dfceq",
+    "lqx",
+    "mpyh",
+    "mpyhh",
+    "mpys",
+    "ceqh",
+    "fcmeq",
+    "dfcmeq",
+    "rotqbybi",
+    "rotqmbybi",
+    "mpyhhu",
+    "shlqbybi",
+    "ceqb",
+    "cbx",
+    "chx",
+    "cwx",
+    "cdx",
+    "rotqbi",
+    "rotqmbi",
+    "shlqbi",
+    "rotqby",
+    "rotqmby",
+    "shlqby",
+    "orx",
+    "absdb",
+    "selb",
+    "shufb",
+    "mpya",
+    "fnms",
+    "fma",
+    "fms",
+    "brz",
+    "stqa",
+    "brnz",
+    "ilh",
+    "brhz",
+    "fsmbi",
+    "brhnz",
+    "stqr",
+    "il",
+    "bra",
+    "iohl",
+    "lqr",
+    "brasl",
+    "lqa",
+    "br",
+    "brsl",
+    "ilhu",
+    "rotqmbii",
+    "shlqbyi",
+    "rotqbyi",
+    "rotqmbyi",
+    "dftsv",
+    "rotqbii",
+    "cbd",
+    "chd",
+    "cwd",
+    "cdd",
+    "roti",
+    "rotmi",
+    "rotmai",
+    "shli",
+    "rothi",
+    "rothmi",
+    "rotmahi",
+    "shlqbii",
+    "hbra",
+    "ila",
+    "hbrr",
+    "cflts",
+    "cfltu",
+    "csflt",
+    "cuflt",
+    "lr"
+};
+
+typedef struct
+{
+    u16 opcode;                 // opcode left aligned to 11 bits
+    u8 width;                   // opcode bits
+    u8 format;
+    u16 itype;
+} spu_opcode_t;
+
+#define RR(op, i)       { op,        11, SPU_FMT_RR,   SPU_##i }
+#define RI7(op, i)      { op,        11, SPU_FMT_RI7,  SPU_##i }
+#define RI8(op, i)      { op << 1,   10, SPU_FMT_RI8,  SPU_##i }
+#define RI10(op, i)     { op << 3,    8, SPU_FMT_RI10, SPU_##i }
+#define RI16(op, i)     { op << 2,    9, SPU_FMT_RI16, SPU_##i }
+#define RI18(op, i)     { op << 4,    7, SPU_FMT_RI18, SPU_##i }
+#define RRR(op, i)      { op << 7,    4, SPU_FMT_RRR,  SPU_##i }
+
+static const spu_opcode_t spu_opcodes[] =
+{
+    RR(0x000, stop),     RR(0x001, lnop),     RR(0x002, sync),     RR(0x003, dsync),
+    RR(0x00c, mfspr),    RR(0x00d, rdch),     RR(0x00f, rchcnt),
+    RR(0x040, sf),       RR(0x041, or),       RR(0x042, bg),       RR(0x048, sfh),
+    RR(0x049, nor),      RR(0x053, absdb),
+    RR(0x058, rot),      RR(0x059, rotm),     RR(0x05a, rotma),    RR(0x05b, shl),
+    RR(0x05c, roth),     RR(0x05d, rothm),    RR(0x05e, rotmah),   RR(0x05f, shlh),
+    RI7(0x078, roti),    RI7(0x079, rotmi),   RI7(0x07a, rotmai),  RI7(0x07b, shli),
+    RI7(0x07c, rothi),   RI7(0x07d, rothmi),  RI7(0x07e, rotmahi), RI7(0x07f, shlhi),
+    RR(0x0c0, a),        RR(0x0c1, and),      RR(0x0c2, cg),       RR(0x0c8, ah),
+    RR(0x0c9, nand),     RR(0x0d3, avgb),
+    RR(0x10c, mtspr),    RR(0x10d, wrch),
+    RR(0x128, biz),      RR(0x129, binz),     RR(0x12a, bihz),     RR(0x12b, bihnz),
+    RR(0x140, stopd),    RR(0x144, stqx),
+    RR(0x1a8, bi),       RR(0x1a9, bisl),     RR(0x1aa, iret),     RR(0x1ab, bisled),
+    RR(0x1ac, hbr),
+    RR(0x1b0, gb),       RR(0x1b1, gbh),      RR(0x1b2, gbb),      RR(0x1b4, fsm),
+    RR(0x1b5, fsmh),     RR(0x1b6, fsmb),     RR(0x1b8, frest),    RR(0x1b9, frsqest),
+    RR(0x1c4, lqx),      RR(0x1cc, rotqbybi), RR(0x1cd, rotqmbybi),RR(0x1cf, shlqbybi),
+    RR(0x1d4, cbx),      RR(0x1d5, chx),      RR(0x1d6, cwx),      RR(0x1d7, cdx),
+    RR(0x1d8, rotqbi),   RR(0x1d9, rotqmbi),  RR(0x1db, shlqbi),   RR(0x1dc, rotqby),
+    RR(0x1dd, rotqmby),  RR(0x1df, shlqby),   RR(0x1f0, orx),
+    RI7(0x1f4, cbd),     RI7(0x1f5, chd),     RI7(0x1f6, cwd),     RI7(0x1f7, cdd),
+    RI7(0x1f8, rotqbii), RI7(0x1f9, rotqmbii),RI7(0x1fb, shlqbii), RI7(0x1fc, rotqbyi),
+    RI7(0x1fd, rotqmbyi),RI7(0x1ff, shlqbyi),
+    RR(0x201, nop),
+    RR(0x240, cgt),      RR(0x241, xor),      RR(0x248, cgth),     RR(0x249, eqv),
+    RR(0x250, cgtb),     RR(0x253, sumb),     RR(0x258, hgt),
+    RR(0x2a5, clz),      RR(0x2a6, xswd),     RR(0x2ae, xshw),     RR(0x2b4, cntb),
+    RR(0x2b6, xsbh),
+    RR(0x2c0, clgt),     RR(0x2c1, andc),     RR(0x2c2, fcgt),     RR(0x2c3, dfcgt),
+    RR(0x2c4, fa),       RR(0x2c5, fs),       RR(0x2c6, fm),       RR(0x2c8, clgth),
+    RR(0x2c9, orc),      RR(0x2ca, fcmgt),    RR(0x2cb, dfcmgt),   RR(0x2cc, dfa),
+    RR(0x2cd, dfs),      RR(0x2ce, dfm),      RR(0x2d0, clgtb),    RR(0x2d8, hlgt),
+    RR(0x340, addx),     RR(0x341, sfx),      RR(0x342, cgx),      RR(0x343, bgx),
+    RR(0x346, mpyhha),   RR(0x34e, mpyhhau),
+    RR(0x35c, dfma),     RR(0x35d, dfms),     RR(0x35e, dfnms),    RR(0x35f, dfnma),
+    RR(0x398, fscrrd),   RR(0x3b8, fesd),     RR(0x3b9, frds),     RR(0x3ba, fscrwr),
+    RI7(0x3bf, dftsv),
+    RR(0x3c0, ceq),      RR(0x3c2, fceq),     RR(0x3c3, dfceq),    RR(0x3c4, mpy),
+    RR(0x3c5, mpyh),     RR(0x3c6, mpyhh),    RR(0x3c7, mpys),     RR(0x3c8, ceqh),
+    RR(0x3ca, fcmeq),    RR(0x3cb, dfcmeq),   RR(0x3cc, mpyu),     RR(0x3ce, mpyhhu),
+    RR(0x3d0, ceqb),     RR(0x3d4, fi),       RR(0x3d8, heq),
+
+    RI8(0x1d8, cflts),   RI8(0x1d9, cfltu),   RI8(0x1da, csflt),   RI8(0x1db, cuflt),
+
+    RI10(0x04, ori),     RI10(0x05, orhi),    RI10(0x06, orbi),
+    RI10(0x0c, sfi),     RI10(0x0d, sfhi),
+    RI10(0x14, andi),    RI10(0x15, andhi),   RI10(0x16, andbi),
+    RI10(0x1c, ai),      RI10(0x1d, ahi),
+    RI10(0x24, stqd),    RI10(0x34, lqd),
+    RI10(0x44, xori),    RI10(0x45, xorhi),   RI10(0x46, xorbi),
+    RI10(0x4c, cgti),    RI10(0x4d, cgthi),   RI10(0x4e, cgtbi),   RI10(0x4f, hgti),
+    RI10(0x5c, clgti),   RI10(0x5d, clgthi),  RI10(0x5e, clgtbi),  RI10(0x5f, hlgti),
+    RI10(0x74, mpyi),    RI10(0x75, mpyui),
+    RI10(0x7c, ceqi),    RI10(0x7d, ceqhi),   RI10(0x7e, ceqbi),   RI10(0x7f, heqi),
+
+    RI16(0x040, brz),    RI16(0x041, stqa),   RI16(0x042, brnz),   RI16(0x044, brhz),
+    RI16(0x046, brhnz),  RI16(0x047, stqr),
+    RI16(0x060, bra),    RI16(0x061, lqa),    RI16(0x062, brasl),  RI16(0x064, br),
+    RI16(0x065, fsmbi),  RI16(0x066, brsl),   RI16(0x067, lqr),
+    RI16(0x081, il),     RI16(0x082, ilhu),   RI16(0x083, ilh),    RI16(0x0c1, iohl),
+
+    RI18(0x08, hbra),    RI18(0x09, hbrr),    RI18(0x21, ila),
+
+    RRR(0x8, selb),      RRR(0xb, shufb),     RRR(0xc, mpya),      RRR(0xd, fnms),
+    RRR(0xe, fma),       RRR(0xf, fms),
+};
+
+// the encoding is prefix free, so every opcode owns a contiguous range of
+// the 2048 possible 11 bit prefixes
+static const spu_opcode_t *spu_lookup[2048];
+static bool spu_lookup_ready = false;
+
+static void spu_init_lookup(void)
+{
+    for (u32 i = 0; i < sizeof spu_opcodes / sizeof spu_opcodes[0]; i++)
+    {
+        const spu_opcode_t *op = &spu_opcodes[i];
+        u32 span = 1 << (11 - op->width);
+
+        for (u32 j = 0; j < span; j++)
+            spu_lookup[op->opcode + j] = op;
+    }
+
+    spu_lookup_ready = true;
+}
+
+bool spu_decode(u32 insn, spu_insn_t *out)
+{
+    if (!spu_lookup_ready)
+        spu_init_lookup();
+
+    memset(out, 0, sizeof *out);
+
+    const spu_opcode_t *op = spu_lookup[insn >> 21];
+    if (op == NULL)
+    {
+        out->itype = SPU_INSN_COUNT;
+        return false;
+    }
+
+    out->itype = op->itype;
+    out->format = op->format;
+    out->rt = insn & 0x7f;
+
+    switch (op->format)
+    {
+    case SPU_FMT_RR:
+        out->ra = (insn >> 7) & 0x7f;
+        out->rb = (insn >> 14) & 0x7f;
+        break;
+    case SPU_FMT_RRR:
+        out->rt = (insn >> 21) & 0x7f;
+        out->rb = (insn >> 14) & 0x7f;
+        out->ra = (insn >> 7) & 0x7f;
+        out->rc = insn & 0x7f;
+        break;
+    case SPU_FMT_RI7:
+        out->ra = (insn >> 7) & 0x7f;
+        out->imm = (insn >> 14) & 0x7f;
+        break;
+    case SPU_FMT_RI8:
+        out->ra = (insn >> 7) & 0x7f;
+        out->imm = (insn >> 14) & 0xff;
+        break;
+    case SPU_FMT_RI10:
+        out->ra = (insn >> 7) & 0x7f;
+        out->imm = (insn >> 14) & 0x3ff;
+        break;
+    case SPU_FMT_RI16:
+        out->imm = (insn >> 7) & 0xffff;
+        break;
+    case SPU_FMT_RI18:
+        out->imm = (insn >> 7) & 0x3ffff;
+        break;
+    }
+
+    return true;
+}
+
+static const u8 spu_unit_latency[SPU_UNIT_COUNT] =
+{
+    2, 4, 4, 6, 7, 13,          // FX WS BO SP FI DP
+    4, 6, 4, 6,                 // SH LS BR CH
+};
+
+static const u16 spu_ws_insns[] =
+{
+    SPU_shl, SPU_shlh, SPU_shli, SPU_shlhi, SPU_rot, SPU_roth, SPU_roti, SPU_rothi,
+    SPU_rotm, SPU_rothm, SPU_rotmi, SPU_rothmi, SPU_rotma, SPU_rotmah, SPU_rotmai, SPU_rotmahi,
+};
+
+static const u16 spu_bo_insns[] =
+{
+    SPU_cntb, SPU_absdb, SPU_avgb, SPU_sumb, SPU_clz,
+};
+
+static const u16 spu_sp_insns[] =
+{
+    SPU_fa, SPU_fs, SPU_fm, SPU_fma, SPU_fms, SPU_fnms, SPU_fi,
+};
+
+static const u16 spu_fi_insns[] =
+{
+    SPU_mpy, SPU_mpyu, SPU_mpyi, SPU_mpyui, SPU_mpya, SPU_mpyh, SPU_mpys, SPU_mpyhh,
+    SPU_mpyhha, SPU_mpyhhu, SPU_mpyhhau, SPU_cflts, SPU_cfltu, SPU_csflt, SPU_cuflt,
+    SPU_fesd, SPU_frds, SPU_fscrrd, SPU_fscrwr,
+};
+
+static const u16 spu_dp_insns[] =
+{
+    SPU_dfa, SPU_dfs, SPU_dfm, SPU_dfma, SPU_dfms, SPU_dfnma, SPU_dfnms,
+    SPU_dfceq, SPU_dfcgt, SPU_dfcmeq, SPU_dfcmgt, SPU_dftsv,
+};
+
+static const u16 spu_sh_insns[] =
+{
+    SPU_shufb, SPU_shlqbi, SPU_shlqbii, SPU_shlqby, SPU_shlqbyi, SPU_shlqbybi,
+    SPU_rotqbi, SPU_rotqbii, SPU_rotqby, SPU_rotqbyi, SPU_rotqbybi,
+    SPU_rotqmbi, SPU_rotqmbii, SPU_rotqmby, SPU_rotqmbyi, SPU_rotqmbybi,
+    SPU_gb, SPU_gbh, SPU_gbb, SPU_fsm, SPU_fsmh, SPU_fsmb, SPU_fsmbi, SPU_orx,
+    SPU_frest, SPU_frsqest, SPU_cbd, SPU_chd, SPU_cwd, SPU_cdd, SPU_cbx, SPU_chx, SPU_cwx, SPU_cdx,
+};
+
+static const u16 spu_ls_insns[] =
+{
+    SPU_lqd, SPU_lqx, SPU_lqa, SPU_lqr, SPU_stqd, SPU_stqx, SPU_stqa, SPU_stqr,
+};
+
+static const u16 spu_br_insns[] =
+{
+    SPU_br, SPU_bra, SPU_brsl, SPU_brasl, SPU_brz, SPU_brnz, SPU_brhz, SPU_brhnz,
+    SPU_bi, SPU_bisl, SPU_bisled, SPU_biz, SPU_binz, SPU_bihz, SPU_bihnz,
+    SPU_hbr, SPU_hbra, SPU_hbrr, SPU_lnop,
+};
+
+static const u16 spu_ch_insns[] =
+{
+    SPU_rdch, SPU_rchcnt, SPU_wrch, SPU_mfspr, SPU_mtspr,
+    SPU_stop, SPU_stopd, SPU_sync, SPU_dsync, SPU_iret,
+};
+
+static u8 spu_units[SPU_INSN_COUNT + 1];
+static bool spu_units_ready = false;
+
+static void spu_set_units(const u16 *insns, u32 count, u8 unit)
+{
+    for (u32 i = 0; i < count; i++)
+        spu_units[insns[i]] = unit;
+}
+
+#define SET_UNITS(list, unit) spu_set_units(list, sizeof list / sizeof list[0], unit)
+
+static void spu_init_units(void)
+{
+    // everything else is simple fixed point
+    memset(spu_units, SPU_UNIT_FX, sizeof spu_units);
+
+    SET_UNITS(spu_ws_insns, SPU_UNIT_WS);
+    SET_UNITS(spu_bo_insns, SPU_UNIT_BO);
+    SET_UNITS(spu_sp_insns, SPU_UNIT_SP);
+    SET_UNITS(spu_fi_insns, SPU_UNIT_FI);
+    SET_UNITS(spu_dp_insns, SPU_UNIT_DP);
+    SET_UNITS(spu_sh_insns, SPU_UNIT_SH);
+    SET_UNITS(spu_ls_insns, SPU_UNIT_LS);
+    SET_UNITS(spu_br_insns, SPU_UNIT_BR);
+    SET_UNITS(spu_ch_insns, SPU_UNIT_CH);
+
+    spu_units_ready = true;
+}
+
+u32 spu_unit(u32 itype)
+{
+    if (!spu_units_ready)
+        spu_init_units();
+
+    if (itype > SPU_INSN_COUNT)
+        itype = SPU_INSN_COUNT;
+
+    return spu_units[itype];
+}
+
+u32 spu_pipe(u32 itype)
+{
+    return (spu_unit(itype) >= SPU_UNIT_SH) ? SPU_PIPE_ODD : SPU_PIPE_EVEN;
+}
+
+u32 spu_latency(u32 itype)
+{
+    return spu_unit_latency[spu_unit(itype)];
+}
+
+u32 spu_operands(const spu_insn_t *insn, u32 *dst, u32 src[3])
+{
+    u32 n = 0;
+
+    *dst = ~0u;
+
+    switch (insn->itype)
+    {
+    // no register operands
+    case SPU_stop: case SPU_stopd: case SPU_sync: case SPU_dsync:
+    case SPU_nop: case SPU_lnop: case SPU_iret:
+    case SPU_br: case SPU_bra: case SPU_hbra: case SPU_hbrr:
+    case SPU_INSN_COUNT:
+        return 0;
+
+    // write rt only
+    case SPU_il: case SPU_ilh: case SPU_ilhu: case SPU_ila: case SPU_fsmbi:
+    case SPU_lqa: case SPU_lqr: case SPU_brsl: case SPU_brasl:
+    case SPU_rdch: case SPU_rchcnt: case SPU_mfspr: case SPU_fscrrd:
+        *dst = insn->rt;
+        return 0;
+
+    // read rt only
+    case SPU_stqa: case SPU_stqr: case SPU_brz: case SPU_brnz: case SPU_brhz: case SPU_brhnz:
+    case SPU_wrch: case SPU_mtspr:
+        src[n++] = insn->rt;
+        return n;
+
+    // read ra only
+    case SPU_bi: case SPU_hbr: case SPU_fscrwr:
+        src[n++] = insn->ra;
+        return n;
+
+    // read rt and ra
+    case SPU_stqd: case SPU_biz: case SPU_binz: case SPU_bihz: case SPU_bihnz:
+        src[n++] = insn->rt;
+        src[n++] = insn->ra;
+        return n;
+
+    // stores read all three
+    case SPU_stqx:
+        src[n++] = insn->rt;
+        src[n++] = insn->ra;
+        src[n++] = insn->rb;
+        return n;
+
+    // rt from ra alone
+    case SPU_bisl: case SPU_bisled:
+    case SPU_clz: case SPU_cntb: case SPU_xsbh: case SPU_xshw: case SPU_xswd:
+    case SPU_fsm: case SPU_fsmh: case SPU_fsmb: case SPU_gb: case SPU_gbh: case SPU_gbb:
+    case SPU_orx: case SPU_frest: case SPU_frsqest: case SPU_fesd: case SPU_frds:
+        *dst = insn->rt;
+        src[n++] = insn->ra;
+        return n;
+
+    // rt is also an input
+    case SPU_iohl:
+        *dst = insn->rt;
+        src[n++] = insn->rt;
+        return n;
+
+    case SPU_addx: case SPU_sfx: case SPU_cgx: case SPU_bgx:
+    case SPU_mpyhha: case SPU_mpyhhau:
+    case SPU_dfma: case SPU_dfms: case SPU_dfnma: case SPU_dfnms:
+        *dst = insn->rt;
+        src[n++] = insn->ra;
+        src[n++] = insn->rb;
+        src[n++] = insn->rt;
+        return n;
+    }
+
+    *dst = insn->rt;
+
+    switch (insn->format)
+    {
+    case SPU_FMT_RRR:
+        src[n++] = insn->ra;
+        src[n++] = insn->rb;
+        src[n++] = insn->rc;
+        break;
+    case SPU_FMT_RR:
+        src[n++] = insn->ra;
+        src[n++] = insn->rb;
+        break;
+    case SPU_FMT_RI7:
+    case SPU_FMT_RI8:
+    case SPU_FMT_RI10:
+        src[n++] = insn->ra;
+        break;
+    }
+
+    return n;
+}
+
+const char *spu_mnemonic(u32 itype)
+{
+    if (itype >= SPU_INSN_COUNT)
+        return "???";
+
+    return spu_names[itype];
+}
+
+bool spu_is_branch(u32 itype)
+{
+    switch (itype)
+    {
+    case SPU_br:
+    case SPU_bra:
+    case SPU_brsl:
+    case SPU_brasl:
+    case SPU_brz:
+    case SPU_brnz:
+    case SPU_brhz:
+    case SPU_brhnz:
+    case SPU_bi:
+    case SPU_bisl:
+    case SPU_bisled:
+    case SPU_iret:
+    case SPU_biz:
+    case SPU_binz:
+    case SPU_bihz:
+    case SPU_bihnz:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool spu_is_hint(u32 itype)
+{
+    return itype == SPU_hbr || itype == SPU_hbra || itype == SPU_hbrr;
+}
+
+bool spu_is_conditional(u32 itype)
+{
+    switch (itype)
+    {
+    case SPU_brz:
+    case SPU_brnz:
+    case SPU_brhz:
+    case SPU_brhnz:
+    case SPU_biz:
+    case SPU_binz:
+    case SPU_bihz:
+    case SPU_bihnz:
+    case SPU_bisled:
+        return true;
+    default:
+        return false;
+    }
+}
+
+u32 spu_branch_target(const spu_insn_t *insn, u32 pc)
+{
+    switch (insn->itype)
+    {
+    case SPU_bra:
+    case SPU_brasl:
+        return (se16(insn->imm) << 2) & LSLR;
+    case SPU_br:
+    case SPU_brsl:
+    case SPU_brz:
+    case SPU_brnz:
+    case SPU_brhz:
+    case SPU_brhnz:
+        return (pc + (se16(insn->imm) << 2)) & LSLR;
+    default:
+        return ~0u;
+    }
+}
+
+u32 spu_hint_branch(u32 insn, u32 pc)
+{
+    u32 ro;
+
+    if ((insn >> 21) == 0x1ac)
+        ro = (((insn >> 14) & 3) << 7) | (insn & 0x7f);        // hbr
+    else
+        ro = (((insn >> 23) & 3) << 7) | (insn & 0x7f);        // hbra, hbrr
+
+    return (pc + (se(ro, 9) << 2)) & LSLR;
+}
+
+u32 spu_hint_target(const spu_insn_t *insn, u32 pc)
+{
+    u32 i16 = (insn->imm >> 0) & 0xffff;
+
+    switch (insn->itype)
+    {
+    case SPU_hbra:
+        return (i16 << 2) & LSLR;
+    case SPU_hbrr:
+        return (pc + (se16(i16) << 2)) & LSLR;
+    default:
+        return ~0u;
+    }
+}
@@ -0,0 +1,283 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef SPU_H__
+#define SPU_H__
+
+#include "types.h"
+
+// instruction types, numbered as IDA's SPU processor module reports them
+// in cmd.itype
+enum spu_instructions
+{
+    SPU_a  =   58,
+    SPU_absdb  =   150,
+    SPU_addx  =   108,
+    SPU_ah  =   76,
+    SPU_ahi  =   9,
+    SPU_ai  =   8,
+    SPU_and  =   70,
+    SPU_andbi  =   7,
+    SPU_andc  =   59,
+    SPU_andhi  =   6,
+    SPU_andi  =   5,
+    SPU_avgb  =   84,
+    SPU_bg  =   41,
+    SPU_bgx  =   97,
+    SPU_bi  =   109,
+    SPU_bihnz  =   93,
+    SPU_bihz  =   92,
+    SPU_binz  =   91,
+    SPU_bisl  =   110,
+    SPU_bisled  =   112,
+    SPU_biz  =   90,
+    SPU_br  =   171,
+    SPU_bra  =   166,
+    SPU_brasl  =   169,
+    SPU_brhnz  =   163,
+    SPU_brhz  =   161,
+    SPU_brnz  =   159,
+    SPU_brsl  =   172,
+    SPU_brz  =   157,
+    SPU_cbd  =   180,
+    SPU_cbx  =   139,
+    SPU_cdd  =   183,
+    SPU_cdx  =   142,
+    SPU_ceq  =   124,
+    SPU_ceqb  =   138,
+    SPU_ceqbi  =   27,
+    SPU_ceqh  =   131,
+    SPU_ceqhi  =   26,
+    SPU_ceqi  =   25,
+    SPU_cflts  =   195,
+    SPU_cfltu  =   196,
+    SPU_cg  =   60,
+    SPU_cgt  =   39,
+    SPU_cgtb  =   44,
+    SPU_cgtbi  =   17,
+    SPU_cgth  =   42,
+    SPU_cgthi  =   16,
+    SPU_cgti  =   15,
+    SPU_cgx  =   96,
+    SPU_chd  =   181,
+    SPU_chx  =   140,
+    SPU_clgt  =   69,
+    SPU_clgtb  =   83,
+    SPU_clgtbi  =   21,
+    SPU_clgth  =   65,
+    SPU_clgthi  =   20,
+    SPU_clgti  =   19,
+    SPU_clz  =   62,
+    SPU_cntb  =   66,
+    SPU_csflt  =   197,
+    SPU_cuflt  =   198,
+    SPU_cwd  =   182,
+    SPU_cwx  =   141,
+    SPU_dfa  =   80,
+    SPU_dfceq  =   126,
+    SPU_dfcgt  =   72,
+    SPU_dfcmeq  =   133,
+    SPU_dfcmgt  =   79,
+    SPU_dfm  =   82,
+    SPU_dfma  =   101,
+    SPU_dfms  =   102,
+    SPU_dfnma  =   104,
+    SPU_dfnms  =   103,
+    SPU_dfs  =   81,
+    SPU_dftsv  =   178,
+    SPU_dsync  =   32,
+    SPU_eqv  =   43,
+    SPU_fa  =   73,
+    SPU_fceq  =   125,
+    SPU_fcgt  =   71,
+    SPU_fcmeq  =   132,
+    SPU_fcmgt  =   78,
+    SPU_fesd  =   45,
+    SPU_fi  =   86,
+    SPU_fm  =   75,
+    SPU_fma  =   155,
+    SPU_fms  =   156,
+    SPU_fnms  =   154,
+    SPU_frds  =   47,
+    SPU_frest  =   121,
+    SPU_frsqest  =   122,
+    SPU_fs  =   74,
+    SPU_fscrrd  =   107,
+    SPU_fscrwr  =   123,
+    SPU_fsm  =   117,
+    SPU_fsmb  =   119,
+    SPU_fsmbi  =   162,
+    SPU_fsmh  =   118,
+    SPU_gb  =   114,
+    SPU_gbb  =   116,
+    SPU_gbh  =   115,
+    SPU_hbr  =   113,
+    SPU_hbra  =   192,
+    SPU_hbrr  =   194,
+    SPU_heq  =   89,
+    SPU_heqi  =   28,
+    SPU_hgt  =   37,
+    SPU_hgti  =   18,
+    SPU_hlgt  =   85,
+    SPU_hlgti  =   22,
+    SPU_il  =   165,
+    SPU_ila  =   193,
+    SPU_ilh  =   160,
+    SPU_ilhu  =   173,
+    SPU_iohl  =   167,
+    SPU_iret  =   111,
+    SPU_lnop  =   30,
+    SPU_lqa  =   170,
+    SPU_lqd  =   11,
+    SPU_lqr  =   168,
+    SPU_lqx  =   127,
+    SPU_lr  =   199,
+    SPU_mfspr  =   34,
+    SPU_mpy  =   61,
+    SPU_mpya  =   153,
+    SPU_mpyh  =   128,
+    SPU_mpyhh  =   129,
+    SPU_mpyhha  =   99,
+    SPU_mpyhhau  =   100,
+    SPU_mpyhhu  =   136,
+    SPU_mpyi  =   23,
+    SPU_mpys  =   130,
+    SPU_mpyu  =   38,
+    SPU_mpyui  =   24,
+    SPU_mtspr  =   87,
+    SPU_nand  =   68,
+    SPU_nop  =   33,
+    SPU_nor  =   120,
+    SPU_or  =   40,
+    SPU_orbi  =   2,
+    SPU_orc  =   77,
+    SPU_orhi  =   1,
+    SPU_ori  =   0,
+    SPU_orx  =   149,
+    SPU_rchcnt  =   36,
+    SPU_rdch  =   35,
+    SPU_rot  =   48,
+    SPU_roth  =   52,
+    SPU_rothi  =   188,
+    SPU_rothm  =   53,
+    SPU_rothmi  =   189,
+    SPU_roti  =   184,
+    SPU_rotm  =   49,
+    SPU_rotma  =   50,
+    SPU_rotmah  =   54,
+    SPU_rotmahi  =   190,
+    SPU_rotmai  =   186,
+    SPU_rotmi  =   185,
+    SPU_rotqbi  =   143,
+    SPU_rotqbii  =   179,
+    SPU_rotqby  =   146,
+    SPU_rotqbybi  =   134,
+    SPU_rotqbyi  =   176,
+    SPU_rotqmbi  =   144,
+    SPU_rotqmbii  =   174,
+    SPU_rotqmby  =   147,
+    SPU_rotqmbybi  =   135,
+    SPU_rotqmbyi  =   177,
+    SPU_selb  =   151,
+    SPU_sf  =   105,
+    SPU_sfh  =   56,
+    SPU_sfhi  =   4,
+    SPU_sfi  =   3,
+    SPU_sfx  =   95,
+    SPU_shl  =   51,
+    SPU_shlh  =   55,
+    SPU_shlhi  =   57,
+    SPU_shli  =   187,
+    SPU_shlqbi  =   145,
+    SPU_shlqbii  =   191,
+    SPU_shlqby  =   148,
+    SPU_shlqbybi  =   137,
+    SPU_shlqbyi  =   175,
+    SPU_shufb  =   152,
+    SPU_stop  =   29,
+    SPU_stopd  =   94,
+    SPU_stqa  =   158,
+    SPU_stqd  =   10,
+    SPU_stqr  =   164,
+    SPU_stqx  =   98,
+    SPU_sumb  =   46,
+    SPU_sync  =   31,
+    SPU_wrch  =   88,
+    SPU_xor  =   106,
+    SPU_xorbi  =   14,
+    SPU_xorhi  =   13,
+    SPU_xori  =   12,
+    SPU_xsbh  =   67,
+    SPU_xshw  =   64,
+    SPU_xswd  =   63,
+
+    SPU_INSN_COUNT  =   200,
+};
+
+typedef enum
+{
+    SPU_FMT_RR = 0,
+    SPU_FMT_RRR,
+    SPU_FMT_RI7,
+    SPU_FMT_RI8,
+    SPU_FMT_RI10,
+    SPU_FMT_RI16,
+    SPU_FMT_RI18,
+} spu_format_t;
+
+// a raw instruction word split into its fields. Fields that the format
+// does not have are zero.
+typedef struct
+{
+    u32 itype;                  // SPU_INSN_COUNT if the word does not decode
+    u32 format;
+    u32 rt, ra, rb, rc;
+    u32 imm;                    // raw immediate field, not sign extended
+} spu_insn_t;
+
+// execution units, from the Cell BE handbook. FX..DP issue on the even
+// pipe, SH..CH on the odd one.
+typedef enum
+{
+    SPU_UNIT_FX = 0,            // simple fixed point
+    SPU_UNIT_WS,                // word rotate and shift
+    SPU_UNIT_BO,                // byte operations
+    SPU_UNIT_SP,                // single precision floating point
+    SPU_UNIT_FI,                // integer multiply, float conversions
+    SPU_UNIT_DP,                // double precision floating point
+    SPU_UNIT_SH,                // shuffle, quadword rotate and shift
+    SPU_UNIT_LS,                // loads and stores
+    SPU_UNIT_BR,                // branches and hints
+    SPU_UNIT_CH,                // channels and special registers
+    SPU_UNIT_COUNT
+} spu_unit_t;
+
+#define SPU_PIPE_EVEN   0
+#define SPU_PIPE_ODD    1
+
+// double precision operations block issue of the following instructions
+#define SPU_DP_ISSUE_STALL  6
+
+// decoding works on raw words so that traces can be analysed without IDA
+bool spu_decode(u32 insn, spu_insn_t *out);
+const char *spu_mnemonic(u32 itype);
+
+u32 spu_unit(u32 itype);
+u32 spu_pipe(u32 itype);
+u32 spu_latency(u32 itype);
+// registers an instruction reads and writes. Returns the number of sources;
+// *dst is ~0 when nothing is written
+u32 spu_operands(const spu_insn_t *insn, u32 *dst, u32 src[3]);
+
+bool spu_is_branch(u32 itype);
+bool spu_is_hint(u32 itype);
+bool spu_is_conditional(u32 itype);
+
+// target of a direct (RI16) branch; ~0 for branches through a register
+u32 spu_branch_target(const spu_insn_t *insn, u32 pc);
+// address of the branch an hbr/hbra/hbrr instruction refers to
+u32 spu_hint_branch(u32 insn, u32 pc);
+// target of an hbra/hbrr hint; ~0 for hbr (register target)
+u32 spu_hint_target(const spu_insn_t *insn, u32 pc);
+
+#endif
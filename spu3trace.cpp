@@ -0,0 +1,470 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+//
+//      spu3trace - offline reports over recorded instruction traces
+//
+//      spu3trace [-j threads] [-n top] <trace>
+//          top PCs, instruction mix and basic block counts
+//
+//      spu3trace timing [-j threads] [-n top] [-a annotations] <trace>
+//          pipeline timing estimate per basic block, optionally written as
+//          an annotation file for LoadAnnotations()
+//
+//      spu3trace hints [-j threads] [-n top] [-a annotations] <trace>
+//          branch hint effectiveness per branch site, by lost cycles
+//
+//      spu3trace bench [-j max_threads] [-r repeats] <trace>
+//          analysis throughput for 1 to max_threads workers
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#include "analysis.h"
+#include "annotate.h"
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: spu3trace [-j threads] [-n top] <trace>\n"
+        "       spu3trace timing [-j threads] [-n top] [-a annotations] <trace>\n"
+        "       spu3trace hints [-j threads] [-n top] [-a annotations] <trace>\n"
+        "       spu3trace bench [-j max_threads] [-r repeats] <trace>\n");
+    exit(1);
+}
+
+static double percent(u64 part, u64 total)
+{
+    return total ? (100.0 * part / total) : 0.0;
+}
+
+static void print_counts(const char *title, const trace_pc_counts_t &counts, u32 top, u64 total)
+{
+    std::vector<trace_count_t> sorted;
+    trace_top_counts(counts, top, &sorted);
+
+    printf("\n%s (%u distinct)\n", title, (u32)counts.size());
+    for (size_t i = 0; i < sorted.size(); i++)
+        printf("  %05X  %14llu  %6.2f%%\n", sorted[i].pc, sorted[i].count, percent(sorted[i].count, total));
+}
+
+static bool mix_order(const std::pair<u64, u32> &a, const std::pair<u64, u32> &b)
+{
+    if (a.first != b.first)
+        return a.first > b.first;
+    return strcmp(spu_mnemonic(a.second), spu_mnemonic(b.second)) < 0;
+}
+
+static void print_mix(const trace_insn_mix_t &mix, u64 total)
+{
+    std::vector<std::pair<u64, u32> > sorted;
+    for (u32 i = 0; i <= SPU_INSN_COUNT; i++)
+    {
+        if (mix.counts[i] != 0)
+            sorted.push_back(std::make_pair(mix.counts[i], i));
+    }
+    std::sort(sorted.begin(), sorted.end(), mix_order);
+
+    printf("\nInstruction mix (%u types)\n", (u32)sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++)
+        printf("  %-10s %14llu  %6.2f%%\n", spu_mnemonic(sorted[i].second), sorted[i].first, percent(sorted[i].first, total));
+}
+
+static int report(trace_index_t *idx, u32 threads, u32 top)
+{
+    trace_pc_histogram_t pcs;
+    trace_insn_mix_t mix;
+    trace_block_counts_t blocks;
+
+    std::vector<trace_reducer_t *> reducers;
+    reducers.push_back(&pcs);
+    reducers.push_back(&mix);
+    reducers.push_back(&blocks);
+
+    trace_analysis_stats_t stats;
+    if (!trace_analyze(idx, reducers, threads, &stats))
+    {
+        fprintf(stderr, "error reading %s\n", idx->path);
+        return 1;
+    }
+
+    printf("%llu instructions in %u chunks, %u threads, %.3f s (%u steals)\n",
+        stats.instructions, stats.chunks, stats.threads, stats.seconds, stats.steals);
+
+    print_counts("Top PCs", pcs.counts, top, stats.instructions);
+    print_mix(mix, stats.instructions);
+    print_counts("Top basic blocks", blocks.counts, top, stats.instructions);
+
+    return 0;
+}
+
+static u64 timing_cost(const trace_timing_stats_t &s)
+{
+    return s.cycles + s.penalty;
+}
+
+static double per_exec(u64 value, const trace_timing_stats_t &s)
+{
+    return s.executions ? ((double)value / s.executions) : 0.0;
+}
+
+static bool timing_order(const std::pair<u32, trace_timing_stats_t> &a, const std::pair<u32, trace_timing_stats_t> &b)
+{
+    if (timing_cost(a.second) != timing_cost(b.second))
+        return timing_cost(a.second) > timing_cost(b.second);
+    return a.first < b.first;
+}
+
+static void timing_annotate(const trace_timing_t &timing, std::vector<annotation_t> *notes)
+{
+    // heat is the cycles per execution lost to stalls and mispredictions,
+    // relative to the worst instruction
+    double worst = 0;
+    for (trace_timing_map_t::const_iterator it = timing.pcs.begin(); it != timing.pcs.end(); ++it)
+        worst = std::max(worst, per_exec(it->second.stall + it->second.penalty, it->second));
+
+    std::vector<u32> order;
+    for (trace_timing_map_t::const_iterator it = timing.pcs.begin(); it != timing.pcs.end(); ++it)
+        order.push_back(it->first);
+    std::sort(order.begin(), order.end());
+
+    notes->clear();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const trace_timing_stats_t &s = timing.pcs.find(order[i])->second;
+        trace_timing_map_t::const_iterator b = timing.blocks.find(order[i]);
+        char buf[256];
+        std::string comment;
+
+        if (b != timing.blocks.end())
+        {
+            const trace_timing_stats_t &bs = b->second;
+            sprintf(buf, "block x%llu: %.1f insns, %.1f cycles, %.0f%% dual",
+                bs.executions, per_exec(bs.instructions, bs), per_exec(timing_cost(bs), bs), percent(bs.dual, bs.instructions));
+            comment = buf;
+        }
+
+        // ignore losses that round away at one decimal
+        double lost = per_exec(s.stall + s.penalty, s);
+        if (lost >= 0.05)
+        {
+            sprintf(buf, "%sstall %.1f", comment.empty() ? "" : "; ", per_exec(s.stall, s));
+            comment += buf;
+            if (s.penalty != 0)
+            {
+                sprintf(buf, ", mispredict %.1f", per_exec(s.penalty, s));
+                comment += buf;
+            }
+        }
+
+        if (comment.empty())
+            continue;
+
+        annotation_t n;
+        n.ea = order[i];
+        n.color = (lost >= 0.05) ? annotation_heat(lost / worst) : ANNOTATION_NO_COLOR;
+        n.comment = comment;
+        notes->push_back(n);
+    }
+}
+
+static int timing_report(trace_index_t *idx, u32 threads, u32 top, const char *annotations)
+{
+    trace_timing_t timing;
+    std::vector<trace_reducer_t *> reducers(1, &timing);
+
+    trace_analysis_stats_t stats;
+    if (!trace_analyze(idx, reducers, threads, &stats))
+    {
+        fprintf(stderr, "error reading %s\n", idx->path);
+        return 1;
+    }
+
+    const trace_timing_stats_t &t = timing.total;
+    printf("%llu instructions, %llu cycles (%.3f CPI)\n", t.instructions, timing_cost(t),
+        t.instructions ? (double)timing_cost(t) / t.instructions : 0.0);
+    printf("  dual issued  %14llu  %6.2f%%\n", t.dual, percent(t.dual, t.instructions));
+    printf("  stalls       %14llu  %6.2f%% of cycles\n", t.stall, percent(t.stall, timing_cost(t)));
+    printf("  mispredicts  %14llu  %6.2f%% of cycles\n", t.penalty, percent(t.penalty, timing_cost(t)));
+
+    std::vector<std::pair<u32, trace_timing_stats_t> > sorted(timing.blocks.begin(), timing.blocks.end());
+    if (top < sorted.size())
+    {
+        std::partial_sort(sorted.begin(), sorted.begin() + top, sorted.end(), timing_order);
+        sorted.resize(top);
+    }
+    else
+    {
+        std::sort(sorted.begin(), sorted.end(), timing_order);
+    }
+
+    printf("\nTop basic blocks by cycles (%u distinct)\n", (u32)timing.blocks.size());
+    printf("  %5s  %12s %7s %8s %7s %7s %7s  %6s\n", "block", "executions", "insns", "cycles", "dual", "stall", "branch", "share");
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        const trace_timing_stats_t &s = sorted[i].second;
+        printf("  %05X  %12llu %7.1f %8.1f %6.1f%% %7.1f %7.1f  %5.2f%%\n", sorted[i].first, s.executions,
+            per_exec(s.instructions, s), per_exec(timing_cost(s), s), percent(s.dual, s.instructions),
+            per_exec(s.stall, s), per_exec(s.penalty, s), percent(timing_cost(s), timing_cost(t)));
+    }
+
+    if (annotations != NULL)
+    {
+        std::vector<annotation_t> notes;
+        timing_annotate(timing, &notes);
+
+        if (!annotations_write(annotations, notes))
+        {
+            fprintf(stderr, "could not write %s\n", annotations);
+            return 1;
+        }
+        printf("\n%u annotations written to %s\n", (u32)notes.size(), annotations);
+    }
+
+    return 0;
+}
+
+static bool hint_order(const std::pair<u32, trace_hint_site_t> &a, const std::pair<u32, trace_hint_site_t> &b)
+{
+    if (a.second.lost != b.second.lost)
+        return a.second.lost > b.second.lost;
+    return a.first < b.first;
+}
+
+static void hint_annotate(const trace_hint_analysis_t &hints, std::vector<annotation_t> *notes)
+{
+    u64 worst = 0;
+    std::vector<u32> order;
+    for (trace_hint_map_t::const_iterator it = hints.sites.begin(); it != hints.sites.end(); ++it)
+    {
+        worst = std::max(worst, it->second.lost);
+        order.push_back(it->first);
+    }
+    std::sort(order.begin(), order.end());
+
+    notes->clear();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const trace_hint_site_t &s = hints.sites.find(order[i])->second;
+        char buf[256];
+
+        sprintf(buf, "taken %llu/%llu: %.0f%% hinted, %.0f%% wrong, %.0f%% unhinted; %llu cycles lost",
+            s.taken, s.taken + s.not_taken, percent(s.correct, s.taken), percent(s.wrong, s.taken),
+            percent(s.unhinted, s.taken), s.lost);
+
+        annotation_t n;
+        n.ea = order[i];
+        n.color = (s.lost != 0) ? annotation_heat((double)s.lost / worst) : ANNOTATION_NO_COLOR;
+        n.comment = buf;
+        notes->push_back(n);
+    }
+}
+
+static int hint_report(trace_index_t *idx, u32 threads, u32 top, const char *annotations)
+{
+    trace_hint_analysis_t hints;
+    std::vector<trace_reducer_t *> reducers(1, &hints);
+
+    trace_analysis_stats_t stats;
+    if (!trace_analyze(idx, reducers, threads, &stats))
+    {
+        fprintf(stderr, "error reading %s\n", idx->path);
+        return 1;
+    }
+
+    const trace_hint_site_t &t = hints.total;
+    printf("%llu branches, %llu taken, %llu cycles lost (%.2f per instruction)\n",
+        t.taken + t.not_taken, t.taken, t.lost, stats.instructions ? (double)t.lost / stats.instructions : 0.0);
+    printf("  hinted correct    %14llu  %6.2f%% of taken\n", t.correct, percent(t.correct, t.taken));
+    printf("  hinted wrong      %14llu  %6.2f%% of taken (%llu late)\n", t.wrong, percent(t.wrong, t.taken), t.late);
+    printf("  unhinted          %14llu  %6.2f%% of taken\n", t.unhinted, percent(t.unhinted, t.taken));
+    printf("  hinted not taken  %14llu\n", t.hinted_not_taken);
+
+    std::vector<std::pair<u32, trace_hint_site_t> > sorted(hints.sites.begin(), hints.sites.end());
+    if (top < sorted.size())
+    {
+        std::partial_sort(sorted.begin(), sorted.begin() + top, sorted.end(), hint_order);
+        sorted.resize(top);
+    }
+    else
+    {
+        std::sort(sorted.begin(), sorted.end(), hint_order);
+    }
+
+    printf("\nBranch sites by lost cycles (%u distinct)\n", (u32)hints.sites.size());
+    printf("  %5s %-7s %12s %7s %7s %7s %10s %14s  %6s  %5s\n",
+        "site", "insn", "taken", "hinted", "wrong", "none", "not taken", "lost", "share", "hint");
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        const trace_hint_site_t &s = sorted[i].second;
+        trace_record_t rec;
+        spu_insn_t insn;
+        u64 n;
+        char hint[16] = "-";
+
+        // the instruction word comes from the site's first execution
+        insn.itype = SPU_INSN_COUNT;
+        if (trace_index_find_pc(idx, sorted[i].first, 0, 0, &n) && trace_index_seek(idx, n, &rec))
+            spu_decode(rec.insn, &insn);
+        if (s.hint != ~0u)
+            sprintf(hint, "%05X", s.hint);
+
+        printf("  %05X %-7s %12llu %6.1f%% %6.1f%% %6.1f%% %10llu %14llu  %5.2f%%  %5s\n",
+            sorted[i].first, spu_mnemonic(insn.itype), s.taken, percent(s.correct, s.taken), percent(s.wrong, s.taken),
+            percent(s.unhinted, s.taken), s.hinted_not_taken, s.lost, percent(s.lost, t.lost), hint);
+    }
+
+    if (annotations != NULL)
+    {
+        std::vector<annotation_t> notes;
+        hint_annotate(hints, &notes);
+
+        if (!annotations_write(annotations, notes))
+        {
+            fprintf(stderr, "could not write %s\n", annotations);
+            return 1;
+        }
+        printf("\n%u annotations written to %s\n", (u32)notes.size(), annotations);
+    }
+
+    return 0;
+}
+
+static int bench(trace_index_t *idx, u32 max_threads, u32 repeats)
+{
+    double base = 0;
+
+    printf("%8s %10s %12s %8s %8s\n", "threads", "seconds", "Minsn/s", "speedup", "steals");
+
+    // warm the page cache so the first row is not penalised
+    {
+        trace_pc_histogram_t pcs;
+        std::vector<trace_reducer_t *> reducers(1, &pcs);
+        trace_analyze(idx, reducers, max_threads, NULL);
+    }
+
+    // 1, 2, 4, ... and max_threads itself
+    std::vector<u32> counts;
+    for (u32 t = 1; t < max_threads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(max_threads);
+
+    for (size_t c = 0; c < counts.size(); c++)
+    {
+        u32 t = counts[c];
+        trace_analysis_stats_t best;
+        memset(&best, 0, sizeof best);
+        best.seconds = -1;
+
+        for (u32 r = 0; r < repeats; r++)
+        {
+            trace_pc_histogram_t pcs;
+            trace_insn_mix_t mix;
+            trace_block_counts_t blocks;
+
+            std::vector<trace_reducer_t *> reducers;
+            reducers.push_back(&pcs);
+            reducers.push_back(&mix);
+            reducers.push_back(&blocks);
+
+            trace_analysis_stats_t stats;
+            if (!trace_analyze(idx, reducers, t, &stats))
+                return 1;
+
+            if (best.seconds < 0 || stats.seconds < best.seconds)
+                best = stats;
+        }
+
+        if (t == 1)
+            base = best.seconds;
+
+        printf("%8u %10.3f %12.1f %7.2fx %8u\n", t, best.seconds,
+            best.instructions / best.seconds / 1e6, base / best.seconds, best.steals);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    enum { MODE_REPORT, MODE_TIMING, MODE_HINTS, MODE_BENCH } mode = MODE_REPORT;
+    const char *annotations = NULL;
+    u32 threads = 0;
+    u32 top = 20;
+    u32 repeats = 3;
+    int i = 1;
+
+    if (i < argc && strcmp(argv[i], "bench") == 0)
+    {
+        mode = MODE_BENCH;
+        i++;
+    }
+    else if (i < argc && strcmp(argv[i], "timing") == 0)
+    {
+        mode = MODE_TIMING;
+        i++;
+    }
+    else if (i < argc && strcmp(argv[i], "hints") == 0)
+    {
+        mode = MODE_HINTS;
+        i++;
+    }
+
+    for (; i < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (i + 1 >= argc)
+            usage();
+
+        switch (argv[i][1])
+        {
+        case 'j':
+            threads = atoi(argv[i + 1]);
+            break;
+        case 'n':
+            top = atoi(argv[i + 1]);
+            break;
+        case 'r':
+            repeats = std::max(1, atoi(argv[i + 1]));
+            break;
+        case 'a':
+            annotations = argv[i + 1];
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (i + 1 != argc)
+        usage();
+
+    trace_index_t *idx = trace_index_open(argv[i]);
+    if (idx == NULL)
+    {
+        fprintf(stderr, "could not open trace %s\n", argv[i]);
+        return 1;
+    }
+
+    int res;
+    switch (mode)
+    {
+    case MODE_BENCH:
+        res = bench(idx, threads ? threads : std::max(1u, std::thread::hardware_concurrency()), repeats);
+        break;
+    case MODE_TIMING:
+        res = timing_report(idx, threads, top, annotations);
+        break;
+    case MODE_HINTS:
+        res = hint_report(idx, threads, top, annotations);
+        break;
+    default:
+        res = report(idx, threads, top);
+        break;
+    }
+
+    trace_index_close(idx);
+    return res;
+}
@@ -0,0 +1,118 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "timing.h"
+
+#include <string.h>
+
+void spu_timing_reset(spu_timing_t *t)
+{
+    memset(t, 0, sizeof *t);
+}
+
+void spu_timing_issue(spu_timing_t *t, u32 pc, u32 word, const spu_insn_t *insn, spu_issue_t *out)
+{
+    u32 dst, src[3];
+    u32 n = spu_operands(insn, &dst, src);
+    u32 pipe = spu_pipe(insn->itype);
+
+    u64 ready = 0;
+    bool depends = false;
+
+    for (u32 i = 0; i < n; i++)
+    {
+        if (ready < t->ready[src[i]])
+            ready = t->ready[src[i]];
+        if (t->open && src[i] == t->open_dst)
+            depends = true;
+    }
+
+    u64 cycle;
+
+    if (t->open && pc == t->open_pc + 4 && pipe == SPU_PIPE_ODD && !depends && ready <= t->open_cycle)
+    {
+        // second slot of a pair
+        cycle = t->open_cycle;
+        t->open = false;
+
+        out->cycles = 0;
+        out->stall = 0;
+        out->dual = true;
+    }
+    else
+    {
+        cycle = (ready > t->next) ? ready : t->next;
+
+        out->cycles = (u32)(cycle + 1 - t->end);
+        out->stall = out->cycles - 1;
+        out->dual = false;
+
+        t->end = cycle + 1;
+        t->next = cycle + 1;
+
+        if (spu_unit(insn->itype) == SPU_UNIT_DP)
+            t->next += SPU_DP_ISSUE_STALL;
+
+        t->open = (pipe == SPU_PIPE_EVEN && (pc & 7) == 0);
+        t->open_pc = pc;
+        t->open_dst = dst;
+        t->open_cycle = cycle;
+    }
+
+    t->last_cycle = cycle;
+
+    if (dst != ~0u)
+        t->ready[dst] = cycle + spu_latency(insn->itype);
+
+    if (spu_is_hint(insn->itype))
+    {
+        t->hinted = true;
+        t->hint_branch = spu_hint_branch(word, pc);
+        t->hint_target = spu_hint_target(insn, pc);
+        t->hint_cycle = cycle;
+    }
+}
+
+u32 spu_timing_branch(spu_timing_t *t, u32 pc, u32 next_pc)
+{
+    bool taken = (next_pc != pc + 4);
+    bool predicted = t->hinted && t->hint_branch == pc && t->hint_cycle + SPU_HINT_LEAD <= t->last_cycle;
+    u32 penalty = 0;
+
+    if (taken != predicted)
+        penalty = SPU_BRANCH_PENALTY;
+    else if (taken && t->hint_target != ~0u && t->hint_target != next_pc)
+        penalty = SPU_BRANCH_PENALTY;
+
+    // the pipeline restarts at next_pc
+    t->open = false;
+    t->next += penalty;
+    t->end += penalty;
+
+    return penalty;
+}
+
+void spu_timing_block(const u32 *words, u32 count, u32 pc, spu_block_timing_t *out, spu_issue_t *issues)
+{
+    spu_timing_t t;
+    spu_insn_t insn;
+    spu_issue_t is;
+
+    spu_timing_reset(&t);
+    memset(out, 0, sizeof *out);
+
+    for (u32 i = 0; i < count; i++)
+    {
+        spu_decode(words[i], &insn);
+        spu_timing_issue(&t, pc + i * 4, words[i], &insn, &is);
+
+        out->instructions++;
+        out->cycles += is.cycles;
+        out->stall += is.stall;
+        if (is.dual)
+            out->dual++;
+
+        if (issues != NULL)
+            issues[i] = is;
+    }
+}
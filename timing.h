@@ -0,0 +1,82 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef TIMING_H__
+#define TIMING_H__
+
+#include "types.h"
+#include "spu.h"
+
+//
+//      SPU pipeline timing model
+//
+//      An in-order estimate of the SPU issue logic:
+//
+//        - one instruction per cycle, or two when an even pipe instruction
+//          at an 8 byte aligned address is followed by an odd pipe one that
+//          does not use its result
+//        - an instruction waits until all of its source registers are
+//          ready (issue cycle of the producer plus its latency)
+//        - double precision operations block issue for a further
+//          SPU_DP_ISSUE_STALL cycles
+//        - a mispredicted branch costs SPU_BRANCH_PENALTY cycles. Branches
+//          are predicted not taken unless a hint for them was issued at
+//          least SPU_HINT_LEAD cycles earlier.
+//
+//      Instruction fetch, local store bank conflicts with DMA and channel
+//      stalls are not modelled.
+//
+
+#define SPU_BRANCH_PENALTY  18
+#define SPU_HINT_LEAD       11
+
+struct spu_timing_t
+{
+    u64 ready[128];             // cycle each register's value is available
+    u64 next;                   // earliest cycle for the next issue
+    u64 end;                    // one past the last issue cycle
+
+    // the previous instruction, as a candidate for the first slot of a pair
+    bool open;
+    u32 open_pc;
+    u32 open_dst;
+    u64 open_cycle;
+
+    u64 last_cycle;             // issue cycle of the previous instruction
+
+    // the most recent branch hint
+    bool hinted;
+    u32 hint_branch;
+    u32 hint_target;            // ~0 for hbr, whose target is a register
+    u64 hint_cycle;
+};
+
+typedef struct
+{
+    u32 cycles;                 // cycles added to the schedule, 0 when dual issued
+    u32 stall;                  // of which nothing issued
+    bool dual;                  // second slot of a pair
+} spu_issue_t;
+
+void spu_timing_reset(spu_timing_t *t);
+// word is the raw instruction that insn was decoded from
+void spu_timing_issue(spu_timing_t *t, u32 pc, u32 word, const spu_insn_t *insn, spu_issue_t *out);
+// resolve the branch issued last, execution continued at next_pc. Returns
+// the mispredict penalty, which is also added to the schedule.
+u32 spu_timing_branch(spu_timing_t *t, u32 pc, u32 next_pc);
+
+//--------------------------------------------------------------------------
+// static estimate for one basic block, all registers ready on entry and the
+// closing branch not charged
+typedef struct
+{
+    u32 instructions;
+    u32 cycles;
+    u32 dual;
+    u32 stall;
+} spu_block_timing_t;
+
+// issues, when not NULL, receives one entry per instruction
+void spu_timing_block(const u32 *words, u32 count, u32 pc, spu_block_timing_t *out, spu_issue_t *issues);
+
+#endif
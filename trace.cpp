@@ -0,0 +1,475 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#ifdef _WIN32
+#define trace_fseek _fseeki64
+#define trace_ftell _ftelli64
+#else
+#define trace_fseek fseeko
+#define trace_ftell ftello
+#endif
+
+// private helpers
+static char *index_path(const char *path)
+{
+    size_t len = strlen(path);
+    char *p = (char *)malloc(len + 5);
+
+    memcpy(p, path, len);
+    memcpy(p + len, ".idx", 5);
+
+    return p;
+}
+
+static u64 file_size(FILE *fp)
+{
+    u64 pos = trace_ftell(fp);
+    trace_fseek(fp, 0, SEEK_END);
+    u64 size = trace_ftell(fp);
+    trace_fseek(fp, pos, SEEK_SET);
+
+    return size;
+}
+
+static bool write_index(const char *path, u64 trace_size,
+                        const std::vector<trace_index_entry_t> &entries,
+                        const std::vector<trace_checkpoint_t> &checkpoints,
+                        const std::vector<trace_index_pc_t> &pcs,
+                        const std::vector<trace_index_run_t> &runs)
+{
+    char *ipath = index_path(path);
+    FILE *fp = fopen(ipath, "wb");
+    free(ipath);
+
+    if (fp == NULL)
+        return false;
+
+    trace_index_header_t hdr;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.magic = TRACE_INDEX_MAGIC;
+    hdr.version = TRACE_INDEX_VERSION;
+    hdr.chunk_count = (u32)entries.size();
+    hdr.checkpoint_count = (u32)checkpoints.size();
+    hdr.pc_count = (u32)pcs.size();
+    hdr.run_count = runs.size();
+    hdr.trace_size = trace_size;
+    if (!entries.empty())
+        hdr.instruction_count = entries.back().first + entries.back().count;
+
+    bool ok = fwrite(&hdr, sizeof hdr, 1, fp) == 1;
+    if (ok && !entries.empty())
+        ok = fwrite(&entries[0], sizeof entries[0], entries.size(), fp) == entries.size();
+    if (ok && !checkpoints.empty())
+        ok = fwrite(&checkpoints[0], sizeof checkpoints[0], checkpoints.size(), fp) == checkpoints.size();
+    if (ok && !pcs.empty())
+        ok = fwrite(&pcs[0], sizeof pcs[0], pcs.size(), fp) == pcs.size();
+    if (ok && !runs.empty())
+        ok = fwrite(&runs[0], sizeof runs[0], runs.size(), fp) == runs.size();
+
+    return (fclose(fp) == 0) && ok;
+}
+
+static bool read_index(trace_index_t *idx, const char *path, u64 trace_size)
+{
+    char *ipath = index_path(path);
+    FILE *fp = fopen(ipath, "rb");
+    free(ipath);
+
+    if (fp == NULL)
+        return false;
+
+    bool ok = fread(&idx->header, sizeof idx->header, 1, fp) == 1 &&
+              idx->header.magic == TRACE_INDEX_MAGIC &&
+              idx->header.version == TRACE_INDEX_VERSION &&
+              idx->header.trace_size == trace_size;
+
+    if (ok)
+    {
+        idx->entries.resize(idx->header.chunk_count);
+        idx->checkpoints.resize(idx->header.checkpoint_count);
+        idx->pcs.resize(idx->header.pc_count);
+        idx->runs.resize((size_t)idx->header.run_count);
+
+        if (!idx->entries.empty())
+            ok = fread(&idx->entries[0], sizeof idx->entries[0], idx->entries.size(), fp) == idx->entries.size();
+        if (ok && !idx->checkpoints.empty())
+            ok = fread(&idx->checkpoints[0], sizeof idx->checkpoints[0], idx->checkpoints.size(), fp) == idx->checkpoints.size();
+        if (ok && !idx->pcs.empty())
+            ok = fread(&idx->pcs[0], sizeof idx->pcs[0], idx->pcs.size(), fp) == idx->pcs.size();
+        if (ok && !idx->runs.empty())
+            ok = fread(&idx->runs[0], sizeof idx->runs[0], idx->runs.size(), fp) == idx->runs.size();
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+bool trace_read_chunk(FILE *fp, u64 offset, trace_chunk_header_t *hdr, trace_chunk_t *chunk)
+{
+    if (trace_fseek(fp, offset, SEEK_SET) != 0)
+        return false;
+
+    if (fread(hdr, sizeof *hdr, 1, fp) != 1 || hdr->magic != TRACE_CHUNK_MAGIC)
+        return false;
+
+    chunk->resize(hdr->count);
+    if (hdr->count == 0)
+        return true;
+
+    return fread(&(*chunk)[0], sizeof(trace_record_t), hdr->count, fp) == hdr->count;
+}
+
+bool trace_read_record(FILE *fp, const trace_index_entry_t *e, u32 i, trace_record_t *rec)
+{
+    if (i >= e->count)
+        return false;
+
+    u64 offset = e->offset + sizeof(trace_chunk_header_t) + (u64)i * sizeof(trace_record_t);
+    if (trace_fseek(fp, offset, SEEK_SET) != 0)
+        return false;
+
+    return fread(rec, sizeof *rec, 1, fp) == 1;
+}
+
+//--------------------------------------------------------------------------
+// index
+bool trace_index_build(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    trace_header_t hdr;
+    if (fread(&hdr, sizeof hdr, 1, fp) != 1 || hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    u64 size = file_size(fp);
+    u64 offset = sizeof hdr;
+
+    std::vector<trace_index_entry_t> entries;
+    std::vector<trace_checkpoint_t> checkpoints;
+    // the runs of every pc, and its hits so far
+    std::map<u32, std::vector<trace_index_run_t> > pc_runs;
+    std::map<u32, u64> pc_hits;
+    std::map<u32, u32> chunk_hits;
+    trace_chunk_header_t chdr;
+    trace_chunk_t chunk;
+    u32 magic;
+
+    while (offset < size && trace_fseek(fp, offset, SEEK_SET) == 0 && fread(&magic, sizeof magic, 1, fp) == 1)
+    {
+        if (magic == TRACE_CHECKPOINT_MAGIC)
+        {
+            trace_checkpoint_t cp;
+
+            if (trace_fseek(fp, offset, SEEK_SET) != 0 || fread(&cp, sizeof cp, 1, fp) != 1)
+                break;
+
+            checkpoints.push_back(cp);
+            offset += sizeof cp;
+            continue;
+        }
+
+        if (!trace_read_chunk(fp, offset, &chdr, &chunk))
+            break;
+
+        trace_index_entry_t e;
+        memset(&e, 0, sizeof e);
+        e.offset = offset;
+        e.first = chdr.first;
+        e.count = chdr.count;
+
+        chunk_hits.clear();
+        for (u32 i = 0; i < chdr.count; i++)
+            chunk_hits[chunk[i].pc]++;
+
+        for (std::map<u32, u32>::const_iterator it = chunk_hits.begin(); it != chunk_hits.end(); ++it)
+        {
+            u64 &hits = pc_hits[it->first];
+            trace_index_run_t run;
+
+            run.chunk = (u32)entries.size();
+            run.hits = it->second;
+            run.before = hits;
+            pc_runs[it->first].push_back(run);
+            hits += it->second;
+        }
+
+        entries.push_back(e);
+        offset += sizeof chdr + (u64)chdr.count * sizeof(trace_record_t);
+    }
+
+    fclose(fp);
+
+    std::vector<trace_index_pc_t> pcs;
+    std::vector<trace_index_run_t> runs;
+
+    for (std::map<u32, std::vector<trace_index_run_t> >::const_iterator it = pc_runs.begin(); it != pc_runs.end(); ++it)
+    {
+        trace_index_pc_t p;
+        p.pc = it->first;
+        p.run_count = (u32)it->second.size();
+        p.first_run = runs.size();
+
+        pcs.push_back(p);
+        runs.insert(runs.end(), it->second.begin(), it->second.end());
+    }
+
+    return write_index(path, size, entries, checkpoints, pcs, runs);
+
+/*
+	// emulator side. trace_add runs for every instruction retired; a
+	// checkpoint is only written between two chunks.
+	static trace_record_t chunk[TRACE_CHUNK_RECORDS];
+	static u32 count;
+	static u64 icount, checkpointed;
+
+	void trace_flush(void)
+	{
+		trace_chunk_header_t hdr = { TRACE_CHUNK_MAGIC, count, icount - count };
+
+		if (count == 0)
+			return;
+		fwrite(&hdr, sizeof hdr, 1, trace_fp);
+		fwrite(chunk, sizeof chunk[0], count, trace_fp);
+		count = 0;
+
+		if (icount - checkpointed >= TRACE_CHECKPOINT_INTERVAL)
+		{
+			static trace_checkpoint_t cp;
+
+			cp.magic = TRACE_CHECKPOINT_MAGIC;
+			cp.pc = ctx->pc;
+			cp.icount = icount;
+			memcpy(cp.reg, ctx->reg, sizeof cp.reg);
+			fwrite(&cp, sizeof cp, 1, trace_fp);
+			checkpointed = icount;
+		}
+	}
+
+	void trace_add(u32 pc, u32 insn)
+	{
+		chunk[count].pc = pc;
+		chunk[count].insn = insn;
+		count++;
+		icount++;
+		if (count == TRACE_CHUNK_RECORDS)
+			trace_flush();
+	}
+*/
+}
+
+trace_index_t *trace_index_open(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    u64 size = file_size(fp);
+
+    trace_index_t *idx = new trace_index_t;
+    idx->fp = fp;
+    idx->path = strdup(path);
+    idx->cached = (u32)-1;
+
+    if (!read_index(idx, path, size))
+    {
+        if (!trace_index_build(path) || !read_index(idx, path, size))
+        {
+            trace_index_close(idx);
+            return NULL;
+        }
+    }
+
+    return idx;
+}
+
+void trace_index_close(trace_index_t *idx)
+{
+    if (idx == NULL)
+        return;
+
+    fclose(idx->fp);
+    free(idx->path);
+    delete idx;
+}
+
+u64 trace_index_count(const trace_index_t *idx)
+{
+    return idx->header.instruction_count;
+}
+
+const trace_chunk_t *trace_index_chunk(trace_index_t *idx, u32 chunk)
+{
+    if (chunk >= idx->entries.size())
+        return NULL;
+
+    if (idx->cached != chunk)
+    {
+        trace_chunk_header_t hdr;
+
+        idx->cached = (u32)-1;
+        if (!trace_read_chunk(idx->fp, idx->entries[chunk].offset, &hdr, &idx->chunk))
+            return NULL;
+        idx->cached = chunk;
+    }
+
+    return &idx->chunk;
+}
+
+// last chunk whose first instruction is <= n
+static u32 find_chunk(const trace_index_t *idx, u64 n)
+{
+    u32 lo = 0;
+    u32 hi = (u32)idx->entries.size();
+
+    while (hi - lo > 1)
+    {
+        u32 mid = lo + (hi - lo) / 2;
+        if (idx->entries[mid].first <= n)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+bool trace_index_seek(trace_index_t *idx, u64 n, trace_record_t *rec)
+{
+    if (n >= trace_index_count(idx))
+        return false;
+
+    u32 c = find_chunk(idx, n);
+    const trace_chunk_t *chunk = trace_index_chunk(idx, c);
+    if (chunk == NULL)
+        return false;
+
+    u64 i = n - idx->entries[c].first;
+    if (i >= chunk->size())
+        return false;
+
+    *rec = (*chunk)[(size_t)i];
+    return true;
+}
+
+bool trace_index_find_pc(trace_index_t *idx, u32 pc, u64 nth, u64 from, u64 *icount)
+{
+    if (idx->entries.empty() || from >= trace_index_count(idx))
+        return false;
+
+    // the pc
+    size_t lo = 0;
+    size_t hi = idx->pcs.size();
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->pcs[mid].pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == idx->pcs.size() || idx->pcs[lo].pc != pc)
+        return false;
+
+    const trace_index_run_t *runs = &idx->runs[(size_t)idx->pcs[lo].first_run];
+    u32 count = idx->pcs[lo].run_count;
+
+    // the first run at or after the chunk holding "from"
+    u32 c = find_chunk(idx, from);
+    u32 r = 0;
+    u32 end = count;
+    while (r < end)
+    {
+        u32 mid = r + (end - r) / 2;
+        if (runs[mid].chunk < c)
+            r = mid + 1;
+        else
+            end = mid;
+    }
+
+    if (r == count)
+        return false;
+
+    // hits before "from" in its own chunk are counted off it
+    u64 skip = runs[r].before;
+    if (runs[r].chunk == c && from > idx->entries[c].first)
+    {
+        const trace_chunk_t *chunk = trace_index_chunk(idx, c);
+        if (chunk == NULL)
+            return false;
+
+        u32 n = (u32)(from - idx->entries[c].first);
+        for (u32 i = 0; i < n && i < chunk->size(); i++)
+        {
+            if ((*chunk)[i].pc == pc)
+                skip++;
+        }
+    }
+
+    const trace_index_run_t &last = runs[count - 1];
+    if (nth >= last.before + last.hits - skip)
+        return false;
+
+    // the run holding hit number "target"
+    u64 target = skip + nth;
+    end = count;
+    while (end - r > 1)
+    {
+        u32 mid = r + (end - r) / 2;
+        if (runs[mid].before <= target)
+            r = mid;
+        else
+            end = mid;
+    }
+
+    const trace_index_run_t &run = runs[r];
+    const trace_chunk_t *chunk = trace_index_chunk(idx, run.chunk);
+    if (chunk == NULL)
+        return false;
+
+    u64 left = target - run.before;
+    for (u32 i = 0; i < chunk->size(); i++)
+    {
+        if ((*chunk)[i].pc == pc && left-- == 0)
+        {
+            *icount = idx->entries[run.chunk].first + i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const trace_checkpoint_t *trace_index_checkpoint(const trace_index_t *idx, u64 n)
+{
+    const trace_checkpoint_t *best = NULL;
+    size_t lo = 0;
+    size_t hi = idx->checkpoints.size();
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->checkpoints[mid].icount <= n)
+        {
+            best = &idx->checkpoints[mid];
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return best;
+}
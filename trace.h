@@ -0,0 +1,152 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stdio.h>
+#include <vector>
+#include "types.h"
+
+//
+//      Instruction trace files
+//
+//      A trace is a header followed by chunks of records. Each record is the
+//      PC and the raw instruction word that retired there, in execution order.
+//      Between chunks the producer may write register checkpoints, about
+//      every TRACE_CHECKPOINT_INTERVAL instructions. Chunks are variable sized
+//      (a producer may flush early, e.g. on a stop), so random access goes
+//      through an index sidecar ("<trace>.idx") holding:
+//
+//        - the file offset, first instruction number and record count of
+//          every chunk (binary searched for "instruction N")
+//        - every PC, with the chunks it was hit in, how often, and how often
+//          in all chunks before. "The nth hit of PC X" is two binary
+//          searches and one chunk read.
+//        - the register checkpoints, so the registers before instruction N
+//          are those of the last checkpoint at or before it
+//
+//      The sidecar is built the first time a trace is opened, and again
+//      whenever the trace changed size. The emulator side of writing a trace
+//      is reference code in trace_index_build.
+//
+//      All fields are stored in host byte order.
+//
+
+#define TRACE_MAGIC             0x54555053      // 'SPUT'
+#define TRACE_CHUNK_MAGIC       0x4B4E4843      // 'CHNK'
+#define TRACE_CHECKPOINT_MAGIC  0x54504B43      // 'CKPT'
+#define TRACE_INDEX_MAGIC       0x49555053      // 'SPUI'
+#define TRACE_VERSION           1
+#define TRACE_INDEX_VERSION     2
+
+#define TRACE_CHUNK_RECORDS     65536
+#define TRACE_CHECKPOINT_INTERVAL   (1024 * 1024)
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 chunk_records;          // maximum records per chunk
+    u32 reserved;
+} trace_header_t;
+
+typedef struct
+{
+    u32 magic;
+    u32 count;                  // records in this chunk
+    u64 first;                  // instruction number of the first record
+} trace_chunk_header_t;
+
+typedef struct
+{
+    u32 pc;
+    u32 insn;
+} trace_record_t;
+
+// in the trace between two chunks, and in the sidecar
+typedef struct
+{
+    u32 magic;                  // TRACE_CHECKPOINT_MAGIC
+    u32 pc;
+    u64 icount;                 // registers are the state before this instruction
+    u32 reg[128][4];
+} trace_checkpoint_t;
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 chunk_count;
+    u32 checkpoint_count;
+    u64 trace_size;             // size of the trace the index was built for
+    u64 instruction_count;
+    u32 pc_count;
+    u32 reserved;
+    u64 run_count;
+} trace_index_header_t;
+
+typedef struct
+{
+    u64 offset;                 // file offset of the chunk header
+    u64 first;
+    u32 count;
+    u32 reserved;
+} trace_index_entry_t;
+
+// runs[first_run .. first_run + run_count) are the chunks pc was hit in
+typedef struct
+{
+    u32 pc;
+    u32 run_count;
+    u64 first_run;
+} trace_index_pc_t;
+
+typedef struct
+{
+    u32 chunk;
+    u32 hits;                   // of the pc in this chunk
+    u64 before;                 // of the pc in all earlier chunks
+} trace_index_run_t;
+
+#pragma pack(pop)
+
+typedef std::vector<trace_record_t> trace_chunk_t;
+
+//--------------------------------------------------------------------------
+// Random access over an indexed trace.
+struct trace_index_t
+{
+    FILE *fp;
+    char *path;
+    trace_index_header_t header;
+    std::vector<trace_index_entry_t> entries;
+    std::vector<trace_checkpoint_t> checkpoints;
+    std::vector<trace_index_pc_t> pcs;          // sorted by pc
+    std::vector<trace_index_run_t> runs;
+
+    // the last decoded chunk
+    u32 cached;
+    trace_chunk_t chunk;
+};
+
+// opens "path" and its sidecar, rebuilding the sidecar when it is missing
+// or stale
+trace_index_t *trace_index_open(const char *path);
+void trace_index_close(trace_index_t *idx);
+bool trace_index_build(const char *path);
+
+u64 trace_index_count(const trace_index_t *idx);
+bool trace_index_seek(trace_index_t *idx, u64 n, trace_record_t *rec);
+// icount of the nth (0-based) execution of pc at or after "from"
+bool trace_index_find_pc(trace_index_t *idx, u32 pc, u64 nth, u64 from, u64 *icount);
+// the last checkpoint at or before instruction n, or NULL
+const trace_checkpoint_t *trace_index_checkpoint(const trace_index_t *idx, u64 n);
+
+const trace_chunk_t *trace_index_chunk(trace_index_t *idx, u32 chunk);
+bool trace_read_chunk(FILE *fp, u64 offset, trace_chunk_header_t *hdr, trace_chunk_t *chunk);
+bool trace_read_record(FILE *fp, const trace_index_entry_t *e, u32 i, trace_record_t *rec);
+
+#endif
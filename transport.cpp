@@ -0,0 +1,669 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#include "transport.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
+#ifdef _WIN32
+#define _WINSOCKAPI_
+#define NOMINMAX
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// segments handed to one writev/WSASend
+#define TRANSPORT_IOV_BATCH     260
+
+// longest a shared memory wait sleeps before looking at the closed flag
+#define SHM_SLICE_USEC          100000
+
+#define SHM_FOREVER             (~0u)
+
+typedef struct
+{
+    const char *name;
+    bool (*open)(const char *target, u32 port);
+    void (*close)(void);
+    bool (*sendv)(const transport_iov_t *iov, u32 count);
+    int (*recv)(void *p, u32 len);
+    int (*wait)(u32 usec);
+} transport_ops_t;
+
+static const transport_ops_t *ops = NULL;
+
+//--------------------------------------------------------------------------
+// TCP and Unix-domain sockets
+#ifdef _WIN32
+typedef SOCKET socket_t;
+#define INVALID_SOCK    INVALID_SOCKET
+
+// afunix.h is not in older SDKs
+#ifndef AF_UNIX
+#define AF_UNIX         1
+#endif
+typedef struct
+{
+    ADDRESS_FAMILY sun_family;
+    char sun_path[108];
+} transport_sockaddr_un;
+#else
+typedef int socket_t;
+#define INVALID_SOCK    -1
+#define closesocket     close
+typedef struct sockaddr_un transport_sockaddr_un;
+#endif
+
+static socket_t sock = INVALID_SOCK;
+
+#ifdef _WIN32
+static WSADATA wsa_data;
+#endif
+
+static bool socket_startup(void)
+{
+#ifdef _WIN32
+    return WSAStartup(MAKEWORD(2,2), &wsa_data) == 0;
+#else
+    return true;
+#endif
+}
+
+static void socket_close(void)
+{
+    if (sock != INVALID_SOCK)
+    {
+        closesocket(sock);
+        sock = INVALID_SOCK;
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static bool tcp_open(const char *host, u32 port)
+{
+    struct addrinfo hints, *list, *ai;
+    char service[16];
+    int on = 1;
+
+    if (!socket_startup())
+        return false;
+
+    if (host == NULL || host[0] == 0)
+        host = "127.0.0.1";
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &list) != 0)
+        return false;
+
+    for (ai = list; ai != NULL; ai = ai->ai_next)
+    {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == INVALID_SOCK)
+            continue;
+
+        if (connect(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+            break;
+
+        closesocket(sock);
+        sock = INVALID_SOCK;
+    }
+
+    freeaddrinfo(list);
+
+    if (sock == INVALID_SOCK)
+        return false;
+
+    // every packet is a single write; don't hold it back for the ack
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof on);
+
+    return true;
+}
+
+static bool unix_open(const char *path, u32 port)
+{
+    transport_sockaddr_un addr;
+
+    (void)port;
+
+    if (!socket_startup())
+        return false;
+
+    if (strlen(path) >= sizeof addr.sun_path)
+        return false;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCK)
+        return false;
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof addr) != 0)
+    {
+        closesocket(sock);
+        sock = INVALID_SOCK;
+        return false;
+    }
+
+    return true;
+}
+
+static bool socket_sendv(const transport_iov_t *iov, u32 count)
+{
+#ifdef _WIN32
+    WSABUF v[TRANSPORT_IOV_BATCH];
+#else
+    struct iovec v[TRANSPORT_IOV_BATCH];
+#endif
+
+    while (count > 0)
+    {
+        u32 n = std::min(count, (u32)TRANSPORT_IOV_BATCH);
+        u32 i;
+
+        for (i = 0; i < n; i++)
+        {
+#ifdef _WIN32
+            v[i].buf = (char *)iov[i].base;
+            v[i].len = iov[i].len;
+#else
+            v[i].iov_base = (void *)iov[i].base;
+            v[i].iov_len = iov[i].len;
+#endif
+        }
+
+        // resumed after partial sends
+        i = 0;
+        while (i < n)
+        {
+#ifdef _WIN32
+            DWORD sent = 0;
+            if (WSASend(sock, v + i, n - i, &sent, 0, NULL, NULL) != 0)
+                return false;
+
+            while (i < n && sent >= v[i].len)
+                sent -= v[i++].len;
+            if (i < n)
+            {
+                v[i].buf += sent;
+                v[i].len -= sent;
+            }
+#else
+            ssize_t sent = writev(sock, v + i, n - i);
+            if (sent < 0)
+                return false;
+
+            while (i < n && (size_t)sent >= v[i].iov_len)
+                sent -= v[i++].iov_len;
+            if (i < n)
+            {
+                v[i].iov_base = (char *)v[i].iov_base + sent;
+                v[i].iov_len -= sent;
+            }
+#endif
+        }
+
+        iov += n;
+        count -= n;
+    }
+
+    return true;
+}
+
+static int socket_recv(void *p, u32 len)
+{
+    return recv(sock, (char *)p, len, 0);
+}
+
+static int socket_wait(u32 usec)
+{
+    struct timeval t;
+    fd_set fds;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+
+    t.tv_sec = usec / 1000000;
+    t.tv_usec = usec % 1000000;
+
+    if (select((int)sock + 1, &fds, NULL, NULL, &t) < 0)
+        return -1;
+
+    return FD_ISSET(sock, &fds) ? 1 : 0;
+}
+
+static const transport_ops_t tcp_ops = { "tcp", tcp_open, socket_close, socket_sendv, socket_recv, socket_wait };
+static const transport_ops_t unix_ops = { "unix", unix_open, socket_close, socket_sendv, socket_recv, socket_wait };
+
+//--------------------------------------------------------------------------
+// Shared memory rings
+enum
+{
+    SHM_DATA_TO_STUB,
+    SHM_SPACE_TO_STUB,
+    SHM_DATA_TO_DEBUGGER,
+    SHM_SPACE_TO_DEBUGGER,
+    SHM_EVENTS
+};
+
+static transport_shm_t *shm = NULL;
+
+#ifdef _WIN32
+static HANDLE shm_mapping = NULL;
+static HANDLE shm_events[SHM_EVENTS];
+#else
+static size_t shm_size;
+#endif
+
+static void shm_sleep(std::atomic<u32> *word, u32 seen, u32 event, u32 usec)
+{
+    // each platform uses only some of these
+    (void)word;
+    (void)seen;
+    (void)event;
+
+#ifdef _WIN32
+    WaitForSingleObject(shm_events[event], (usec + 999) / 1000);
+#elif defined(__linux__)
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    syscall(SYS_futex, (u32 *)word, FUTEX_WAIT, seen, &ts, NULL, 0);
+#else
+    usleep(std::min(usec, 100u));
+#endif
+}
+
+static void shm_wake(std::atomic<u32> *word, u32 event)
+{
+    (void)word;
+    (void)event;
+
+#ifdef _WIN32
+    SetEvent(shm_events[event]);
+#elif defined(__linux__)
+    syscall(SYS_futex, (u32 *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+// waits until *word no longer holds seen. The waiting flag is raised
+// before the final check, so a producer that moves *word after that check
+// sees the flag and wakes us.
+static bool shm_wait(std::atomic<u32> *word, u32 seen, std::atomic<u32> *waiting, u32 event, u32 usec)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        if (word->load() != seen)
+            return true;
+
+        if (shm->closed.load() != 0)
+            return false;
+
+        u32 left = SHM_SLICE_USEC;
+        if (usec != SHM_FOREVER)
+        {
+            u64 spent = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            if (spent >= usec)
+                return false;
+            left = (u32)std::min((u64)left, usec - spent);
+        }
+
+        waiting->store(1);
+        if (word->load() == seen)
+            shm_sleep(word, seen, event, left);
+        waiting->store(0);
+    }
+}
+
+static void shm_close(void)
+{
+#ifdef _WIN32
+    if (shm != NULL)
+        UnmapViewOfFile(shm);
+    if (shm_mapping != NULL)
+        CloseHandle(shm_mapping);
+    for (int i = 0; i < SHM_EVENTS; i++)
+    {
+        if (shm_events[i] != NULL)
+            CloseHandle(shm_events[i]);
+        shm_events[i] = NULL;
+    }
+    shm_mapping = NULL;
+#else
+    if (shm != NULL)
+        munmap(shm, shm_size);
+#endif
+    shm = NULL;
+}
+
+static bool shm_open_segment(const char *name, u32 port)
+{
+    (void)port;
+
+#ifdef _WIN32
+    static const char *suffix[SHM_EVENTS] = { ".d0", ".s0", ".d1", ".s1" };
+    char event_name[MAX_PATH];
+
+    if (strlen(name) + 4 > sizeof event_name)
+        return false;
+
+    shm_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (shm_mapping == NULL)
+        return false;
+
+    shm = (transport_shm_t *)MapViewOfFile(shm_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(transport_shm_t));
+
+    // shm stays set on failure, so that shm_close unmaps it
+    bool ok = shm != NULL;
+    for (int i = 0; i < SHM_EVENTS; i++)
+    {
+        sprintf(event_name, "%s%s", name, suffix[i]);
+        shm_events[i] = OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, event_name);
+        if (shm_events[i] == NULL)
+            ok = false;
+    }
+
+    if (!ok)
+    {
+        shm_close();
+        return false;
+    }
+#else
+    char path[256];
+    struct stat st;
+
+    if (strlen(name) + 2 > sizeof path)
+        return false;
+
+    sprintf(path, "%s%s", name[0] == '/' ? "" : "/", name);
+
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0)
+        return false;
+
+    shm_size = sizeof(transport_shm_t);
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= shm_size)
+    {
+        void *p = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            shm = (transport_shm_t *)p;
+    }
+
+    close(fd);
+#endif
+
+    if (shm == NULL ||
+        shm->magic != TRANSPORT_SHM_MAGIC ||
+        shm->version != TRANSPORT_SHM_VERSION ||
+        shm->ring_size != TRANSPORT_RING_SIZE)
+    {
+        shm_close();
+        return false;
+    }
+
+    return true;
+
+/*
+	// emulator side, before waiting for the debugger. Either side sets
+	// closed when it goes away.
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	ftruncate(fd, sizeof(transport_shm_t));
+	shm = (transport_shm_t *)mmap(NULL, sizeof(transport_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	shm->version = TRANSPORT_SHM_VERSION;
+	shm->ring_size = TRANSPORT_RING_SIZE;
+	std::atomic_thread_fence(std::memory_order_release);
+	shm->magic = TRANSPORT_SHM_MAGIC;
+
+	// gdb_read_byte and gdb_reply then use to_stub and to_debugger the way
+	// shm_recv and shm_sendv below use them the other way round
+*/
+}
+
+static void shm_detach(void)
+{
+    if (shm != NULL)
+        shm->closed.store(1);
+
+    shm_close();
+}
+
+static bool shm_sendv(const transport_iov_t *iov, u32 count)
+{
+    transport_ring_t *r = &shm->to_stub;
+    u32 head = r->head.load(std::memory_order_relaxed);
+
+    for (u32 i = 0; i < count; i++)
+    {
+        const u8 *src = (const u8 *)iov[i].base;
+        u32 left = iov[i].len;
+
+        while (left > 0)
+        {
+            u32 tail = r->tail.load(std::memory_order_acquire);
+            u32 space = TRANSPORT_RING_SIZE - (head - tail);
+
+            if (space == 0)
+            {
+                // publish what we have and wait for the stub to drain it
+                r->head.store(head, std::memory_order_release);
+                if (r->data_waiting.load())
+                    shm_wake(&r->head, SHM_DATA_TO_STUB);
+
+                if (!shm_wait(&r->tail, tail, &r->space_waiting, SHM_SPACE_TO_STUB, SHM_FOREVER))
+                    return false;
+                continue;
+            }
+
+            u32 off = head & (TRANSPORT_RING_SIZE - 1);
+            u32 n = std::min(std::min(left, space), TRANSPORT_RING_SIZE - off);
+
+            memcpy(r->data + off, src, n);
+            src += n;
+            left -= n;
+            head += n;
+        }
+    }
+
+    r->head.store(head, std::memory_order_release);
+    if (r->data_waiting.load())
+        shm_wake(&r->head, SHM_DATA_TO_STUB);
+
+    return true;
+}
+
+static int shm_recv(void *p, u32 len)
+{
+    transport_ring_t *r = &shm->to_debugger;
+    u32 tail = r->tail.load(std::memory_order_relaxed);
+
+    if (!shm_wait(&r->head, tail, &r->data_waiting, SHM_DATA_TO_DEBUGGER, SHM_FOREVER))
+        return -1;
+
+    u32 head = r->head.load(std::memory_order_acquire);
+    u32 off = tail & (TRANSPORT_RING_SIZE - 1);
+    u32 n = std::min(len, head - tail);
+    u32 first = std::min(n, (u32)TRANSPORT_RING_SIZE - off);
+
+    memcpy(p, r->data + off, first);
+    memcpy((u8 *)p + first, r->data, n - first);
+
+    r->tail.store(tail + n, std::memory_order_release);
+    if (r->space_waiting.load())
+        shm_wake(&r->tail, SHM_SPACE_TO_DEBUGGER);
+
+    return n;
+}
+
+static int shm_wait_readable(u32 usec)
+{
+    transport_ring_t *r = &shm->to_debugger;
+
+    if (shm_wait(&r->head, r->tail.load(std::memory_order_relaxed), &r->data_waiting, SHM_DATA_TO_DEBUGGER, usec))
+        return 1;
+
+    return shm->closed.load() != 0 ? -1 : 0;
+}
+
+static const transport_ops_t shm_ops = { "shm", shm_open_segment, shm_detach, shm_sendv, shm_recv, shm_wait_readable };
+
+//--------------------------------------------------------------------------
+// what transport_select swaps
+typedef struct
+{
+    bool used;
+    const transport_ops_t *ops;
+    socket_t sock;
+    transport_shm_t *shm;
+#ifdef _WIN32
+    HANDLE shm_mapping;
+    HANDLE shm_events[SHM_EVENTS];
+#else
+    size_t shm_size;
+#endif
+} transport_connection_t;
+
+static transport_connection_t connections[TRANSPORT_CONNECTIONS];
+static u32 selected = 0;
+
+void transport_select(u32 connection)
+{
+    if (connection >= TRANSPORT_CONNECTIONS || connection == selected)
+        return;
+
+    transport_connection_t *c = &connections[selected];
+    c->used = true;
+    c->ops = ops;
+    c->sock = sock;
+    c->shm = shm;
+#ifdef _WIN32
+    c->shm_mapping = shm_mapping;
+    memcpy(c->shm_events, shm_events, sizeof shm_events);
+#else
+    c->shm_size = shm_size;
+#endif
+
+    selected = connection;
+    c = &connections[selected];
+    if (!c->used)
+    {
+        ops = NULL;
+        sock = INVALID_SOCK;
+        shm = NULL;
+#ifdef _WIN32
+        shm_mapping = NULL;
+        memset(shm_events, 0, sizeof shm_events);
+#endif
+        return;
+    }
+
+    ops = c->ops;
+    sock = c->sock;
+    shm = c->shm;
+#ifdef _WIN32
+    shm_mapping = c->shm_mapping;
+    memcpy(shm_events, c->shm_events, sizeof shm_events);
+#else
+    shm_size = c->shm_size;
+#endif
+}
+
+bool transport_open(const char *host, u32 port)
+{
+    if (host == NULL)
+        host = "";
+
+    if (strncmp(host, "unix:", 5) == 0)
+    {
+        ops = &unix_ops;
+        host += 5;
+    }
+    else if (strncmp(host, "shm:", 4) == 0)
+    {
+        ops = &shm_ops;
+        host += 4;
+    }
+    else
+        ops = &tcp_ops;
+
+    if (!ops->open(host, port))
+    {
+        ops->close();
+        return false;
+    }
+
+    return true;
+}
+
+void transport_close(void)
+{
+    if (ops != NULL)
+        ops->close();
+}
+
+bool transport_is_open(void)
+{
+    return ops == &shm_ops ? shm != NULL : sock != INVALID_SOCK;
+}
+
+const char *transport_name(void)
+{
+    return ops != NULL ? ops->name : "none";
+}
+
+bool transport_sendv(const transport_iov_t *iov, u32 count)
+{
+    return transport_is_open() && ops->sendv(iov, count);
+}
+
+bool transport_send(const void *p, u32 len)
+{
+    transport_iov_t iov = { p, len };
+
+    return transport_sendv(&iov, 1);
+}
+
+int transport_recv(void *p, u32 len)
+{
+    if (!transport_is_open())
+        return -1;
+
+    return ops->recv(p, len);
+}
+
+int transport_wait(u32 usec)
+{
+    if (!transport_is_open())
+        return -1;
+
+    return ops->wait(usec);
+}
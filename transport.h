@@ -0,0 +1,80 @@
+// Licensed under the terms of the GNU GPL, version 2
+// http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+
+#ifndef TRANSPORT_H__
+#define TRANSPORT_H__
+
+#include <atomic>
+#include "types.h"
+
+//
+//      Byte stream to the emulator's gdb stub
+//
+//      The backend is picked by the host name given to the debugger:
+//
+//        unix:/path      Unix-domain stream socket (Windows 10 1803 or later)
+//        shm:name        a pair of ring buffers in shared memory
+//        anything else   TCP to that host (empty means 127.0.0.1) and port
+//
+//      The shared memory segment is created by the emulator and laid out as
+//      transport_shm_t: one ring per direction, each with a single producer
+//      and a single consumer. head and tail are free running byte counts.
+//      A side that finds its ring empty (or full) sets the matching waiting
+//      flag, re-checks and sleeps; the other side wakes it after moving head
+//      (or tail) if the flag is set. On Linux the sleep is a futex on head or
+//      tail. On Windows it is a named auto-reset event, "<name>.d0"/"<name>.s0"
+//      (data/space) for the debugger to stub ring and ".d1"/".s1" for the
+//      other one.
+//
+
+#define TRANSPORT_SHM_MAGIC     0x4d485350      // 'PSHM'
+#define TRANSPORT_SHM_VERSION   1
+#define TRANSPORT_RING_SIZE     (256 * 1024)    // power of two
+
+typedef struct
+{
+    std::atomic<u32> head;      // written by the producer
+    std::atomic<u32> tail;      // written by the consumer
+    std::atomic<u32> data_waiting;
+    std::atomic<u32> space_waiting;
+    u8 data[TRANSPORT_RING_SIZE];
+} transport_ring_t;
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 ring_size;
+    std::atomic<u32> closed;    // set by whichever side goes away first
+    transport_ring_t to_stub;
+    transport_ring_t to_debugger;
+} transport_shm_t;
+
+typedef struct
+{
+    const void *base;
+    u32 len;
+} transport_iov_t;
+
+// connection 0 is the debugger's own and the one selected at start. The
+// others are for driving further emulators (lockstep). Each keeps its own
+// backend and handles; the functions below use the selected one.
+#define TRANSPORT_CONNECTIONS   3
+
+void transport_select(u32 connection);
+
+bool transport_open(const char *host, u32 port);
+void transport_close(void);
+bool transport_is_open(void);
+// the backend the last transport_open picked, for messages
+const char *transport_name(void);
+
+// all segments, in order. false if the connection failed
+bool transport_sendv(const transport_iov_t *iov, u32 count);
+bool transport_send(const void *p, u32 len);
+// blocks until at least one byte arrived; <= 0 if the connection failed
+int transport_recv(void *p, u32 len);
+// 1 if there is something to read, 0 after usec without, < 0 on failure
+int transport_wait(u32 usec);
+
+#endif